@@ -0,0 +1,168 @@
+/*
+* gen.c - traffic of the other nodes on the bus
+*
+* Frames become ready at a rate that fills load percent of the bus time,
+* with +-50% jitter, whether or not the bus kept up with earlier ones.
+* Every frame carries a sequence number per identifier in its first data
+* bytes and a check value of identifier and sequence in the rest, so the
+* receiving side can tell lost, duplicated, reordered and corrupted
+* frames apart. Identifiers of the generator are odd, main.c transmits
+* even ones, so no two nodes ever send the same identifier.
+*/
+
+#include "sim.h"
+
+u32 sim_rand(u32 *state)
+{
+        u32 x = *state;
+
+        /* xorshift32 */
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *state = x;
+        return x;
+}
+
+unsigned int sim_frame_bits(const struct sim_frame *f)
+{
+        unsigned int dlc = (f->id & CAN_RTR_FLAG) ? 0 : f->dlc;
+
+        /* bit stuffing is not modelled */
+        return ((f->id & CAN_EFF_FLAG) ? 67 : 47) + 8 * dlc;
+}
+
+static u32 sim_frame_hash(canid_t id, u32 seq)
+{
+        return hash_32(id ^ (seq * 0x61c88647U), 32) ^ 0x5a5a5a5aU;
+}
+
+/* sequence in data[0..min(dlc, 4) - 1], check value in the bytes after it */
+void sim_frame_stamp(struct sim_frame *f, u32 seq)
+{
+        unsigned int n = min_t(unsigned int, f->dlc, 4);
+        u32 check = sim_frame_hash(f->id, seq);
+        unsigned int i;
+
+        for (i = 0; i < n; i++)
+                f->data[i] = seq >> (8 * i);
+        for (i = n; i < f->dlc; i++)
+                f->data[i] = check >> (8 * (i - n));
+}
+
+/*
+* returns the number of sequence bytes the frame carries, with the
+* sequence in seq, or -1 if the check value does not match
+*/
+int sim_frame_check(const struct sim_frame *f, u32 *seq)
+{
+        unsigned int n = min_t(unsigned int, f->dlc, 4);
+        unsigned int i;
+        u32 check;
+
+        *seq = 0;
+        for (i = 0; i < n; i++)
+                *seq |= (u32)f->data[i] << (8 * i);
+
+        /* the check value covers the whole sequence only with 4 bytes of it */
+        if (n < 4)
+                return n;
+
+        check = sim_frame_hash(f->id, *seq);
+        for (i = n; i < f->dlc; i++) {
+                if (f->data[i] != (u8)(check >> (8 * (i - n))))
+                        return -1;
+        }
+
+        return n;
+}
+
+static s64 sim_gen_interval(struct sim_gen *g, const struct sim_frame *f)
+{
+        s64 ns = (s64)sim_frame_bits(f) * g->bit_ns * 100 / g->load;
+
+        return ns / 2 + (s64)(sim_rand(&g->rng) % 1000) * ns / 1000;
+}
+
+static void sim_gen_next(struct sim_gen *g)
+{
+        struct sim_frame *f = &g->next;
+        unsigned int i = sim_rand(&g->rng) % g->ids;
+
+        f->id = g->id[i];
+        f->dlc = g->dlc < 0 ? sim_rand(&g->rng) % 9 : g->dlc;
+        memset(f->data, 0, sizeof(f->data));
+        sim_frame_stamp(f, g->seq[i]++);
+}
+
+void sim_gen_init(struct sim_gen *g, u32 seed, s64 start_ns)
+{
+        unsigned int i, j;
+        canid_t id;
+
+        g->rng = seed ? seed : 1;
+        g->ids = clamp_t(unsigned int, g->ids, 1, ARRAY_SIZE(g->id));
+        g->has_retry = false;
+        g->offered = 0;
+
+        for (i = 0; i < g->ids; i++) {
+again:
+                if (sim_rand(&g->rng) % 100 < g->eff_pct)
+                        id = ((sim_rand(&g->rng) & CAN_EFF_MASK) | 1) | CAN_EFF_FLAG;
+                else
+                        id = (sim_rand(&g->rng) & CAN_SFF_MASK) | 1;
+                for (j = 0; j < i; j++)
+                        if (g->id[j] == id)
+                                goto again;
+                g->id[i] = id;
+                g->seq[i] = 0;
+        }
+
+        if (!g->load) {
+                g->next_ns = KTIME_MAX;
+                return;
+        }
+        sim_gen_next(g);
+        g->next_ns = start_ns + sim_gen_interval(g, &g->next);
+}
+
+/* the frame sent next and the time it is ready, false if there is none */
+bool sim_gen_peek(struct sim_gen *g, s64 *ready, struct sim_frame *f)
+{
+        if (g->has_retry) {
+                *ready = g->retry_ns;
+                *f = g->retry;
+                return true;
+        }
+        if (g->next_ns == KTIME_MAX)
+                return false;
+
+        *ready = g->next_ns;
+        *f = g->next;
+        return true;
+}
+
+/* the frame returned by sim_gen_peek() went on the bus */
+void sim_gen_pop(struct sim_gen *g)
+{
+        if (g->has_retry) {
+                g->has_retry = false;
+                return;
+        }
+
+        g->offered++;
+        if (g->next_ns == KTIME_MAX)
+                return;
+        sim_gen_next(g);
+        g->next_ns += sim_gen_interval(g, &g->next);
+}
+
+/* a frame destroyed by a bus error is sent again ahead of new ones */
+void sim_gen_retry(struct sim_gen *g, const struct sim_frame *f, s64 ready)
+{
+        if (!g->has_retry)
+                sim_gen_pop(g);
+        g->retry = *f;
+        g->retry_ns = ready;
+        g->has_retry = true;
+}
@@ -0,0 +1,1786 @@
+/*
+* kernel.c - the kernel services sunxi_can.c uses, for the simulation
+*
+* Nothing runs concurrently: main.c drives an event loop that calls the
+* interrupt handlers, timers, NAPI polls, work items and start_xmit one
+* at a time, in kernel priority order. What this file adds on top of
+* plain stubs is the bookkeeping of that loop and the checks the kernel
+* would make at run time: execution context, locks held across calls
+* that may sleep, skbs leaked or freed in the wrong context.
+*/
+
+#include <stdarg.h>
+#include <time.h>
+
+#include "sim.h"
+
+#define SIM_T0 (100 * NSEC_PER_SEC)        /* ktime_get() at start, never 0 */
+#define SIM_MAX_OBJS 256
+
+struct sim_costs sim_costs = {
+        .mmio_read_ns = 200,
+        .mmio_write_ns = 120,
+        .barrier_ns = 40,
+        .irq_ns = 1500,
+        .softirq_ns = 500,
+        .stack_ns = 2000,
+        .xmit_ns = 3000,
+};
+bool sim_verbose;
+unsigned long sim_clk_rate = 24000000;
+unsigned long sim_warnings;
+unsigned long sim_skbs;
+s64 sim_act_ns[SIM_ACT_NR];
+u64 sim_host_ns[SIM_ACT_NR];
+u64 sim_mmio[SIM_ACT_NR];
+
+unsigned long jiffies = INITIAL_JIFFIES;
+static s64 now_ns = SIM_T0;
+
+static struct task_struct init_task;
+struct task_struct *current = &init_task;
+
+/* execution context */
+static enum sim_act act = SIM_ACT_IDLE;
+static int bh_depth;
+static int raw_locks;
+static int locks;
+static u64 host_mark;
+
+static u64 host_clock(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void sim_warn(const char *fmt, ...)
+{
+        va_list ap;
+
+        if (++sim_warnings > 50)
+                return;
+        fprintf(stderr, "[%12.6f] WARNING: ", (double)(now_ns - SIM_T0) / NSEC_PER_SEC);
+        va_start(ap, fmt);
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        fputc('\n', stderr);
+}
+
+int printk(const char *fmt, ...)
+{
+        va_list ap;
+        int n;
+
+        if (!sim_verbose)
+                return 0;
+        fprintf(stderr, "[%12.6f] ", (double)(now_ns - SIM_T0) / NSEC_PER_SEC);
+        va_start(ap, fmt);
+        n = vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        return n;
+}
+
+int net_ratelimit(void)
+{
+        return 1;
+}
+
+/* time */
+s64 sim_now(void)
+{
+        return now_ns;
+}
+
+void sim_set_time(s64 ns)
+{
+        if (ns <= now_ns)
+                return;
+        sim_act_ns[act] += ns - now_ns;
+        now_ns = ns;
+        jiffies = INITIAL_JIFFIES + (now_ns - SIM_T0) / (NSEC_PER_SEC / HZ);
+}
+
+void sim_advance(s64 ns)
+{
+        sim_set_time(now_ns + ns);
+}
+
+ktime_t ktime_get(void)
+{
+        return now_ns;
+}
+
+enum sim_act sim_act(void)
+{
+        return act;
+}
+
+/* host time is accounted exclusively, a nested activity stops its parent's clock */
+enum sim_act sim_act_enter(enum sim_act new)
+{
+        enum sim_act saved = act;
+        u64 t = host_clock();
+
+        if (host_mark)
+                sim_host_ns[act] += t - host_mark;
+        host_mark = t;
+        act = new;
+        return saved;
+}
+
+void sim_act_exit(enum sim_act saved)
+{
+        u64 t = host_clock();
+
+        sim_host_ns[act] += t - host_mark;
+        host_mark = t;
+        act = saved;
+}
+
+int in_irq(void)
+{
+        return act == SIM_ACT_IRQ || act == SIM_ACT_HRTIMER;
+}
+
+int in_interrupt(void)
+{
+        return in_irq() || act == SIM_ACT_SOFTIRQ || bh_depth;
+}
+
+void might_sleep(void)
+{
+        if (in_interrupt() || raw_locks || locks)
+                sim_warn("sleeping function called from atomic context");
+}
+
+void cond_resched(void)
+{
+        might_sleep();
+}
+
+void udelay(unsigned long us)
+{
+        sim_advance(us * NSEC_PER_USEC);
+}
+
+void ndelay(unsigned long ns)
+{
+        sim_advance(ns);
+}
+
+void mdelay(unsigned long ms)
+{
+        sim_advance(ms * NSEC_PER_MSEC);
+}
+
+/*
+* a process context sleep only passes time, unless main.c set a hook
+* that runs the rest of the system meanwhile
+*/
+void (*sim_sleep_hook)(s64 until);
+
+static void sim_sleep(s64 ns)
+{
+        might_sleep();
+        if (sim_sleep_hook && act == SIM_ACT_CTRL)
+                sim_sleep_hook(now_ns + ns);
+        else
+                sim_advance(ns);
+}
+
+void msleep(unsigned int ms)
+{
+        sim_sleep(ms * NSEC_PER_MSEC);
+}
+
+void usleep_range(unsigned long min, unsigned long max)
+{
+        sim_sleep(min * NSEC_PER_USEC);
+}
+
+int signal_pending(struct task_struct *t)
+{
+        return 0;
+}
+
+int sched_setscheduler(struct task_struct *t, int policy, const struct sched_param *param)
+{
+        return 0;
+}
+
+/* locks */
+void sim_lock(int *held, bool raw)
+{
+        if (*held)
+                sim_warn("%s lock taken twice", raw ? "raw spin" : "spin");
+        *held = 1;
+        if (raw)
+                raw_locks++;
+        else
+                locks++;
+}
+
+void sim_unlock(int *held, bool raw)
+{
+        if (!*held)
+                sim_warn("%s lock released but not held", raw ? "raw spin" : "spin");
+        *held = 0;
+        if (raw)
+                raw_locks--;
+        else
+                locks--;
+}
+
+void mutex_lock(struct mutex *m)
+{
+        might_sleep();
+        if (m->held)
+                sim_warn("mutex taken twice");
+        m->held = 1;
+}
+
+int mutex_lock_interruptible(struct mutex *m)
+{
+        mutex_lock(m);
+        return 0;
+}
+
+int mutex_trylock(struct mutex *m)
+{
+        if (m->held)
+                return 0;
+        m->held = 1;
+        return 1;
+}
+
+void mutex_unlock(struct mutex *m)
+{
+        m->held = 0;
+}
+
+void local_bh_disable(void)
+{
+        bh_depth++;
+}
+
+void local_bh_enable(void)
+{
+        if (!bh_depth)
+                sim_warn("local_bh_enable() without local_bh_disable()");
+        else
+                bh_depth--;
+}
+
+/* memory and strings */
+void *kmalloc(size_t size, gfp_t gfp)
+{
+        if (gfp == GFP_KERNEL)
+                might_sleep();
+        return malloc(size ? size : 1);
+}
+
+void *kzalloc(size_t size, gfp_t gfp)
+{
+        if (gfp == GFP_KERNEL)
+                might_sleep();
+        return calloc(1, size ? size : 1);
+}
+
+void *kcalloc(size_t n, size_t size, gfp_t gfp)
+{
+        if (gfp == GFP_KERNEL)
+                might_sleep();
+        return calloc(n ? n : 1, size ? size : 1);
+}
+
+void kfree(const void *p)
+{
+        free((void *)p);
+}
+
+void *vmalloc(size_t size)
+{
+        might_sleep();
+        return malloc(size);
+}
+
+void *vzalloc(size_t size)
+{
+        might_sleep();
+        return calloc(1, size);
+}
+
+void vfree(const void *p)
+{
+        free((void *)p);
+}
+
+char *kstrdup(const char *s, gfp_t gfp)
+{
+        return s ? strdup(s) : NULL;
+}
+
+char *kstrndup(const char *s, size_t n, gfp_t gfp)
+{
+        return s ? strndup(s, n) : NULL;
+}
+
+void sort(void *base, size_t num, size_t size, int (*cmp)(const void *, const void *),
+          void (*swap_fn)(void *, void *, int))
+{
+        qsort(base, num, size, cmp);
+}
+
+unsigned long copy_to_user(void __user *to, const void *from, unsigned long n)
+{
+        memcpy(to, from, n);
+        return 0;
+}
+
+unsigned long copy_from_user(void *to, const void __user *from, unsigned long n)
+{
+        memcpy(to, from, n);
+        return 0;
+}
+
+int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+        va_list ap;
+        int n;
+
+        if (!size)
+                return 0;
+        va_start(ap, fmt);
+        n = vsnprintf(buf, size, fmt, ap);
+        va_end(ap);
+        return n < (int)size ? n : (int)size - 1;
+}
+
+char *skip_spaces(const char *s)
+{
+        while (*s == ' ' || *s == '\t' || *s == '\n')
+                s++;
+        return (char *)s;
+}
+
+char *strim(char *s)
+{
+        size_t n = strlen(s);
+
+        while (n && (s[n - 1] == ' ' || s[n - 1] == '\t' || s[n - 1] == '\n'))
+                s[--n] = 0;
+        return skip_spaces(s);
+}
+
+static int sim_strtoull(const char *s, unsigned int base, unsigned long long max,
+                        unsigned long long *res)
+{
+        char *end;
+
+        if (!*s || *s == '-')
+                return -EINVAL;
+        *res = strtoull(s, &end, base);
+        if (*end == '\n')
+                end++;
+        if (*end)
+                return -EINVAL;
+        return *res > max ? -ERANGE : 0;
+}
+
+int kstrtoul(const char *s, unsigned int base, unsigned long *res)
+{
+        unsigned long long v;
+        int err = sim_strtoull(s, base, ULONG_MAX, &v);
+
+        if (!err)
+                *res = v;
+        return err;
+}
+
+int kstrtouint(const char *s, unsigned int base, unsigned int *res)
+{
+        unsigned long long v;
+        int err = sim_strtoull(s, base, UINT_MAX, &v);
+
+        if (!err)
+                *res = v;
+        return err;
+}
+
+int kstrtou32(const char *s, unsigned int base, u32 *res)
+{
+        return kstrtouint(s, base, res);
+}
+
+int kstrtoint(const char *s, unsigned int base, int *res)
+{
+        unsigned long long v;
+        int err;
+
+        if (*s == '-') {
+                err = sim_strtoull(s + 1, base, (unsigned long long)INT_MAX + 1, &v);
+                if (!err)
+                        *res = -(long long)v;
+                return err;
+        }
+        err = sim_strtoull(s, base, INT_MAX, &v);
+        if (!err)
+                *res = v;
+        return err;
+}
+
+int strtobool(const char *s, bool *res)
+{
+        switch (s[0]) {
+        case 'y': case 'Y': case '1':
+                *res = true;
+                return 0;
+        case 'n': case 'N': case '0':
+                *res = false;
+                return 0;
+        }
+        return -EINVAL;
+}
+
+unsigned long simple_strtoul(const char *s, char **end, unsigned int base)
+{
+        return strtoul(s, end, base);
+}
+
+/* module parameters */
+static struct {
+        const char *name;
+        const char *type;
+        void *var;
+} params[64];
+static int n_params;
+
+void sim_param_add(const char *name, const char *type, void *var)
+{
+        if (n_params < ARRAY_SIZE(params)) {
+                params[n_params].name = name;
+                params[n_params].type = type;
+                params[n_params].var = var;
+                n_params++;
+        }
+}
+
+int sim_param_set(const char *arg)
+{
+        const char *eq = strchr(arg, '=');
+        size_t len = eq ? (size_t)(eq - arg) : strlen(arg);
+        const char *val = eq ? eq + 1 : "1";
+        int i;
+
+        for (i = 0; i < n_params; i++) {
+                if (strlen(params[i].name) != len || strncmp(params[i].name, arg, len))
+                        continue;
+                if (!strcmp(params[i].type, "bool"))
+                        return strtobool(val, params[i].var);
+                if (!strcmp(params[i].type, "uint"))
+                        return kstrtouint(val, 0, params[i].var);
+                if (!strcmp(params[i].type, "int"))
+                        return kstrtoint(val, 0, params[i].var);
+                return -EINVAL;
+        }
+        return -ENOENT;
+}
+
+/* value of a bool, uint or int module parameter, 0 for an unknown one */
+long long sim_param(const char *name)
+{
+        int i;
+
+        for (i = 0; i < n_params; i++) {
+                if (strcmp(params[i].name, name))
+                        continue;
+                if (!strcmp(params[i].type, "bool"))
+                        return *(bool *)params[i].var;
+                if (!strcmp(params[i].type, "uint"))
+                        return *(unsigned int *)params[i].var;
+                return *(int *)params[i].var;
+        }
+        return 0;
+}
+
+void sim_params_list(FILE *f)
+{
+        int i;
+
+        for (i = 0; i < n_params; i++) {
+                fprintf(f, "  %-24s ", params[i].name);
+                if (!strcmp(params[i].type, "bool"))
+                        fprintf(f, "%d\n", *(bool *)params[i].var);
+                else if (!strcmp(params[i].type, "uint"))
+                        fprintf(f, "%u\n", *(unsigned int *)params[i].var);
+                else
+                        fprintf(f, "%d\n", *(int *)params[i].var);
+        }
+}
+
+/*
+* registries of the timers, hrtimers, work items and NAPI contexts the
+* event loop runs; entries inside a freed net_device are dropped by
+* sim_forget()
+*/
+static struct timer_list *timers[SIM_MAX_OBJS];
+static int n_timers;
+static struct hrtimer *hrtimers[SIM_MAX_OBJS];
+static int n_hrtimers;
+static struct work_struct *works[SIM_MAX_OBJS];
+static int n_works;
+static struct napi_struct *napis[SIM_MAX_OBJS];
+static int n_napis;
+static int napi_next;
+
+static void sim_register(void **tab, int *n, void *obj)
+{
+        int i;
+
+        for (i = 0; i < *n; i++)
+                if (tab[i] == obj)
+                        return;
+        if (*n == SIM_MAX_OBJS) {
+                sim_warn("too many timers, work items or NAPI contexts");
+                abort();
+        }
+        tab[(*n)++] = obj;
+}
+
+static void sim_unregister_range(void **tab, int *n, const void *start, size_t len)
+{
+        int i, j;
+
+        for (i = 0, j = 0; i < *n; i++) {
+                if ((const char *)tab[i] >= (const char *)start &&
+                    (const char *)tab[i] < (const char *)start + len)
+                        continue;
+                tab[j++] = tab[i];
+        }
+        *n = j;
+}
+
+static void sim_forget(const void *start, size_t len)
+{
+        sim_unregister_range((void **)timers, &n_timers, start, len);
+        sim_unregister_range((void **)hrtimers, &n_hrtimers, start, len);
+        sim_unregister_range((void **)works, &n_works, start, len);
+        sim_unregister_range((void **)napis, &n_napis, start, len);
+}
+
+/* timers */
+void init_timer(struct timer_list *t)
+{
+        t->pending = false;
+        sim_register((void **)timers, &n_timers, t);
+}
+
+void setup_timer(struct timer_list *t, void (*fn)(unsigned long), unsigned long data)
+{
+        init_timer(t);
+        t->function = fn;
+        t->data = data;
+}
+
+int mod_timer(struct timer_list *t, unsigned long expires)
+{
+        int was = t->pending;
+
+        sim_register((void **)timers, &n_timers, t);
+        t->expires = expires;
+        t->pending = true;
+        return was;
+}
+
+int del_timer(struct timer_list *t)
+{
+        int was = t->pending;
+
+        t->pending = false;
+        return was;
+}
+
+void hrtimer_init(struct hrtimer *t, int clock, enum hrtimer_mode mode)
+{
+        t->active = false;
+        sim_register((void **)hrtimers, &n_hrtimers, t);
+}
+
+int hrtimer_start(struct hrtimer *t, ktime_t tim, enum hrtimer_mode mode)
+{
+        int was = t->active;
+
+        t->expires = mode == HRTIMER_MODE_REL ? now_ns + tim : tim;
+        t->active = true;
+        return was;
+}
+
+int hrtimer_cancel(struct hrtimer *t)
+{
+        int was = t->active;
+
+        t->active = false;
+        return was;
+}
+
+u64 hrtimer_forward_now(struct hrtimer *t, ktime_t interval)
+{
+        u64 overruns = 0;
+
+        if (interval <= 0)
+                return 0;
+        while (t->expires <= now_ns) {
+                t->expires += interval;
+                overruns++;
+        }
+        return overruns;
+}
+
+/* time the next timer or hrtimer expires, KTIME_MAX if none */
+s64 sim_next_timer_ns(void)
+{
+        s64 next = KTIME_MAX, t;
+        long delta;
+        int i;
+
+        for (i = 0; i < n_hrtimers; i++)
+                if (hrtimers[i]->active && hrtimers[i]->expires < next)
+                        next = hrtimers[i]->expires;
+
+        for (i = 0; i < n_timers; i++) {
+                if (!timers[i]->pending)
+                        continue;
+                delta = (long)(timers[i]->expires - jiffies);
+                if (delta <= 0)
+                        return now_ns;
+                t = SIM_T0 + (s64)(jiffies - INITIAL_JIFFIES + delta) * (NSEC_PER_SEC / HZ);
+                if (t < next)
+                        next = t;
+        }
+
+        for (i = 0; i < n_napis; i++)
+                if (napis[i]->sim_listed && napis[i]->sim_due < next)
+                        next = napis[i]->sim_due;
+
+        return next;
+}
+
+/* hrtimer callbacks run in hard interrupt context */
+bool sim_run_hrtimers(void)
+{
+        struct hrtimer *t;
+        enum hrtimer_restart ret;
+        enum sim_act saved;
+        int i;
+
+        for (i = 0; i < n_hrtimers; i++) {
+                t = hrtimers[i];
+                if (!t->active || t->expires > now_ns)
+                        continue;
+
+                t->active = false;
+                saved = sim_act_enter(SIM_ACT_HRTIMER);
+                sim_advance(sim_costs.irq_ns);
+                ret = t->function(t);
+                sim_act_exit(saved);
+                if (ret == HRTIMER_RESTART) {
+                        if (t->expires <= now_ns)
+                                sim_warn("hrtimer restarted without moving its expiry");
+                        t->active = true;
+                }
+                return true;
+        }
+
+        return false;
+}
+
+/* work */
+void sim_init_work(struct work_struct *w, void (*fn)(struct work_struct *))
+{
+        w->func = fn;
+        w->pending = false;
+        sim_register((void **)works, &n_works, w);
+}
+
+int schedule_work(struct work_struct *w)
+{
+        /* queue_work() takes the workqueue's spinlock_t, a sleeping lock on RT */
+        if (raw_locks)
+                sim_warn("schedule_work() under a raw spinlock, sleeps on PREEMPT_RT");
+        if (w->pending)
+                return 0;
+        w->pending = true;
+        return 1;
+}
+
+int cancel_work_sync(struct work_struct *w)
+{
+        int was = w->pending;
+
+        might_sleep();
+        w->pending = false;
+        return was;
+}
+
+bool sim_run_work(void)
+{
+        struct work_struct *w;
+        enum sim_act saved;
+        int i;
+
+        for (i = 0; i < n_works; i++) {
+                w = works[i];
+                if (!w->pending)
+                        continue;
+
+                w->pending = false;
+                saved = sim_act_enter(SIM_ACT_WORK);
+                w->func(w);
+                sim_act_exit(saved);
+                return true;
+        }
+
+        return false;
+}
+
+/* NAPI */
+void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
+                    int (*poll)(struct napi_struct *, int), int weight)
+{
+        napi->poll = poll;
+        napi->weight = weight;
+        napi->dev = dev;
+        napi->state = 1UL << NAPI_STATE_SCHED;        /* disabled until napi_enable() */
+        napi->sim_listed = false;
+        sim_register((void **)napis, &n_napis, napi);
+}
+
+void netif_napi_del(struct napi_struct *napi)
+{
+        sim_unregister_range((void **)napis, &n_napis, napi, 1);
+}
+
+int napi_schedule_prep(struct napi_struct *napi)
+{
+        return !test_bit(NAPI_STATE_DISABLE, &napi->state) &&
+                !test_and_set_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+void __napi_schedule(struct napi_struct *napi)
+{
+        if (!test_bit(NAPI_STATE_SCHED, &napi->state))
+                sim_warn("__napi_schedule() without NAPI_STATE_SCHED");
+        if (!napi->sim_listed) {
+                napi->sim_due = now_ns + sim_costs.softirq_delay_ns;
+                napi->sim_scheduled++;
+        }
+        napi->sim_listed = true;
+}
+
+void napi_complete(struct napi_struct *napi)
+{
+        if (!napi->sim_listed)
+                sim_warn("napi_complete() of a NAPI context not scheduled");
+        napi->sim_listed = false;
+        napi->sim_completed = true;
+        clear_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+static void sim_napi_poll(struct napi_struct *napi)
+{
+        enum sim_act saved;
+        int work;
+
+        napi->sim_completed = false;
+        saved = sim_act_enter(SIM_ACT_SOFTIRQ);
+        sim_advance(sim_costs.softirq_ns);
+        work = napi->poll(napi, napi->weight);
+        sim_act_exit(saved);
+
+        if (work > napi->weight)
+                sim_warn("NAPI poll did %d of weight %d", work, napi->weight);
+        if (work < napi->weight && !napi->sim_completed)
+                sim_warn("NAPI poll did %d < %d without napi_complete()", work, napi->weight);
+        /* net_rx_action() completes a full poll only for a pending disable */
+        if (work == napi->weight && napi->sim_listed &&
+            test_bit(NAPI_STATE_DISABLE, &napi->state))
+                napi_complete(napi);
+}
+
+void napi_enable(struct napi_struct *napi)
+{
+        if (!test_bit(NAPI_STATE_SCHED, &napi->state))
+                sim_warn("napi_enable() of an enabled NAPI context");
+        clear_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+/* as the kernel, wait for a scheduled poll to run and complete */
+void napi_disable(struct napi_struct *napi)
+{
+        int rounds = 0;
+
+        might_sleep();
+        set_bit(NAPI_STATE_DISABLE, &napi->state);
+        while (test_and_set_bit(NAPI_STATE_SCHED, &napi->state)) {
+                if (!napi->sim_listed || ++rounds > 1000) {
+                        sim_warn("napi_disable() waits for a poll that does not run");
+                        break;
+                }
+                sim_napi_poll(napi);
+        }
+        clear_bit(NAPI_STATE_DISABLE, &napi->state);
+}
+
+/* one softirq round: an expired timer, or one NAPI poll */
+bool sim_run_softirq(void)
+{
+        struct timer_list *t;
+        enum sim_act saved;
+        int i;
+
+        for (i = 0; i < n_timers; i++) {
+                t = timers[i];
+                if (!t->pending || time_before(jiffies, t->expires))
+                        continue;
+
+                t->pending = false;
+                saved = sim_act_enter(SIM_ACT_SOFTIRQ);
+                sim_advance(sim_costs.softirq_ns);
+                t->function(t->data);
+                sim_act_exit(saved);
+                return true;
+        }
+
+        for (i = 0; i < n_napis; i++) {
+                struct napi_struct *napi = napis[(napi_next + i) % n_napis];
+
+                if (!napi->sim_listed || napi->sim_due > now_ns)
+                        continue;
+                napi_next = (napi_next + i + 1) % n_napis;
+                sim_napi_poll(napi);
+                return true;
+        }
+
+        return false;
+}
+
+/* interrupts */
+static struct sim_irq {
+        irq_handler_t handler;
+        irq_handler_t thread_fn;
+        unsigned long flags;
+        void *dev_id;
+        int depth;
+        bool thread_pending;
+        unsigned long unhandled;
+} irqs[256];
+
+static void sim_irq_thread(unsigned int irq)
+{
+        struct sim_irq *d = &irqs[irq];
+        enum sim_act saved;
+
+        saved = sim_act_enter(SIM_ACT_THREAD);
+        d->thread_fn(irq, d->dev_id);
+        sim_act_exit(saved);
+        d->thread_pending = false;
+        if (bh_depth)
+                sim_warn("IRQ thread returned with softirqs disabled");
+}
+
+int request_threaded_irq(unsigned int irq, irq_handler_t handler, irq_handler_t thread_fn,
+                         unsigned long flags, const char *name, void *dev_id)
+{
+        struct sim_irq *d;
+
+        might_sleep();
+        if (irq >= ARRAY_SIZE(irqs))
+                return -EINVAL;
+        d = &irqs[irq];
+        if (d->handler && !(flags & d->flags & IRQF_SHARED))
+                return -EBUSY;
+        if (thread_fn && !(flags & IRQF_ONESHOT))
+                sim_warn("threaded IRQ %u without IRQF_ONESHOT", irq);
+
+        memset(d, 0, sizeof(*d));
+        d->handler = handler;
+        d->thread_fn = thread_fn;
+        d->flags = flags;
+        d->dev_id = dev_id;
+        return 0;
+}
+
+int request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags,
+                const char *name, void *dev_id)
+{
+        return request_threaded_irq(irq, handler, NULL, flags, name, dev_id);
+}
+
+void free_irq(unsigned int irq, void *dev_id)
+{
+        struct sim_irq *d = &irqs[irq];
+
+        might_sleep();
+        if (d->dev_id != dev_id) {
+                sim_warn("free_irq(%u) of an unknown handler", irq);
+                return;
+        }
+        if (d->thread_pending)
+                sim_irq_thread(irq);
+        memset(d, 0, sizeof(*d));
+}
+
+/* as the kernel, wait for a woken IRQ thread */
+void disable_irq(unsigned int irq)
+{
+        struct sim_irq *d = &irqs[irq];
+
+        might_sleep();
+        d->depth++;
+        if (d->thread_pending)
+                sim_irq_thread(irq);
+}
+
+void enable_irq(unsigned int irq)
+{
+        struct sim_irq *d = &irqs[irq];
+
+        if (!d->depth)
+                sim_warn("unbalanced enable_irq(%u)", irq);
+        else
+                d->depth--;
+}
+
+/* deliver the level-triggered interrupt line of a controller */
+bool sim_run_irq(unsigned int irq, bool line)
+{
+        struct sim_irq *d = &irqs[irq];
+        enum sim_act saved;
+        irqreturn_t ret;
+
+        if (!line || !d->handler || d->depth || d->thread_pending)
+                return false;
+
+        saved = sim_act_enter(SIM_ACT_IRQ);
+        sim_advance(sim_costs.irq_ns);
+        ret = d->handler(irq, d->dev_id);
+        sim_act_exit(saved);
+        if (raw_locks || locks)
+                sim_warn("IRQ %u handler returned with a lock held", irq);
+
+        if (ret == IRQ_WAKE_THREAD) {
+                if (!d->thread_fn)
+                        sim_warn("IRQ %u woke a thread it does not have", irq);
+                else
+                        d->thread_pending = true;
+        }
+
+        /* note_interrupt(): a line nobody handles is eventually shut off */
+        if (ret == IRQ_NONE) {
+                if (++d->unhandled == 1000) {
+                        sim_warn("IRQ %u: nobody cared, disabling it", irq);
+                        d->depth++;
+                }
+        } else {
+                d->unhandled = 0;
+        }
+
+        return true;
+}
+
+bool sim_run_irq_threads(void)
+{
+        unsigned int irq;
+
+        for (irq = 0; irq < ARRAY_SIZE(irqs); irq++) {
+                if (irqs[irq].thread_pending) {
+                        sim_irq_thread(irq);
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+/* skbs */
+struct sk_buff *alloc_skb(unsigned int size, gfp_t gfp)
+{
+        struct sk_buff *skb;
+
+        if (gfp == GFP_KERNEL)
+                might_sleep();
+        skb = calloc(1, sizeof(*skb) + size);
+        if (!skb)
+                return NULL;
+        skb->data = skb->buf;
+        skb->size = size;
+        sim_skbs++;
+        return skb;
+}
+
+struct sk_buff *__netdev_alloc_skb(struct net_device *dev, unsigned int size, gfp_t gfp)
+{
+        struct sk_buff *skb = alloc_skb(size, gfp);
+
+        if (skb)
+                skb->dev = dev;
+        return skb;
+}
+
+unsigned char *skb_put(struct sk_buff *skb, unsigned int len)
+{
+        unsigned char *p = skb->data + skb->len;
+
+        if (skb->len + len > skb->size) {
+                sim_warn("skb_put() over the end of the skb");
+                abort();
+        }
+        skb->len += len;
+        return p;
+}
+
+void kfree_skb(struct sk_buff *skb)
+{
+        if (!skb)
+                return;
+        /* the socket destructor must not run in hard interrupt context */
+        if (skb->destructor && in_irq())
+                sim_warn("socket skb freed in hard interrupt context");
+        sim_skbs--;
+        free(skb);
+}
+
+static void sim_netif(struct sk_buff *skb)
+{
+        sim_advance(sim_costs.stack_ns);
+        sim_stack_rx(skb);
+        sim_skbs--;
+        free(skb);
+}
+
+int netif_rx(struct sk_buff *skb)
+{
+        if (!in_interrupt())
+                sim_warn("netif_rx() with softirqs enabled, the frame would wait");
+        sim_netif(skb);
+        return 0;
+}
+
+int netif_receive_skb(struct sk_buff *skb)
+{
+        if (act != SIM_ACT_SOFTIRQ && act != SIM_ACT_THREAD)
+                sim_warn("netif_receive_skb() outside of the NAPI poll");
+        sim_netif(skb);
+        return 0;
+}
+
+/* the socket layer: dev_queue_xmit() runs start_xmit with softirqs disabled */
+netdev_tx_t sim_xmit(struct net_device *dev, struct sk_buff *skb)
+{
+        enum sim_act saved;
+        netdev_tx_t ret;
+
+        saved = sim_act_enter(SIM_ACT_XMIT);
+        local_bh_disable();
+        sim_advance(sim_costs.xmit_ns);
+        ret = dev->netdev_ops->ndo_start_xmit(skb, dev);
+        local_bh_enable();
+        sim_act_exit(saved);
+        return ret;
+}
+
+int dev_queue_xmit(struct sk_buff *skb)
+{
+        return sim_xmit(skb->dev, skb);
+}
+
+/* CAN device interface, drivers/net/can/dev.c */
+static struct net_device *netdevs[16];
+static int n_netdevs;
+static int netdev_index;
+
+struct net_device *sim_netdev(int i)
+{
+        return i < n_netdevs ? netdevs[i] : NULL;
+}
+
+static void can_flush_echo_skb(struct net_device *dev)
+{
+        struct can_priv *priv = netdev_priv(dev);
+        unsigned int i;
+
+        for (i = 0; i < priv->echo_skb_max; i++) {
+                if (priv->echo_skb[i]) {
+                        kfree_skb(priv->echo_skb[i]);
+                        priv->echo_skb[i] = NULL;
+                        dev->stats.tx_dropped++;
+                        dev->stats.tx_aborted_errors++;
+                }
+        }
+}
+
+static void can_restart(unsigned long data)
+{
+        struct net_device *dev = (struct net_device *)data;
+        struct can_priv *priv = netdev_priv(dev);
+        struct can_frame *cf;
+        struct sk_buff *skb;
+        int err;
+
+        if (dev->carrier)
+                sim_warn("can_restart() with the carrier on");
+        can_flush_echo_skb(dev);
+
+        skb = alloc_can_err_skb(dev, &cf);
+        if (skb) {
+                cf->can_id |= CAN_ERR_RESTARTED;
+                dev->stats.rx_packets++;
+                dev->stats.rx_bytes += cf->can_dlc;
+                netif_rx(skb);
+        }
+
+        priv->can_stats.restarts++;
+        err = priv->do_set_mode(dev, CAN_MODE_START);
+        netif_carrier_on(dev);
+        if (err)
+                sim_warn("restart failed, error %d", err);
+}
+
+struct net_device *alloc_candev(int sizeof_priv, unsigned int echo_skb_max)
+{
+        size_t off = (sizeof(struct net_device) + 31) & ~(size_t)31;
+        struct net_device *dev;
+        struct can_priv *priv;
+
+        dev = calloc(1, off + sizeof_priv);
+        if (!dev)
+                return NULL;
+        dev->priv_offset = off;
+        dev->sim_size = off + sizeof_priv;
+        strcpy(dev->name, "can%d");
+
+        priv = netdev_priv(dev);
+        if (echo_skb_max) {
+                priv->echo_skb = calloc(echo_skb_max, sizeof(*priv->echo_skb));
+                if (!priv->echo_skb) {
+                        free(dev);
+                        return NULL;
+                }
+                priv->echo_skb_max = echo_skb_max;
+        }
+        priv->state = CAN_STATE_STOPPED;
+        setup_timer(&priv->restart_timer, can_restart, (unsigned long)dev);
+
+        return dev;
+}
+
+void free_candev(struct net_device *dev)
+{
+        struct can_priv *priv = netdev_priv(dev);
+
+        sim_forget(dev, dev->sim_size);
+        free(priv->echo_skb);
+        free(dev);
+}
+
+int register_candev(struct net_device *dev)
+{
+        if (n_netdevs == ARRAY_SIZE(netdevs))
+                return -ENOSPC;
+        snprintf(dev->name, sizeof(dev->name), "can%d", netdev_index++);
+        netdevs[n_netdevs++] = dev;
+        return 0;
+}
+
+void unregister_candev(struct net_device *dev)
+{
+        enum sim_act saved;
+        int i, j;
+
+        /* unregister_netdevice() closes a running interface */
+        if (dev->running) {
+                saved = sim_act_enter(SIM_ACT_CTRL);
+                dev->netdev_ops->ndo_stop(dev);
+                sim_act_exit(saved);
+                dev->running = false;
+        }
+
+        for (i = 0, j = 0; i < n_netdevs; i++)
+                if (netdevs[i] != dev)
+                        netdevs[j++] = netdevs[i];
+        n_netdevs = j;
+}
+
+int open_candev(struct net_device *dev)
+{
+        struct can_priv *priv = netdev_priv(dev);
+
+        if (!priv->bittiming.tq && !priv->bittiming.bitrate)
+                return -EINVAL;
+        netif_carrier_on(dev);
+        return 0;
+}
+
+void close_candev(struct net_device *dev)
+{
+        struct can_priv *priv = netdev_priv(dev);
+
+        del_timer_sync(&priv->restart_timer);
+        can_flush_echo_skb(dev);
+}
+
+void can_bus_off(struct net_device *dev)
+{
+        struct can_priv *priv = netdev_priv(dev);
+
+        netif_carrier_off(dev);
+        priv->can_stats.bus_off++;
+        if (priv->restart_ms)
+                mod_timer(&priv->restart_timer, jiffies + (priv->restart_ms * HZ) / 1000);
+}
+
+void can_put_echo_skb(struct sk_buff *skb, struct net_device *dev, unsigned int idx)
+{
+        struct can_priv *priv = netdev_priv(dev);
+
+        if (idx >= priv->echo_skb_max) {
+                sim_warn("echo skb index %u out of range", idx);
+                abort();
+        }
+
+        if (!(dev->flags & IFF_ECHO) || skb->pkt_type != PACKET_LOOPBACK) {
+                kfree_skb(skb);
+                return;
+        }
+
+        if (priv->echo_skb[idx]) {
+                sim_warn("echo skb %u is occupied", idx);
+                kfree_skb(skb);
+                return;
+        }
+
+        /* skb_orphan() runs the socket destructor */
+        if (skb->destructor && in_irq())
+                sim_warn("can_put_echo_skb() runs the socket destructor in hard interrupt context");
+        skb->destructor = false;
+        skb->protocol = htons(ETH_P_CAN);
+        skb->pkt_type = PACKET_BROADCAST;
+        skb->ip_summed = CHECKSUM_UNNECESSARY;
+        skb->dev = dev;
+        priv->echo_skb[idx] = skb;
+}
+
+unsigned int can_get_echo_skb(struct net_device *dev, unsigned int idx)
+{
+        struct can_priv *priv = netdev_priv(dev);
+        struct sk_buff *skb;
+
+        if (idx >= priv->echo_skb_max) {
+                sim_warn("echo skb index %u out of range", idx);
+                abort();
+        }
+
+        skb = priv->echo_skb[idx];
+        if (!skb)
+                return 0;
+        priv->echo_skb[idx] = NULL;
+        netif_rx(skb);
+        return 1;
+}
+
+void can_free_echo_skb(struct net_device *dev, unsigned int idx)
+{
+        struct can_priv *priv = netdev_priv(dev);
+
+        if (idx >= priv->echo_skb_max) {
+                sim_warn("echo skb index %u out of range", idx);
+                abort();
+        }
+
+        kfree_skb(priv->echo_skb[idx]);
+        priv->echo_skb[idx] = NULL;
+}
+
+struct sk_buff *alloc_can_skb(struct net_device *dev, struct can_frame **cf)
+{
+        struct sk_buff *skb = __netdev_alloc_skb(dev, sizeof(struct can_frame), GFP_ATOMIC);
+
+        if (!skb)
+                return NULL;
+        skb->protocol = htons(ETH_P_CAN);
+        skb->pkt_type = PACKET_BROADCAST;
+        skb->ip_summed = CHECKSUM_UNNECESSARY;
+        *cf = (struct can_frame *)skb_put(skb, sizeof(struct can_frame));
+        memset(*cf, 0, sizeof(struct can_frame));
+        return skb;
+}
+
+struct sk_buff *alloc_can_err_skb(struct net_device *dev, struct can_frame **cf)
+{
+        struct sk_buff *skb = alloc_can_skb(dev, cf);
+
+        if (!skb)
+                return NULL;
+        (*cf)->can_id = CAN_ERR_FLAG;
+        (*cf)->can_dlc = CAN_ERR_DLC;
+        return skb;
+}
+
+int can_dropped_invalid_skb(struct net_device *dev, struct sk_buff *skb)
+{
+        const struct can_frame *cf = (struct can_frame *)skb->data;
+
+        if (skb->len != sizeof(*cf) || cf->can_dlc > 8) {
+                kfree_skb(skb);
+                dev->stats.tx_dropped++;
+                return 1;
+        }
+        return 0;
+}
+
+/* platform bus */
+struct sim_pdev {
+        struct platform_device pdev;
+        struct platform_driver *drv;
+        char name[32];
+};
+static struct sim_pdev *pdevs[16];
+static int n_pdevs;
+static struct platform_driver *pdrvs[4];
+static int n_pdrvs;
+
+static void sim_bind(struct sim_pdev *sp, struct platform_driver *drv)
+{
+        enum sim_act saved;
+        int err;
+
+        if (sp->drv || strcmp(sp->pdev.name, drv->driver.name))
+                return;
+        saved = sim_act_enter(SIM_ACT_CTRL);
+        err = drv->probe(&sp->pdev);
+        sim_act_exit(saved);
+        if (err)
+                printk("%s: probe failed, error %d\n", sp->name, err);
+        else
+                sp->drv = drv;
+}
+
+static void sim_unbind(struct sim_pdev *sp)
+{
+        enum sim_act saved;
+
+        if (!sp->drv)
+                return;
+        saved = sim_act_enter(SIM_ACT_CTRL);
+        sp->drv->remove(&sp->pdev);
+        sim_act_exit(saved);
+        sp->drv = NULL;
+}
+
+int platform_driver_register(struct platform_driver *drv)
+{
+        int i;
+
+        if (n_pdrvs == ARRAY_SIZE(pdrvs))
+                return -ENOSPC;
+        pdrvs[n_pdrvs++] = drv;
+        for (i = 0; i < n_pdevs; i++)
+                sim_bind(pdevs[i], drv);
+        return 0;
+}
+
+void platform_driver_unregister(struct platform_driver *drv)
+{
+        int i, j;
+
+        for (i = 0; i < n_pdevs; i++)
+                if (pdevs[i]->drv == drv)
+                        sim_unbind(pdevs[i]);
+        for (i = 0, j = 0; i < n_pdrvs; i++)
+                if (pdrvs[i] != drv)
+                        pdrvs[j++] = pdrvs[i];
+        n_pdrvs = j;
+}
+
+struct platform_device *platform_device_register_resndata(struct device *parent, const char *name,
+                                                          int id, const struct resource *res,
+                                                          unsigned int num, const void *data,
+                                                          size_t size)
+{
+        struct sim_pdev *sp;
+        int i;
+
+        if (n_pdevs == ARRAY_SIZE(pdevs))
+                return ERR_PTR(-ENOSPC);
+        sp = calloc(1, sizeof(*sp));
+        if (!sp)
+                return ERR_PTR(-ENOMEM);
+        snprintf(sp->name, sizeof(sp->name), "%s.%d", name, id);
+        sp->pdev.name = name;
+        sp->pdev.id = id;
+        sp->pdev.dev.parent = parent;
+        sp->pdev.dev.init_name = sp->name;
+        sp->pdev.num_resources = num;
+        sp->pdev.resource = calloc(num ? num : 1, sizeof(*res));
+        memcpy(sp->pdev.resource, res, num * sizeof(*res));
+        if (data) {
+                sp->pdev.dev.platform_data = malloc(size);
+                memcpy(sp->pdev.dev.platform_data, data, size);
+        }
+
+        pdevs[n_pdevs++] = sp;
+        for (i = 0; i < n_pdrvs; i++)
+                sim_bind(sp, pdrvs[i]);
+        return &sp->pdev;
+}
+
+void platform_device_unregister(struct platform_device *pdev)
+{
+        struct sim_pdev *sp = container_of(pdev, struct sim_pdev, pdev);
+        int i, j;
+
+        sim_unbind(sp);
+        for (i = 0, j = 0; i < n_pdevs; i++)
+                if (pdevs[i] != sp)
+                        pdevs[j++] = pdevs[i];
+        n_pdevs = j;
+        free(pdev->resource);
+        free(pdev->dev.platform_data);
+        free(sp);
+}
+
+const char *dev_name(const struct device *dev)
+{
+        return dev->init_name ? dev->init_name : "sim";
+}
+
+struct resource *platform_get_resource(struct platform_device *pdev, unsigned int type, unsigned int n)
+{
+        unsigned int i;
+
+        for (i = 0; i < pdev->num_resources; i++)
+                if ((pdev->resource[i].flags & type) && !n--)
+                        return &pdev->resource[i];
+        return NULL;
+}
+
+int platform_get_irq(struct platform_device *pdev, unsigned int n)
+{
+        struct resource *r = platform_get_resource(pdev, IORESOURCE_IRQ, n);
+
+        return r ? (int)r->start : -ENXIO;
+}
+
+void __iomem *devm_request_and_ioremap(struct device *dev, struct resource *res)
+{
+        return sim_can_map(res->start, resource_size(res));
+}
+
+struct clk {
+        const char *name;
+};
+
+struct clk *clk_get(struct device *dev, const char *id)
+{
+        struct clk *clk = calloc(1, sizeof(*clk));
+
+        if (!clk)
+                return ERR_PTR(-ENOMEM);
+        clk->name = id;
+        return clk;
+}
+
+void clk_put(struct clk *clk)
+{
+        free(clk);
+}
+
+int clk_enable(struct clk *clk)
+{
+        return 0;
+}
+
+void clk_disable(struct clk *clk)
+{
+}
+
+unsigned long clk_get_rate(struct clk *clk)
+{
+        return sim_clk_rate;
+}
+
+/* script.bin: one controller configured, its pins always available */
+int gpio_request_ex(char *main_name, const char *sub_name)
+{
+        return 1;
+}
+
+int script_parser_fetch(char *main_name, char *sub_name, int value[], int count)
+{
+        if (!strcmp(sub_name, "can_used")) {
+                value[0] = 1;
+                return 0;
+        }
+        return -1;
+}
+
+/*
+* debugfs: a flat table of paths, directories included; main.c reads and
+* writes the files as cat and echo would, through their file_operations
+*/
+struct dentry {
+        char path[64];
+        void *data;
+        const struct file_operations *fops;
+        enum sim_debugfs_type type;
+        bool used;
+};
+static struct dentry dentries[SIM_MAX_OBJS];
+
+struct dentry *sim_debugfs_create(const char *name, struct dentry *parent, void *data,
+                                  const struct file_operations *fops, enum sim_debugfs_type type)
+{
+        struct dentry *d;
+        int i;
+
+        for (i = 0; i < SIM_MAX_OBJS && dentries[i].used; i++)
+                ;
+        if (i == SIM_MAX_OBJS) {
+                sim_warn("debugfs: too many files");
+                return NULL;
+        }
+        if ((parent ? strlen(parent->path) + 1 : 0) + strlen(name) >= sizeof(d->path)) {
+                sim_warn("debugfs: path of %s too long", name);
+                return NULL;
+        }
+        d = &dentries[i];
+        d->path[0] = '\0';
+        if (parent) {
+                strcpy(d->path, parent->path);
+                strcat(d->path, "/");
+        }
+        strcat(d->path, name);
+        d->data = data;
+        d->fops = fops;
+        d->type = type;
+        d->used = true;
+        return d;
+}
+
+void debugfs_remove_recursive(struct dentry *d)
+{
+        char path[sizeof(d->path)];
+        size_t len;
+        int i;
+
+        if (IS_ERR_OR_NULL(d))
+                return;
+        strcpy(path, d->path);
+        len = strlen(path);
+        for (i = 0; i < SIM_MAX_OBJS; i++) {
+                if (dentries[i].used && !strncmp(dentries[i].path, path, len) &&
+                    (dentries[i].path[len] == '/' || !dentries[i].path[len]))
+                        dentries[i].used = false;
+        }
+}
+
+static struct dentry *sim_debugfs_find(const char *path)
+{
+        int i;
+
+        for (i = 0; i < SIM_MAX_OBJS; i++)
+                if (dentries[i].used && !strcmp(dentries[i].path, path))
+                        return &dentries[i];
+        return NULL;
+}
+
+/* open, one read or write from offset 0, release; returns the read/write result */
+static ssize_t sim_debugfs_io(const char *path, char *buf, size_t size, bool write)
+{
+        struct dentry *d = sim_debugfs_find(path);
+        struct inode inode;
+        struct file file;
+        loff_t pos = 0;
+        ssize_t n;
+        int err;
+
+        if (!d || (!d->fops && d->type == SIM_DEBUGFS_FOPS))
+                return -ENOENT;
+
+        if (d->type != SIM_DEBUGFS_FOPS) {
+                unsigned long v;
+
+                if (!write)
+                        return snprintf(buf, size, d->type == SIM_DEBUGFS_X32 ? "0x%08x\n" : "%u\n",
+                                        d->type == SIM_DEBUGFS_U8 ? *(u8 *)d->data :
+                                        *(u32 *)d->data);
+                if (d->type == SIM_DEBUGFS_BOOL) {
+                        *(u32 *)d->data = strchr("yY1", buf[0]) != NULL;
+                        return size;
+                }
+                v = strtoul(buf, NULL, 0);
+                if (d->type == SIM_DEBUGFS_U8)
+                        *(u8 *)d->data = v;
+                else
+                        *(u32 *)d->data = v;
+                return size;
+        }
+
+        might_sleep();
+        inode.i_private = d->data;
+        file.private_data = NULL;
+        if (d->fops->open) {
+                err = d->fops->open(&inode, &file);
+                if (err)
+                        return err;
+        }
+        if (write)
+                n = d->fops->write ? d->fops->write(&file, buf, size, &pos) : -EINVAL;
+        else
+                n = d->fops->read ? d->fops->read(&file, buf, size, &pos) : -EINVAL;
+        if (d->fops->release)
+                d->fops->release(&inode, &file);
+        return n;
+}
+
+ssize_t sim_debugfs_read(const char *path, char *buf, size_t size)
+{
+        ssize_t n = sim_debugfs_io(path, buf, size - 1, false);
+
+        buf[n > 0 ? n : 0] = '\0';
+        return n;
+}
+
+ssize_t sim_debugfs_write(const char *path, const char *buf)
+{
+        return sim_debugfs_io(path, (char *)buf, strlen(buf), true);
+}
+
+/* the show routine is run by the first read, the output buffer grows as needed */
+int seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+        va_list ap;
+        int n;
+
+        for (;;) {
+                va_start(ap, fmt);
+                n = vsnprintf(m->buf + m->count, m->size - m->count, fmt, ap);
+                va_end(ap);
+                if (n < 0)
+                        return n;
+                if (m->count + n < m->size)
+                        break;
+                m->size = 2 * (m->count + n + 1);
+                m->buf = realloc(m->buf, m->size);
+        }
+        m->count += n;
+        return 0;
+}
+
+int seq_puts(struct seq_file *m, const char *s)
+{
+        return seq_printf(m, "%s", s);
+}
+
+ssize_t seq_read(struct file *f, char __user *buf, size_t size, loff_t *ppos)
+{
+        struct seq_file *m = f->private_data;
+        int err;
+
+        if (!m->buf) {
+                m->size = PAGE_SIZE;
+                m->buf = malloc(m->size);
+                err = m->show(m, NULL);
+                if (err)
+                        return err;
+        }
+        return simple_read_from_buffer(buf, size, ppos, m->buf, m->count);
+}
+
+loff_t seq_lseek(struct file *f, loff_t off, int whence)
+{
+        return -EINVAL;
+}
+
+int simple_open(struct inode *inode, struct file *f)
+{
+        f->private_data = inode->i_private;
+        return 0;
+}
+
+int single_open(struct file *f, int (*show)(struct seq_file *, void *), void *data)
+{
+        struct seq_file *m = calloc(1, sizeof(*m));
+
+        m->private = data;
+        m->show = show;
+        f->private_data = m;
+        return 0;
+}
+
+int single_release(struct inode *inode, struct file *f)
+{
+        struct seq_file *m = f->private_data;
+
+        free(m->buf);
+        free(m);
+        return 0;
+}
+
+/* sysfs attributes of the driver's groups, by name; buf holds PAGE_SIZE bytes */
+static struct device_attribute *sim_sysfs_find(struct net_device *dev, const char *name)
+{
+        struct attribute **a;
+        int i;
+
+        for (i = 0; i < ARRAY_SIZE(dev->sysfs_groups) && dev->sysfs_groups[i]; i++)
+                for (a = dev->sysfs_groups[i]->attrs; *a; a++)
+                        if (!strcmp((*a)->name, name))
+                                return container_of(*a, struct device_attribute, attr);
+        return NULL;
+}
+
+ssize_t sim_sysfs_show(struct net_device *dev, const char *name, char *buf)
+{
+        struct device_attribute *attr = sim_sysfs_find(dev, name);
+        ssize_t n;
+
+        if (!attr || !attr->show)
+                return -ENOENT;
+        n = attr->show(&dev->dev, attr, buf);
+        buf[n > 0 ? n : 0] = '\0';
+        return n;
+}
+
+ssize_t sim_sysfs_store(struct net_device *dev, const char *name, const char *buf)
+{
+        struct device_attribute *attr = sim_sysfs_find(dev, name);
+
+        if (!attr || !attr->store)
+                return -ENOENT;
+        might_sleep();
+        return attr->store(&dev->dev, attr, buf, strlen(buf));
+}
+
+loff_t default_llseek(struct file *f, loff_t off, int whence)
+{
+        return -EINVAL;
+}
+
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+                                const void *from, size_t available)
+{
+        loff_t pos = *ppos;
+
+        if (pos < 0)
+                return -EINVAL;
+        if ((size_t)pos >= available || !count)
+                return 0;
+        if (count > available - pos)
+                count = available - pos;
+        memcpy(to, (const char *)from + pos, count);
+        *ppos = pos + count;
+        return count;
+}
@@ -0,0 +1,1398 @@
+/*
+* main.c - sunxi_can simulation: setup, event loop, checks and report
+*
+* Loads the driver as the kernel would (module init, platform probe,
+* bit timing, open), puts generated traffic on the bus of every
+* controller and transmits frames through start_xmit, runs the
+* interrupt handlers, timers, NAPI polls and work items in kernel
+* priority order in virtual time, and checks what reaches the stack:
+* every frame once, in order per identifier and intact. The filter,
+* bench and ids scenarios also drive the driver's sysfs and debugfs
+* files while traffic runs and check what they do, the scale scenario
+* compares several controllers at once with one alone. The report gives
+* frames per second, register accesses per frame, drops and the CPU time
+* per activity.
+*/
+
+#include <getopt.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "sunxi_can.h"
+
+#define SIM_CAN0_PHYS 0x01C2BC00
+#define SIM_CAN_PHYS 0x10000000         /* further controllers, board devices */
+#define SIM_CAN_IRQ 100
+#define SIM_DEVICES 4
+#define SIM_TX_IDS 8
+#define SIM_DRAIN_NS (100 * NSEC_PER_MSEC)
+#define SIM_BENCH_ID 0x556              /* even, never sent by the generator or tx_ids */
+
+int sim_module_init(void);
+void sim_module_exit(void);
+
+/* arrival order of one identifier */
+struct sim_track {
+        canid_t id;
+        u32 last;
+        bool seen;
+        unsigned long frames;                   /* since the ID statistics were cleared */
+        u64 bytes;
+};
+
+struct sim_dev {
+        struct net_device *dev;
+        struct sim_can *can;
+        struct sim_gen gen;
+
+        struct sim_track rx[ARRAY_SIZE(((struct sim_gen *)0)->id)];
+        struct sim_track bus[SIM_TX_IDS];       /* our frames on the bus */
+        struct sim_track echo[SIM_TX_IDS];
+        u32 tx_seq[SIM_TX_IDS];
+        u32 rng;
+
+        s64 tx_next;
+        struct sk_buff *held;                   /* waits for the queue or the carrier */
+        unsigned long xmit;
+        unsigned long rx_frames;
+        unsigned long echoes;
+        unsigned long err_frames;
+        unsigned long err_busoff;
+        unsigned long err_restarted;
+        unsigned long corrupt;
+        unsigned long duplicates;
+        unsigned long reordered;
+        unsigned long unknown;
+
+        /* filter scenario: identifiers the driver passes up, by generator index */
+        bool accept[ARRAY_SIZE(((struct sim_gen *)0)->id)];
+        u32 accept_seq[ARRAY_SIZE(((struct sim_gen *)0)->id)];  /* frames stamped since */
+        unsigned int filter_step;
+        unsigned long sw_rejected;              /* sw_filter_rejected before it was reset */
+        unsigned long filtered_leaks;
+
+        s64 ctrl_next;                          /* next sysfs/debugfs action */
+        bool bench_active;
+        unsigned long bench_bus;                /* benchmark frames on the bus */
+        unsigned long bench_rx;                 /* and received back */
+        unsigned long looped;                   /* our frames received back in loopback */
+        char bench_result[512];
+};
+
+static struct sim_opts {
+        unsigned int secs;
+        unsigned int bitrate;
+        unsigned int load;
+        int dlc;
+        unsigned int ids;
+        unsigned int eff_pct;
+        unsigned int tx_rate;
+        unsigned int err_rate;
+        unsigned int busoff_ms;
+        int restart_ms;
+        bool berr;
+        bool ethtool;
+        bool no_drops;
+        unsigned int filter_ms;
+        bool bench;
+        bool id_stats;
+        unsigned int devices;
+        bool scale;
+        u32 seed;
+} opts = {
+        .secs = 2,
+        .bitrate = 1000000,
+        .load = 80,
+        .dlc = 8,
+        .ids = 16,
+        .eff_pct = 25,
+        .restart_ms = 100,
+        .devices = 1,
+        .seed = 1,
+};
+
+static const char *const act_names[SIM_ACT_NR] = {
+        "idle", "hardirq", "irq thread", "hrtimer", "softirq", "work", "xmit", "control",
+};
+
+/* identifiers transmitted, even so they never collide with the generator's */
+static const canid_t tx_ids[SIM_TX_IDS] = {
+        0x010, 0x0a2, 0x1f4, 0x2c6, 0x4a8, 0x5fa, 0x7ec,
+        0x0abcde0 | CAN_EFF_FLAG,
+};
+
+static struct sim_dev devs[SIM_DEVICES];
+static int n_devs;
+static char tx_sk;                      /* marks the skbs of our sockets */
+static unsigned long failures;
+
+static void sim_fail(struct sim_dev *d, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#include <stdarg.h>
+
+static void sim_fail(struct sim_dev *d, const char *fmt, ...)
+{
+        va_list ap;
+
+        if (++failures > 20)
+                return;
+        fprintf(stderr, "[%12.6f] %s: FAIL: ", (double)(sim_now() - 100 * NSEC_PER_SEC) / NSEC_PER_SEC,
+                d->dev ? d->dev->name : "?");
+        va_start(ap, fmt);
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        fputc('\n', stderr);
+}
+
+static struct sim_dev *sim_dev_of_netdev(struct net_device *dev)
+{
+        int i;
+
+        for (i = 0; i < n_devs; i++)
+                if (devs[i].dev == dev)
+                        return &devs[i];
+        return NULL;
+}
+
+static struct sim_dev *sim_dev_of_can(struct sim_can *c)
+{
+        int i;
+
+        for (i = 0; i < n_devs; i++)
+                if (devs[i].can == c)
+                        return &devs[i];
+        return NULL;
+}
+
+static struct sim_track *sim_track_find(struct sim_track *t, unsigned int n, canid_t id)
+{
+        unsigned int i;
+
+        for (i = 0; i < n; i++)
+                if (t[i].id == id)
+                        return &t[i];
+        return NULL;
+}
+
+/*
+* check a frame against the previous one of its identifier
+* gaps are fine, frames lost to overruns or dropped by a restart are
+* accounted by the counts in sim_check()
+* returns true with the full sequence number in t->last if the frame
+* carried one and came in order
+*/
+static bool sim_track_frame(struct sim_dev *d, struct sim_track *t, const struct sim_frame *f,
+                            const char *where)
+{
+        u32 seq, mask, diff;
+        int n = sim_frame_check(f, &seq);
+
+        if (n < 0) {
+                d->corrupt++;
+                sim_fail(d, "%s: corrupt frame, id 0x%x", where, f->id);
+                return false;
+        }
+        if (!n)
+                return false;
+
+        /* shorter frames carry the low bytes, the rest follows from the last one */
+        mask = n == 4 ? ~0U : (1U << (8 * n)) - 1;
+        if (t->seen) {
+                diff = (seq - t->last) & mask;
+                seq = t->last + (diff > mask / 2 ? diff - mask - 1 : diff);
+                if (!diff) {
+                        d->duplicates++;
+                        sim_fail(d, "%s: duplicate frame, id 0x%x seq %u", where, f->id, seq);
+                } else if (diff > mask / 2) {
+                        d->reordered++;
+                        sim_fail(d, "%s: frame out of order, id 0x%x seq %u after %u",
+                                 where, f->id, seq, t->last);
+                        return false;
+                }
+        }
+        t->last = seq;
+        t->seen = true;
+        return true;
+}
+
+static void sim_frame_of_cf(const struct can_frame *cf, struct sim_frame *f)
+{
+        f->id = cf->can_id;
+        f->dlc = cf->can_dlc;
+        memcpy(f->data, cf->data, sizeof(f->data));
+}
+
+/* the protocol stack: frames, echoes and error frames from netif_rx()/netif_receive_skb() */
+void sim_stack_rx(struct sk_buff *skb)
+{
+        struct sim_dev *d = sim_dev_of_netdev(skb->dev);
+        const struct can_frame *cf = (const struct can_frame *)skb->data;
+        struct sim_track *t;
+        struct sim_frame f;
+
+        if (!d) {
+                sim_warn("skb of an unknown device");
+                return;
+        }
+        if (skb->len != sizeof(*cf) || skb->protocol != htons(ETH_P_CAN)) {
+                sim_fail(d, "malformed skb, len %u", skb->len);
+                return;
+        }
+
+        if (cf->can_id & CAN_ERR_FLAG) {
+                d->err_frames++;
+                if (cf->can_id & CAN_ERR_BUSOFF)
+                        d->err_busoff++;
+                if (cf->can_id & CAN_ERR_RESTARTED)
+                        d->err_restarted++;
+                return;
+        }
+
+        sim_frame_of_cf(cf, &f);
+        if (skb->sk == &tx_sk) {
+                d->echoes++;
+                t = sim_track_find(d->echo, SIM_TX_IDS, f.id);
+                if (!t) {
+                        d->unknown++;
+                        sim_fail(d, "echo of a frame never sent, id 0x%x", f.id);
+                        return;
+                }
+                sim_track_frame(d, t, &f, "echo");
+                return;
+        }
+
+        /* in loopback for a benchmark run the controller receives what it sends */
+        if (d->bench_active && f.id == SIM_BENCH_ID) {
+                d->bench_rx++;
+                return;
+        }
+        if (d->bench_active && sim_track_find(d->echo, SIM_TX_IDS, f.id)) {
+                d->looped++;
+                return;
+        }
+
+        d->rx_frames++;
+        t = sim_track_find(d->rx, d->gen.ids, f.id);
+        if (!t) {
+                d->unknown++;
+                sim_fail(d, "received a frame nobody sent, id 0x%x dlc %u", f.id, f.dlc);
+                return;
+        }
+        t->frames++;
+        t->bytes += (f.id & CAN_RTR_FLAG) ? 0 : f.dlc;
+        if (sim_track_frame(d, t, &f, "rx") && !d->accept[t - d->rx] &&
+            t->last >= d->accept_seq[t - d->rx]) {
+                d->filtered_leaks++;
+                sim_fail(d, "frame of a filtered identifier, id 0x%x seq %u", f.id, t->last);
+        }
+}
+
+static void sim_bus_frame(struct sim_can *c, const struct sim_frame *f, bool ours)
+{
+        struct sim_dev *d = sim_dev_of_can(c);
+        struct sim_track *t;
+
+        if (!d || !ours)
+                return;
+
+        if (d->bench_active && f->id == SIM_BENCH_ID) {
+                d->bench_bus++;
+                return;
+        }
+        t = sim_track_find(d->bus, SIM_TX_IDS, f->id);
+        if (!t) {
+                d->unknown++;
+                sim_fail(d, "sent a frame nobody queued, id 0x%x", f->id);
+                return;
+        }
+        sim_track_frame(d, t, f, "bus");
+}
+
+static struct sk_buff *sim_tx_skb(struct sim_dev *d)
+{
+        unsigned int i = sim_rand(&d->rng) % SIM_TX_IDS;
+        struct can_frame *cf;
+        struct sk_buff *skb;
+        struct sim_frame f;
+
+        skb = alloc_skb(sizeof(*cf), GFP_KERNEL);
+        if (!skb)
+                return NULL;
+
+        memset(&f, 0, sizeof(f));
+        f.id = tx_ids[i];
+        /* a random length keeps one sequence byte, so no frame goes unchecked */
+        f.dlc = opts.dlc < 0 ? 1 + sim_rand(&d->rng) % 8 : opts.dlc;
+        sim_frame_stamp(&f, d->tx_seq[i]++);
+
+        cf = (struct can_frame *)skb_put(skb, sizeof(*cf));
+        memset(cf, 0, sizeof(*cf));
+        cf->can_id = f.id;
+        cf->can_dlc = f.dlc;
+        memcpy(cf->data, f.data, sizeof(cf->data));
+
+        skb->dev = d->dev;
+        skb->protocol = htons(ETH_P_CAN);
+        skb->pkt_type = PACKET_LOOPBACK;
+        skb->sk = &tx_sk;
+        skb->destructor = true;
+        return skb;
+}
+
+/* the socket and qdisc above the driver: one frame every 1/tx_rate s */
+static bool sim_tx(struct sim_dev *d, bool draining)
+{
+        s64 now = sim_now();
+
+        if (!d->held) {
+                if (draining || !opts.tx_rate || now < d->tx_next)
+                        return false;
+                d->held = sim_tx_skb(d);
+                d->tx_next += NSEC_PER_SEC / opts.tx_rate / 2 +
+                        (s64)(sim_rand(&d->rng) % 1000) * (NSEC_PER_SEC / opts.tx_rate) / 1000;
+                if (d->tx_next < now)
+                        d->tx_next = now;
+        }
+
+        if (netif_queue_stopped(d->dev) || !d->dev->carrier)
+                return false;
+
+        d->xmit++;
+        if (sim_xmit(d->dev, d->held) != NETDEV_TX_OK)
+                sim_fail(d, "start_xmit returned busy");
+        d->held = NULL;
+        return true;
+}
+
+/* bit timing for the bitrate with a sample point near 87.5% */
+static int sim_set_bittiming(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct can_bittiming *bt = &priv->can.bittiming;
+        const struct can_bittiming_const *btc = priv->can.bittiming_const;
+        u32 clock = priv->can.clock.freq;
+        u32 brp, tq, tseg1, tseg2;
+
+        for (brp = btc->brp_min; brp <= btc->brp_max; brp++) {
+                if (clock % (brp * opts.bitrate))
+                        continue;
+                tq = clock / (brp * opts.bitrate);
+                if (tq < 8 || tq > 1 + btc->tseg1_max + btc->tseg2_max)
+                        continue;
+
+                tseg2 = clamp_t(u32, tq - (tq * 875 + 500) / 1000, btc->tseg2_min, btc->tseg2_max);
+                tseg1 = tq - 1 - tseg2;
+                if (tseg1 > btc->tseg1_max)
+                        continue;
+
+                memset(bt, 0, sizeof(*bt));
+                bt->bitrate = opts.bitrate;
+                bt->brp = brp;
+                bt->tq = (u64)brp * NSEC_PER_SEC / clock;
+                bt->prop_seg = tseg1 / 2;
+                bt->phase_seg1 = tseg1 - bt->prop_seg;
+                bt->phase_seg2 = tseg2;
+                bt->sjw = 1;
+                bt->sample_point = 1000 * (1 + tseg1) / tq;
+                return priv->can.do_set_bittiming(dev);
+        }
+
+        fprintf(stderr, "no bit timing for %u bit/s from a %u Hz clock\n", opts.bitrate, clock);
+        return -EINVAL;
+}
+
+/* a driver statistic by its ethtool -S name, 0 if the driver has none of that name */
+static u64 sim_xstat(struct net_device *dev, const char *name)
+{
+        const struct ethtool_ops *ops = dev->ethtool_ops;
+        u8 (*strings)[ETH_GSTRING_LEN];
+        u64 *data, val = 0;
+        int i, n;
+
+        if (!ops)
+                return 0;
+        n = ops->get_sset_count(dev, ETH_SS_STATS);
+        strings = calloc(n, ETH_GSTRING_LEN);
+        data = calloc(n, sizeof(*data));
+        ops->get_strings(dev, ETH_SS_STATS, (u8 *)strings);
+        ops->get_ethtool_stats(dev, NULL, data);
+        for (i = 0; i < n; i++)
+                if (!strcmp((char *)strings[i], name))
+                        val = data[i];
+        free(strings);
+        free(data);
+        return val;
+}
+
+static void sim_ethtool(struct net_device *dev)
+{
+        const struct ethtool_ops *ops = dev->ethtool_ops;
+        u8 (*strings)[ETH_GSTRING_LEN];
+        u64 *data;
+        int i, n;
+
+        if (!ops) {
+                printf("  %s: no driver statistics\n", dev->name);
+                return;
+        }
+        n = ops->get_sset_count(dev, ETH_SS_STATS);
+        strings = calloc(n, ETH_GSTRING_LEN);
+        data = calloc(n, sizeof(*data));
+        ops->get_strings(dev, ETH_SS_STATS, (u8 *)strings);
+        ops->get_ethtool_stats(dev, NULL, data);
+        printf("  ethtool -S %s:\n", dev->name);
+        for (i = 0; i < n; i++)
+                printf("    %-24s %llu\n", (char *)strings[i], data[i]);
+        free(strings);
+        free(data);
+}
+
+static double per(double a, double b)
+{
+        return b ? a / b : 0;
+}
+
+static void sim_run(s64 end, bool draining);
+
+/* a sleep in a sysfs/debugfs call: the rest of the system runs meanwhile */
+static void sim_sleep_run(s64 until)
+{
+        enum sim_act saved = sim_act_enter(SIM_ACT_IDLE);
+
+        sim_run(until, false);
+        sim_act_exit(saved);
+}
+
+/* frames of a filtered identifier are only allowed if stamped before the change */
+static void sim_accept_from_now(struct sim_dev *d)
+{
+        unsigned int i;
+
+        for (i = 0; i < d->gen.ids; i++)
+                d->accept_seq[i] = d->gen.seq[i];
+}
+
+/*
+* change the filter while traffic runs, in turn:
+*   rx_ids, the SFF identifiers of even generator index
+*   rx_ids, every identifier of even index (mixed, acceptance filter open)
+*   acceptance_filter, exactly the first SFF identifier
+*   rx_ids off
+*/
+static void sim_filter_step(struct sim_dev *d)
+{
+        unsigned int i, step = d->filter_step++ % 4;
+        bool accept[ARRAY_SIZE(d->accept)];
+        char buf[PAGE_SIZE], sff[256] = "sff", eff[256] = " eff";
+        const char *attr = "rx_ids";
+        size_t ls = strlen(sff), le = strlen(eff);
+        canid_t id, first = ~0U;
+        bool open = true;
+        ssize_t n;
+
+        for (i = 0; i < d->gen.ids; i++) {
+                id = d->gen.id[i];
+                if (!(id & CAN_EFF_FLAG) && first == ~0U)
+                        first = id;
+        }
+        if (step == 2 && first == ~0U)
+                step = 3;
+
+        for (i = 0; i < d->gen.ids; i++) {
+                id = d->gen.id[i];
+                if (step == 2) {
+                        /* the single SFF filter also passes EFF frames of the same ID28..18 */
+                        accept[i] = id == first || ((id & CAN_EFF_FLAG) &&
+                                                    ((id & CAN_EFF_MASK) >> 18) == first);
+                        continue;
+                }
+                accept[i] = step == 3 || (!(i % 2) && !(step == 0 && (id & CAN_EFF_FLAG)));
+                if (step == 3 || !accept[i])
+                        continue;
+                open = false;
+                if (id & CAN_EFF_FLAG)
+                        le += snprintf(eff + le, sizeof(eff) - le, " 0x%x", id & CAN_EFF_MASK);
+                else
+                        ls += snprintf(sff + ls, sizeof(sff) - ls, " 0x%x", id);
+        }
+
+        if (step == 2) {
+                attr = "acceptance_filter";
+                snprintf(buf, sizeof(buf), "single sff 0x%x 0x%x\n", first, CAN_SFF_MASK);
+        } else if (open) {
+                for (i = 0; i < d->gen.ids; i++)
+                        accept[i] = true;
+                snprintf(buf, sizeof(buf), "off\n");
+        } else {
+                snprintf(buf, sizeof(buf), "%s%s\n", sff, le > 4 ? eff : "");
+        }
+        /* a store to rx_ids starts the count of rejected frames again */
+        if (step != 2)
+                d->sw_rejected += sim_xstat(d->dev, "sw_filter_rejected");
+
+        /* frames the poll delivers during the change passed either filter */
+        for (i = 0; i < d->gen.ids; i++)
+                d->accept[i] = true;
+        n = sim_sysfs_store(d->dev, attr, buf);
+        memcpy(d->accept, accept, sizeof(accept));
+        sim_accept_from_now(d);
+        if (n != (ssize_t)strlen(buf)) {
+                sim_fail(d, "writing %s to %s returned %zd", buf, attr, n);
+                return;
+        }
+
+        n = sim_sysfs_show(d->dev, attr, buf);
+        if (n <= 0 || (!strncmp(buf, "off", 3)) != (step != 2 && open))
+                sim_fail(d, "%s reads back as %s", attr, n > 0 ? buf : "nothing");
+        n = sim_sysfs_show(d->dev, "rx_id_hits", buf);
+        if (n <= 0 || !strstr(buf, "miss "))
+                sim_fail(d, "rx_id_hits reads back as %s", n > 0 ? buf : "nothing");
+}
+
+static ssize_t sim_debugfs_set(struct sim_dev *d, const char *file, const char *val)
+{
+        char path[64];
+
+        snprintf(path, sizeof(path), "sunxi_can/%s/%s", d->dev->name, file);
+        return sim_debugfs_write(path, val);
+}
+
+static ssize_t sim_debugfs_get(struct sim_dev *d, const char *file, char *buf, size_t size)
+{
+        char path[64];
+
+        snprintf(path, sizeof(path), "sunxi_can/%s/%s", d->dev->name, file);
+        return sim_debugfs_read(path, buf, size);
+}
+
+/* one loopback benchmark run of a second while the other nodes keep sending */
+static void sim_bench(struct sim_dev *d)
+{
+        unsigned long tx, dropped, rx, lost;
+        char id[16];
+        ssize_t n;
+
+        snprintf(id, sizeof(id), "%#x", SIM_BENCH_ID);
+        sim_debugfs_set(d, "bench_secs", "1");
+        sim_debugfs_set(d, "bench_id", id);
+        sim_debugfs_set(d, "bench_eff", "0");
+        sim_debugfs_set(d, "bench_dlc", "8");
+
+        d->bench_active = true;
+        n = sim_debugfs_set(d, "bench", "1\n");
+        d->bench_active = false;
+        if (n < 0) {
+                sim_fail(d, "bench run failed, error %zd", n);
+                return;
+        }
+
+        n = sim_debugfs_get(d, "bench", d->bench_result, sizeof(d->bench_result));
+        if (n <= 0 || sscanf(d->bench_result, "tx %lu tx_dropped %lu rx %lu lost %lu",
+                             &tx, &dropped, &rx, &lost) != 4) {
+                sim_fail(d, "bench result unreadable");
+                return;
+        }
+        if (!rx || lost)
+                sim_fail(d, "bench: %lu frames sent, %lu received, %lu lost", tx, rx, lost);
+        if (rx != d->bench_rx || tx - dropped != d->bench_bus)
+                sim_fail(d, "bench counted %lu sent and %lu received, %lu were on the bus and "
+                         "%lu reached the stack", tx - dropped, rx, d->bench_bus, d->bench_rx);
+}
+
+/* start the ID statistics over, the frames counted from here are compared at the end */
+static void sim_id_stats_clear(struct sim_dev *d)
+{
+        unsigned int i;
+
+        if (sim_debugfs_set(d, "id_stats", "0\n") < 0) {
+                sim_fail(d, "clearing id_stats failed");
+                return;
+        }
+        for (i = 0; i < d->gen.ids; i++) {
+                d->rx[i].frames = 0;
+                d->rx[i].bytes = 0;
+        }
+}
+
+/* the text and binary ID statistics against the frames the stack received */
+static unsigned long sim_id_stats_check(struct sim_dev *d)
+{
+        struct sunxi_can_id_stats *bin;
+        const struct sunxi_can_id_stat *e;
+        bool listed[ARRAY_SIZE(d->rx)] = { false };
+        unsigned long overflow = ~0UL, fails = 0;
+        unsigned long long bytes;
+        char *text, *line, tok[16];
+        struct sim_track *t;
+        unsigned int i, j, count;
+        canid_t id;
+        ssize_t n;
+
+        text = malloc(65536);
+        n = sim_debugfs_get(d, "id_stats", text, 65536);
+        if (n <= 0) {
+                sim_fail(d, "id_stats unreadable");
+                free(text);
+                return 1;
+        }
+        for (line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+                if (sscanf(line, "eff_overflow %lu", &overflow) == 1)
+                        continue;
+                if (sscanf(line, "%15s %u %llu", tok, &count, &bytes) != 3 ||
+                    strspn(tok, "0123456789abcdef") != strlen(tok))
+                        continue;
+                id = strtoul(tok, NULL, 16) | (strlen(tok) == 8 ? CAN_EFF_FLAG : 0);
+                t = sim_track_find(d->rx, d->gen.ids, id);
+                if (!t) {
+                        sim_fail(d, "id_stats lists 0x%x, nobody sent it", id);
+                        fails++;
+                        continue;
+                }
+                listed[t - d->rx] = true;
+                if (count != t->frames || bytes != t->bytes) {
+                        sim_fail(d, "id_stats: 0x%x %u frames %llu bytes, received %lu frames "
+                                 "%llu bytes", id, count, bytes, t->frames,
+                                 (unsigned long long)t->bytes);
+                        fails++;
+                }
+        }
+        free(text);
+        if (overflow) {
+                sim_fail(d, "id_stats eff_overflow %lu", overflow);
+                fails++;
+        }
+
+        bin = malloc(sizeof(*bin) + 1);
+        n = sim_debugfs_get(d, "id_stats.bin", (char *)bin, sizeof(*bin) + 1);
+        if (n != sizeof(*bin)) {
+                sim_fail(d, "id_stats.bin: read %zd of %zu bytes", n, sizeof(*bin));
+                free(bin);
+                return fails + 1;
+        }
+        for (i = 0; i < d->gen.ids; i++) {
+                t = &d->rx[i];
+                if (t->frames && !listed[i]) {
+                        sim_fail(d, "id_stats misses 0x%x, %lu frames received", t->id, t->frames);
+                        fails++;
+                }
+                e = NULL;
+                if (!(t->id & CAN_EFF_FLAG)) {
+                        e = &bin->sff[t->id];
+                } else {
+                        for (j = 0; j < SUNXI_CAN_ID_STATS_EFF; j++)
+                                if (bin->eff[j].id == t->id)
+                                        e = &bin->eff[j];
+                }
+                if ((e ? e->count : 0) != t->frames) {
+                        sim_fail(d, "id_stats.bin: 0x%x %u frames, received %lu", t->id,
+                                 e ? e->count : 0, t->frames);
+                        fails++;
+                }
+        }
+        free(bin);
+
+        return fails;
+}
+
+/* the scenario's sysfs/debugfs action, in process context; false if none is due */
+static bool sim_control(struct sim_dev *d, bool draining)
+{
+        enum sim_act saved;
+
+        /* nothing else starts while an action sleeps */
+        if (draining || sim_sleep_hook || sim_now() < d->ctrl_next)
+                return false;
+
+        saved = sim_act_enter(SIM_ACT_CTRL);
+        sim_sleep_hook = sim_sleep_run;
+        if (opts.filter_ms) {
+                sim_filter_step(d);
+                d->ctrl_next += (s64)opts.filter_ms * NSEC_PER_MSEC;
+        } else {
+                if (opts.bench)
+                        sim_bench(d);
+                if (opts.id_stats)
+                        sim_id_stats_clear(d);
+                d->ctrl_next = KTIME_MAX;
+        }
+        sim_sleep_hook = NULL;
+        sim_act_exit(saved);
+        return true;
+}
+
+/* frames the driver still holds the echo skb of, e.g. while bus-off */
+static unsigned long sim_echo_pending(struct net_device *dev)
+{
+        struct can_priv *can = netdev_priv(dev);
+        unsigned long n = 0;
+        unsigned int i;
+
+        for (i = 0; i < can->echo_skb_max; i++)
+                if (can->echo_skb[i])
+                        n++;
+        return n;
+}
+
+/* checks after the run, returns the number of failed ones */
+static unsigned long sim_check(struct sim_dev *d)
+{
+        const struct sim_can_stats *cs = sim_can_stats(d->can);
+        struct net_device_stats *st = &d->dev->stats;
+        unsigned long stored, delivered, pending, fails = 0;
+
+        stored = cs->rx_fifo - cs->rx_reset_flushed - sim_can_fifo_frames(d->can);
+        delivered = d->rx_frames + d->bench_rx + d->looped + st->rx_dropped +
+                d->sw_rejected + sim_xstat(d->dev, "sw_filter_rejected");
+        if (delivered != stored) {
+                sim_fail(d, "%lu frames stored in the RX FIFO, %lu received or dropped",
+                         stored, delivered);
+                fails++;
+        }
+        /* the drain leaves no frame behind unless RX stopped for good */
+        if (sim_can_fifo_frames(d->can)) {
+                sim_fail(d, "%u frames left in the RX FIFO after the drain",
+                         sim_can_fifo_frames(d->can));
+                fails++;
+        }
+        pending = sim_echo_pending(d->dev);
+        if (d->echoes + st->tx_dropped + pending != d->xmit) {
+                sim_fail(d, "%lu frames transmitted, %lu echoed, %lu dropped, %lu pending",
+                         d->xmit, d->echoes, st->tx_dropped, pending);
+                fails++;
+        }
+        if (d->echoes + d->bench_bus != cs->tx_frames) {
+                sim_fail(d, "%lu frames on the bus, %lu echoed, %lu benchmark frames",
+                         cs->tx_frames, d->echoes, d->bench_bus);
+                fails++;
+        }
+        if (opts.no_drops && (cs->rx_overruns || cs->rx_reset_flushed || st->rx_dropped ||
+                              st->tx_dropped)) {
+                sim_fail(d, "frames dropped");
+                fails++;
+        }
+        if (opts.id_stats)
+                fails += sim_id_stats_check(d);
+        /* the per-type error counters keep what coalescing merged */
+        if (opts.berr && !sim_xstat(d->dev, "berr_storms") &&
+            sim_xstat(d->dev, "err_bus_errors") != cs->bus_errors) {
+                sim_fail(d, "%lu bus errors, err_bus_errors %llu", cs->bus_errors,
+                         sim_xstat(d->dev, "err_bus_errors"));
+                fails++;
+        }
+        /* without NAPI the ISR receives, the poll only takes over deferred frames */
+        if (!sim_param("use_napi")) {
+                struct sunxi_can_priv *priv = netdev_priv(d->dev);
+                u64 deferrals = sim_xstat(d->dev, "isr_deferrals");
+
+                if (sim_xstat(d->dev, "rx_poll_switches")) {
+                        sim_fail(d, "use_napi=0 switched to hrtimer polling");
+                        fails++;
+                }
+                if (priv->napi.sim_scheduled > deferrals + d->filter_step) {
+                        sim_fail(d, "use_napi=0: %lu NAPI polls scheduled, %llu ISR deferrals",
+                                 priv->napi.sim_scheduled, deferrals);
+                        fails++;
+                }
+        }
+
+        return fails + d->corrupt + d->duplicates + d->reordered + d->unknown +
+                d->filtered_leaks + cs->protocol_errors;
+}
+
+static void sim_report(struct sim_dev *d, double secs)
+{
+        const struct sim_can_stats *cs = sim_can_stats(d->can);
+        struct net_device_stats *st = &d->dev->stats;
+        struct net_device *dev = d->dev;
+        unsigned long n, frames = d->rx_frames + d->echoes;
+        unsigned int i;
+
+        printf("%s: %.0f rx frames/s, %.0f tx frames/s, %lu bus frames of other nodes\n",
+               dev->name, d->rx_frames / secs, d->echoes / secs, cs->bus_frames);
+        printf("  mmio: %.1f per frame (model: %lu reads, %lu writes)\n",
+               per(cs->mmio_reads + cs->mmio_writes, frames), cs->mmio_reads, cs->mmio_writes);
+        if (dev->ethtool_ops)
+                printf("  mmio per frame (driver): rx %.1f, tx %.1f, isr %llu reads %llu writes\n",
+                       per(sim_xstat(dev, "rx_mmio_reads") + sim_xstat(dev, "rx_mmio_writes"),
+                           sim_xstat(dev, "rx_drained")),
+                       per(sim_xstat(dev, "tx_mmio_reads") + sim_xstat(dev, "tx_mmio_writes"),
+                           st->tx_packets),
+                       sim_xstat(dev, "isr_mmio_reads"), sim_xstat(dev, "isr_mmio_writes"));
+        printf("  drops: %lu rx overruns, %lu flushed by reset, %lu not listening, "
+               "%lu rx_dropped, %lu tx_dropped, %lu filtered\n",
+               cs->rx_overruns, cs->rx_reset_flushed, cs->rx_not_listening,
+               st->rx_dropped, st->tx_dropped, cs->rx_filtered);
+        printf("  tx: %lu queued, %lu aborted, %lu cancelled by reset, %lu arbitration lost, "
+               "%lu retries\n",
+               d->xmit, cs->tx_aborted, cs->tx_reset_aborted, cs->tx_arb_lost, cs->tx_retries);
+        printf("  errors: %lu bus errors, %lu bus-off, %lu recoveries, %lu error frames "
+               "(%lu bus-off, %lu restarted)\n",
+               cs->bus_errors, cs->bus_offs, cs->recoveries, d->err_frames,
+               d->err_busoff, d->err_restarted);
+        if (dev->ethtool_ops)
+                printf("  isr: %llu calls, %llu loops, %llu deferrals, %llu poll switches, "
+                       "%lu NAPI polls scheduled\n",
+                       sim_xstat(dev, "isr_calls"), sim_xstat(dev, "isr_loops"),
+                       sim_xstat(dev, "isr_deferrals"), sim_xstat(dev, "rx_poll_switches"),
+                       ((struct sunxi_can_priv *)netdev_priv(dev))->napi.sim_scheduled);
+        if (opts.filter_ms)
+                printf("  filter: %u changes, %llu frames rejected by the filter bank\n",
+                       d->filter_step, d->sw_rejected + sim_xstat(dev, "sw_filter_rejected"));
+        if (opts.id_stats) {
+                for (i = 0, n = 0; i < d->gen.ids; i++)
+                        n += d->rx[i].frames;
+                printf("  id_stats: %lu frames of %u identifiers since the clear\n", n, d->gen.ids);
+        }
+        if (opts.bench)
+                printf("  bench: %lu frames on the bus, %lu received back, %lu of ours looped\n"
+                       "%s", d->bench_bus, d->bench_rx, d->looped, d->bench_result);
+        printf("  checks: %lu corrupt, %lu duplicate, %lu reordered, %lu unknown, "
+               "%lu past the filter\n",
+               d->corrupt, d->duplicates, d->reordered, d->unknown, d->filtered_leaks);
+
+        if (opts.ethtool)
+                sim_ethtool(dev);
+}
+
+static void sim_report_cpu(double secs)
+{
+        unsigned long frames = 0;
+        u64 host = 0;
+        int i;
+
+        for (i = 0; i < n_devs; i++)
+                frames += devs[i].rx_frames + devs[i].echoes;
+        for (i = SIM_ACT_IRQ; i < SIM_ACT_NR; i++)
+                host += sim_host_ns[i];
+
+        printf("cpu: %.0f host ns per frame (driver and model)\n", per(host, frames));
+        for (i = SIM_ACT_IRQ; i < SIM_ACT_NR; i++) {
+                if (!sim_act_ns[i] && !sim_mmio[i])
+                        continue;
+                printf("  %-10s %6.2f%% virtual cpu, %llu mmio\n", act_names[i],
+                       100.0 * sim_act_ns[i] / (secs * NSEC_PER_SEC), sim_mmio[i]);
+        }
+}
+
+/* one step of the event loop, false when nothing was ready to run */
+static bool sim_step(bool draining)
+{
+        int i;
+
+        for (i = 0; i < n_devs; i++)
+                if (sim_run_irq(sim_can_irq(devs[i].can), sim_can_irq_line(devs[i].can)))
+                        return true;
+        if (sim_run_hrtimers())
+                return true;
+        if (sim_run_softirq())
+                return true;
+        if (sim_run_irq_threads())
+                return true;
+        if (sim_run_work())
+                return true;
+        for (i = 0; i < n_devs; i++)
+                if (sim_control(&devs[i], draining))
+                        return true;
+        for (i = 0; i < n_devs; i++)
+                if (sim_tx(&devs[i], draining))
+                        return true;
+
+        return false;
+}
+
+static void sim_run(s64 end, bool draining)
+{
+        s64 next, t;
+        int i;
+
+        while (sim_now() < end) {
+                if (sim_step(draining))
+                        continue;
+
+                next = min(end, sim_next_timer_ns());
+                for (i = 0; i < n_devs; i++) {
+                        t = sim_can_next_event(devs[i].can);
+                        if (t < next)
+                                next = t;
+                        if (!draining && opts.tx_rate && !devs[i].held && devs[i].tx_next < next)
+                                next = devs[i].tx_next;
+                        if (!draining && !sim_sleep_hook && devs[i].ctrl_next < next)
+                                next = devs[i].ctrl_next;
+                }
+                if (next <= sim_now())
+                        next = sim_now() + 1;
+                sim_set_time(next);
+        }
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "usage: %s [options] rx|tx|err|filter|bench|ids|scale\n"
+                "  rx      frames of other nodes at --load, nothing sent\n"
+                "  tx      --tx-rate frames/s sent while other nodes load the bus\n"
+                "  err     tx with bus errors, forced bus-off and error reporting\n"
+                "  filter  rx while rx_ids and acceptance_filter change every --filter-ms\n"
+                "  bench   rx with a loopback benchmark run through debugfs\n"
+                "  ids     rx with id_stats, checked against the frames received\n"
+                "  scale   tx on one controller, then on --devices at once, which must\n"
+                "          each do as well as the one alone\n"
+                "options:\n"
+                "  -t, --time SECS          virtual time to run (%u)\n"
+                "  -b, --bitrate BPS        (%u)\n"
+                "  -l, --load PCT           bus load of the other nodes\n"
+                "      --dlc N              data length, -1 random (%d)\n"
+                "      --ids N              identifiers of the other nodes (%u)\n"
+                "      --eff PCT            share of EFF identifiers (%u)\n"
+                "      --tx-rate N          frames/s sent\n"
+                "      --err-rate N         bus errors/s\n"
+                "      --busoff-ms N        force a bus-off this often\n"
+                "      --restart-ms N       restart-ms of the interface (%d)\n"
+                "      --berr               bus error reporting on\n"
+                "      --filter-ms N        change the filter this often\n"
+                "      --mmio-read NS, --mmio-write NS, --barrier NS, --irq NS\n"
+                "                           virtual cost of register access and interrupts\n"
+                "      --softirq-delay US   NAPI polls run this late, as from ksoftirqd\n"
+                "  -p, --param NAME=VAL     module parameter, -p list shows them\n"
+                "      --ethtool            print the driver statistics\n"
+                "      --no-drops           fail on any dropped frame\n"
+                "  -v, --verbose            kernel log\n"
+                "      --devices N          controllers (%u)\n"
+                "      --seed N\n",
+                prog, opts.secs, opts.bitrate, opts.dlc, opts.ids, opts.eff_pct,
+                opts.restart_ms, opts.devices);
+        exit(2);
+}
+
+static const char *const scenarios[] = { "rx", "tx", "err", "filter", "bench", "ids", "scale" };
+
+static void sim_scenario(const char *name)
+{
+        if (!strcmp(name, "rx")) {
+                opts.load = 80;
+                opts.tx_rate = 0;
+        } else if (!strcmp(name, "tx")) {
+                opts.load = 30;
+                opts.tx_rate = 4000;
+        } else if (!strcmp(name, "err")) {
+                opts.load = 30;
+                opts.tx_rate = 2000;
+                opts.err_rate = 200;
+                opts.busoff_ms = 250;
+                opts.berr = true;
+                opts.restart_ms = 50;
+        } else if (!strcmp(name, "filter")) {
+                opts.load = 60;
+                opts.filter_ms = 100;
+        } else if (!strcmp(name, "bench")) {
+                opts.load = 30;
+                opts.bench = true;
+        } else if (!strcmp(name, "ids")) {
+                opts.load = 80;
+                opts.id_stats = true;
+                sim_param_set("id_stats=1");
+        } else if (!strcmp(name, "scale")) {
+                opts.load = 60;
+                opts.tx_rate = 4000;
+                opts.devices = 2;
+                opts.scale = true;
+        } else {
+                fprintf(stderr, "unknown scenario %s\n", name);
+                exit(2);
+        }
+}
+
+enum {
+        OPT_DLC = 256, OPT_IDS, OPT_EFF, OPT_TX_RATE, OPT_ERR_RATE, OPT_BUSOFF_MS,
+        OPT_RESTART_MS, OPT_BERR, OPT_MMIO_READ, OPT_MMIO_WRITE, OPT_BARRIER,
+        OPT_IRQ, OPT_SOFTIRQ_DELAY, OPT_ETHTOOL, OPT_NO_DROPS, OPT_FILTER_MS, OPT_DEVICES,
+        OPT_SEED,
+};
+
+static const struct option long_opts[] = {
+        { "time", 1, NULL, 't' },
+        { "bitrate", 1, NULL, 'b' },
+        { "load", 1, NULL, 'l' },
+        { "dlc", 1, NULL, OPT_DLC },
+        { "ids", 1, NULL, OPT_IDS },
+        { "eff", 1, NULL, OPT_EFF },
+        { "tx-rate", 1, NULL, OPT_TX_RATE },
+        { "err-rate", 1, NULL, OPT_ERR_RATE },
+        { "busoff-ms", 1, NULL, OPT_BUSOFF_MS },
+        { "restart-ms", 1, NULL, OPT_RESTART_MS },
+        { "berr", 0, NULL, OPT_BERR },
+        { "mmio-read", 1, NULL, OPT_MMIO_READ },
+        { "mmio-write", 1, NULL, OPT_MMIO_WRITE },
+        { "barrier", 1, NULL, OPT_BARRIER },
+        { "irq", 1, NULL, OPT_IRQ },
+        { "softirq-delay", 1, NULL, OPT_SOFTIRQ_DELAY },
+        { "param", 1, NULL, 'p' },
+        { "ethtool", 0, NULL, OPT_ETHTOOL },
+        { "no-drops", 0, NULL, OPT_NO_DROPS },
+        { "filter-ms", 1, NULL, OPT_FILTER_MS },
+        { "devices", 1, NULL, OPT_DEVICES },
+        { "verbose", 0, NULL, 'v' },
+        { "seed", 1, NULL, OPT_SEED },
+        { "help", 0, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+};
+
+static void sim_options(int argc, char **argv)
+{
+        const char *scenario = NULL;
+        unsigned int j;
+        int i, c;
+
+        /* the scenario sets the defaults the options then change */
+        for (i = 1; i < argc; i++) {
+                for (j = 0; j < ARRAY_SIZE(scenarios); j++)
+                        if (!strcmp(argv[i], scenarios[j]))
+                                scenario = argv[i];
+                if (!strcmp(argv[i], "list") && i > 1 && !strcmp(argv[i - 1], "-p"))
+                        scenario = "rx";
+        }
+        if (!scenario)
+                usage(argv[0]);
+        sim_scenario(scenario);
+
+        while ((c = getopt_long(argc, argv, "t:b:l:p:vh", long_opts, NULL)) != -1) {
+                switch (c) {
+                case 't':
+                        opts.secs = atoi(optarg);
+                        break;
+                case 'b':
+                        opts.bitrate = atoi(optarg);
+                        break;
+                case 'l':
+                        opts.load = atoi(optarg);
+                        break;
+                case OPT_DLC:
+                        opts.dlc = clamp(atoi(optarg), -1, 8);
+                        break;
+                case OPT_IDS:
+                        opts.ids = atoi(optarg);
+                        break;
+                case OPT_EFF:
+                        opts.eff_pct = atoi(optarg);
+                        break;
+                case OPT_TX_RATE:
+                        opts.tx_rate = atoi(optarg);
+                        break;
+                case OPT_ERR_RATE:
+                        opts.err_rate = atoi(optarg);
+                        break;
+                case OPT_BUSOFF_MS:
+                        opts.busoff_ms = atoi(optarg);
+                        break;
+                case OPT_RESTART_MS:
+                        opts.restart_ms = atoi(optarg);
+                        break;
+                case OPT_BERR:
+                        opts.berr = true;
+                        break;
+                case OPT_MMIO_READ:
+                        sim_costs.mmio_read_ns = atoi(optarg);
+                        break;
+                case OPT_MMIO_WRITE:
+                        sim_costs.mmio_write_ns = atoi(optarg);
+                        break;
+                case OPT_BARRIER:
+                        sim_costs.barrier_ns = atoi(optarg);
+                        break;
+                case OPT_IRQ:
+                        sim_costs.irq_ns = atoi(optarg);
+                        break;
+                case OPT_SOFTIRQ_DELAY:
+                        sim_costs.softirq_delay_ns = (s64)atoi(optarg) * NSEC_PER_USEC;
+                        break;
+                case 'p':
+                        if (!strcmp(optarg, "list")) {
+                                sim_params_list(stdout);
+                                exit(0);
+                        }
+                        if (sim_param_set(optarg)) {
+                                fprintf(stderr, "bad module parameter %s\n", optarg);
+                                exit(2);
+                        }
+                        break;
+                case OPT_ETHTOOL:
+                        opts.ethtool = true;
+                        break;
+                case OPT_NO_DROPS:
+                        opts.no_drops = true;
+                        break;
+                case OPT_FILTER_MS:
+                        opts.filter_ms = atoi(optarg);
+                        break;
+                case OPT_DEVICES:
+                        opts.devices = clamp(atoi(optarg), 1, SIM_DEVICES);
+                        break;
+                case 'v':
+                        sim_verbose = true;
+                        break;
+                case OPT_SEED:
+                        opts.seed = strtoul(optarg, NULL, 0);
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+
+        if (!opts.secs || !opts.bitrate || opts.load > 100)
+                usage(argv[0]);
+}
+
+static int sim_setup(void)
+{
+        static struct sunxi_can_platform_data pdata = {
+                .para = "can_para",
+                .clk_gate = "apb_can",
+                .clk_mod = "can",
+        };
+        struct resource res[2];
+        struct sim_can_cfg cfg;
+        struct platform_device *pdev;
+        struct sunxi_can_priv *priv;
+        struct sim_dev *d;
+        enum sim_act saved;
+        s64 bit_ns = NSEC_PER_SEC / opts.bitrate;
+        int i, j, err;
+
+        sim_can_set_bus_hook(sim_bus_frame);
+        for (i = 0; i < opts.devices; i++) {
+                d = &devs[i];
+                d->gen.load = opts.load;
+                d->gen.ids = opts.ids;
+                d->gen.dlc = opts.dlc;
+                d->gen.eff_pct = opts.eff_pct;
+                d->gen.bit_ns = bit_ns;
+                sim_gen_init(&d->gen, opts.seed * 31 + i, sim_now());
+
+                memset(&cfg, 0, sizeof(cfg));
+                cfg.clock = sim_clk_rate;
+                cfg.err_rate = opts.err_rate;
+                cfg.busoff_ms = opts.busoff_ms;
+                cfg.seed = opts.seed * 7919 + i;
+                d->can = sim_can_create(i ? SIM_CAN_PHYS + i * 0x400 : SIM_CAN0_PHYS,
+                                        i ? SIM_CAN_IRQ + i : SW_INT_IRQNO_CAN, &cfg, &d->gen);
+                d->rng = opts.seed * 104729 + i;
+        }
+        n_devs = opts.devices;
+
+        /* the module registers the first controller, the board the others */
+        saved = sim_act_enter(SIM_ACT_CTRL);
+        err = sim_module_init();
+        for (i = 1; !err && i < n_devs; i++) {
+                memset(res, 0, sizeof(res));
+                res[0].start = SIM_CAN_PHYS + i * 0x400;
+                res[0].end = res[0].start + 0x400 - 1;
+                res[0].flags = IORESOURCE_MEM;
+                res[1].start = res[1].end = SIM_CAN_IRQ + i;
+                res[1].flags = IORESOURCE_IRQ;
+                pdev = platform_device_register_resndata(NULL, "sunxi_can", i, res, 2,
+                                                         &pdata, sizeof(pdata));
+                if (IS_ERR(pdev))
+                        err = PTR_ERR(pdev);
+        }
+        sim_act_exit(saved);
+        if (err) {
+                fprintf(stderr, "module init failed, error %d\n", err);
+                return err;
+        }
+
+        for (i = 0; i < n_devs; i++) {
+                d = &devs[i];
+                d->dev = sim_netdev(i);
+                if (!d->dev) {
+                        fprintf(stderr, "controller %d was not registered\n", i);
+                        return -ENODEV;
+                }
+                priv = netdev_priv(d->dev);
+
+                for (j = 0; j < d->gen.ids; j++) {
+                        d->rx[j].id = d->gen.id[j];
+                        d->accept[j] = true;
+                }
+                for (j = 0; j < SIM_TX_IDS; j++)
+                        d->bus[j].id = d->echo[j].id = tx_ids[j];
+                d->tx_next = sim_now();
+                d->ctrl_next = KTIME_MAX;
+                if (opts.filter_ms)
+                        d->ctrl_next = sim_now() + (s64)opts.filter_ms * NSEC_PER_MSEC;
+                else if (opts.bench || opts.id_stats)
+                        d->ctrl_next = sim_now() + (s64)opts.secs * NSEC_PER_SEC / 4;
+
+                /* ip link set canN type can bitrate ... restart-ms ... berr-reporting on; up */
+                saved = sim_act_enter(SIM_ACT_CTRL);
+                err = sim_set_bittiming(d->dev);
+                if (!err) {
+                        priv->can.restart_ms = opts.restart_ms;
+                        if (opts.berr)
+                                priv->can.ctrlmode |= CAN_CTRLMODE_BERR_REPORTING;
+                        d->dev->running = true;
+                        err = d->dev->netdev_ops->ndo_open(d->dev);
+                        if (err)
+                                d->dev->running = false;
+                        else
+                                d->dev->flags |= IFF_UP;
+                }
+                sim_act_exit(saved);
+                if (err) {
+                        fprintf(stderr, "%s: open failed, error %d\n", d->dev->name, err);
+                        return err;
+                }
+        }
+
+        return 0;
+}
+
+/* what the scale scenario compares, per controller */
+struct sim_result {
+        double frames;                  /* received and echoed per second */
+        double cpu_ns;                  /* virtual CPU time per frame */
+        double mmio;                    /* register accesses per frame */
+};
+
+/* set up, run, check and tear down, returns the number of failures */
+static unsigned long sim_simulate(struct sim_result *res)
+{
+        s64 start, end;
+        unsigned long frames = 0, fails = 0;
+        double secs;
+        enum sim_act saved;
+        s64 cpu = 0;
+        u64 mmio = 0;
+        int i;
+
+        if (sim_setup())
+                return 1;
+
+        /* traffic, then the frames still in flight are drained */
+        start = sim_now();
+        end = start + (s64)opts.secs * NSEC_PER_SEC;
+        memset(sim_act_ns, 0, sizeof(s64) * SIM_ACT_NR);
+        memset(sim_host_ns, 0, sizeof(u64) * SIM_ACT_NR);
+        memset(sim_mmio, 0, sizeof(u64) * SIM_ACT_NR);
+        sim_run(end, false);
+        secs = (double)(sim_now() - start) / NSEC_PER_SEC;
+
+        for (i = 0; i < n_devs; i++)
+                devs[i].gen.next_ns = KTIME_MAX;
+        sim_run(end + SIM_DRAIN_NS, true);
+
+        for (i = 0; i < n_devs; i++) {
+                sim_report(&devs[i], secs);
+                fails += sim_check(&devs[i]);
+                frames += devs[i].rx_frames + devs[i].echoes;
+        }
+        sim_report_cpu(secs);
+        for (i = SIM_ACT_IRQ; i < SIM_ACT_NR; i++) {
+                cpu += sim_act_ns[i];
+                mmio += sim_mmio[i];
+        }
+        res->frames = frames / secs / n_devs;
+        res->cpu_ns = per(cpu, frames);
+        res->mmio = per(mmio, frames);
+
+        /* ip link set down, rmmod */
+        saved = sim_act_enter(SIM_ACT_CTRL);
+        for (i = 0; i < n_devs; i++) {
+                kfree_skb(devs[i].held);
+                devs[i].held = NULL;
+                devs[i].dev->netdev_ops->ndo_stop(devs[i].dev);
+                devs[i].dev->running = false;
+        }
+        sim_module_exit();
+        sim_act_exit(saved);
+
+        if (sim_skbs) {
+                fprintf(stderr, "FAIL: %lu skbs leaked\n", sim_skbs);
+                fails++;
+        }
+        if (sim_warnings)
+                fprintf(stderr, "FAIL: %lu warnings\n", sim_warnings);
+
+        return fails + failures + sim_warnings;
+}
+
+/*
+* the scale scenario: the same traffic on one controller alone, in a
+* child process, then on opts.devices controllers at once. Nothing in the
+* driver is shared between instances but the module parameters, so every
+* controller must keep the frame rate of the one alone and cost no more
+* CPU time or register accesses per frame.
+*/
+static int sim_scale_alone(struct sim_result *one)
+{
+        int fd[2], status;
+        bool got;
+        pid_t pid;
+
+        fflush(stdout);
+        if (pipe(fd) || (pid = fork()) < 0) {
+                perror("scale");
+                return -1;
+        }
+        if (!pid) {
+                close(fd[0]);
+                opts.devices = 1;
+                printf("one controller:\n");
+                status = sim_simulate(one) ? 1 : 0;
+                fflush(stdout);
+                if (write(fd[1], one, sizeof(*one)) != sizeof(*one))
+                        status = 1;
+                _exit(status);
+        }
+        close(fd[1]);
+        got = read(fd[0], one, sizeof(*one)) == sizeof(*one);
+        close(fd[0]);
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) || !got) {
+                fprintf(stderr, "FAIL: the run with one controller failed\n");
+                return -1;
+        }
+        return 0;
+}
+
+static unsigned long sim_scale_check(const struct sim_result *one, const struct sim_result *many)
+{
+        unsigned long fails = 0;
+
+        printf("scale: per controller, %u at once against one alone: %.0f / %.0f frames/s, "
+               "%.0f / %.0f cpu ns per frame, %.1f / %.1f mmio per frame\n",
+               opts.devices, many->frames, one->frames, many->cpu_ns, one->cpu_ns,
+               many->mmio, one->mmio);
+        if (many->frames < one->frames * 0.98) {
+                fprintf(stderr, "FAIL: %.0f frames/s per controller, %.0f alone\n",
+                        many->frames, one->frames);
+                fails++;
+        }
+        if (many->cpu_ns > one->cpu_ns * 1.05 || many->mmio > one->mmio * 1.05) {
+                fprintf(stderr, "FAIL: %.0f cpu ns and %.1f mmio per frame, "
+                        "%.0f and %.1f alone\n", many->cpu_ns, many->mmio, one->cpu_ns, one->mmio);
+                fails++;
+        }
+        return fails;
+}
+
+int main(int argc, char **argv)
+{
+        struct sim_result one, res;
+        unsigned long fails;
+
+        sim_options(argc, argv);
+        if (opts.scale) {
+                if (sim_scale_alone(&one)) {
+                        printf("FAIL\n");
+                        return 1;
+                }
+                printf("%u controllers:\n", opts.devices);
+        }
+
+        fails = sim_simulate(&res);
+        if (opts.scale)
+                fails += sim_scale_check(&one, &res);
+
+        printf("%s\n", fails ? "FAIL" : "PASS");
+        return fails ? 1 : 0;
+}
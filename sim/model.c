@@ -0,0 +1,850 @@
+/*
+* model.c - the A10/A20 CAN controller and its bus
+*
+* A register level model of what sunxi_can.c relies on: mode, command,
+* status and interrupt registers as described in sunxi_can.h, the TX
+* buffer, a 64 byte RX FIFO behind the acceptance filter, the error
+* counters with warning, passive and bus-off states, and the bus-off
+* recovery sequence. The bus carries the frames of the generator (the
+* other nodes) and the controller's own, one at a time in arbitration
+* order; bit stuffing is not modelled.
+*
+* The model advances lazily: every register access, and the event loop
+* between handlers, first brings it up to the current virtual time.
+* Register use the hardware does not allow is reported with sim_warn(),
+* which fails the run.
+*/
+
+#include <math.h>
+
+#include "sim.h"
+#include "../sunxi_can.h"
+
+#define SIM_CAN_WINDOW 0x400
+#define SIM_CAN_IO_VIRT 0xF0000000      /* static mapping of the sunxi I/O area */
+#define SIM_CCU_PHYS 0x01C20000         /* clock control unit, its gates are plain registers here */
+#define SIM_CCU_SIZE 0x400
+
+/* register offsets, from the A20 user manual */
+#define SIM_CAN_MSEL 0x00
+#define SIM_CAN_CMD 0x04
+#define SIM_CAN_STA 0x08
+#define SIM_CAN_INT 0x0c
+#define SIM_CAN_INTEN 0x10
+#define SIM_CAN_BTIME 0x14
+#define SIM_CAN_TEWL 0x18
+#define SIM_CAN_ERRC 0x1c
+#define SIM_CAN_RMCNT 0x20
+#define SIM_CAN_BUF0 0x40               /* BUF0..BUF12 in operation, ACPC/ACPM in reset mode */
+#define SIM_CAN_BUF12 0x70
+#define SIM_CAN_ACPC 0x40
+#define SIM_CAN_ACPM 0x44
+#define SIM_CAN_BUF_WINDOW 13
+#define SIM_CAN_FIFO_BYTES 64
+#define SIM_CAN_FIFO_FRAMES 32          /* 64 bytes hold at most 21 SFF frames */
+#define SIM_CAN_ERR_FRAME_BITS 20       /* error flag, delimiter and intermission */
+#define SIM_CAN_MAX 8
+
+struct sim_can_rx {
+        u32 win[SIM_CAN_BUF_WINDOW];
+        unsigned int bytes;
+};
+
+struct sim_can_bus_frame {
+        struct sim_frame f;
+        bool ours;
+        bool listening;         /* we were receiving when the frame started */
+        bool error;             /* destroyed by a bus error at end - error frame */
+        bool force_busoff;
+        s64 start;
+        s64 end;
+};
+
+struct sim_can {
+        u8 window[SIM_CAN_WINDOW] __attribute__((aligned(SIM_CAN_WINDOW)));
+        unsigned long phys;
+        unsigned int irq;
+        struct sim_can_cfg cfg;
+        struct sim_gen *gen;
+
+        /* registers */
+        u32 msel;
+        u32 inten;
+        u32 intr;               /* latched INT bits, RBUF_VLD is level triggered */
+        u32 btime;
+        u32 tewl;
+        u32 acpc;
+        u32 acpm;
+        u32 ecc;                /* error code capture in SIM_CAN_STA */
+        u32 txbuf[SIM_CAN_BUF_WINDOW];
+        int txerr;
+        int rxerr;
+
+        /* TX buffer */
+        bool tx_pending;        /* requested, not completed or aborted */
+        bool tx_self;           /* SELF_RCV_REQ */
+        bool tx_over;           /* TRANS_OVER */
+        s64 tx_ready;
+        struct sim_frame tx_frame;
+
+        /* RX FIFO */
+        struct sim_can_rx fifo[SIM_CAN_FIFO_FRAMES];
+        unsigned int fifo_head;
+        unsigned int fifo_count;
+        unsigned int fifo_bytes;
+        bool data_orun;
+
+        /* bus and error state */
+        bool busy;
+        struct sim_can_bus_frame cur;
+        s64 bus_free;
+        bool err_sta;
+        bool passive;
+        bool bus_off;
+        s64 recovery_end;       /* 0 unless recovering from bus-off */
+        s64 next_err;
+        s64 next_busoff;
+        u32 rng;
+
+        struct sim_can_stats stats;
+};
+
+static struct sim_can *cans[SIM_CAN_MAX];
+static int n_cans;
+static void (*bus_hook)(struct sim_can *c, const struct sim_frame *f, bool ours);
+
+static void sim_can_protocol_error(struct sim_can *c, const char *what)
+{
+        c->stats.protocol_errors++;
+        sim_warn("CAN@0x%08lx: %s", c->phys, what);
+}
+
+s64 sim_can_bit_ns(struct sim_can *c)
+{
+        u32 brp = (c->btime & 0x3FF) + 1;
+        u32 tseg1 = ((c->btime >> 16) & 0xF) + 1;
+        u32 tseg2 = ((c->btime >> 20) & 0x7) + 1;
+
+        return (s64)brp * (1 + tseg1 + tseg2) * NSEC_PER_SEC / c->cfg.clock;
+}
+
+static s64 sim_can_exp_ns(struct sim_can *c, unsigned int per_sec)
+{
+        double u = (sim_rand(&c->rng) + 1.0) / 4294967297.0;
+
+        return (s64)(-log(u) * NSEC_PER_SEC / per_sec);
+}
+
+static void sim_can_raise(struct sim_can *c, u32 bit)
+{
+        if (!(c->inten & bit))
+                return;
+        c->intr |= bit;
+        c->stats.irq_raised[ffs(bit) - 1]++;
+}
+
+static bool sim_can_listening(struct sim_can *c)
+{
+        return !(c->msel & RESET_MODE) && !c->bus_off && !c->recovery_end;
+}
+
+static bool sim_can_tx_ready(struct sim_can *c)
+{
+        return c->tx_pending && sim_can_listening(c) && !(c->msel & LISTEN_ONLY_MODE);
+}
+
+/* the frame window image the driver reads from SIM_CAN_BUF0 on */
+static unsigned int sim_can_encode(const struct sim_frame *f, u32 *win)
+{
+        bool eff = f->id & CAN_EFF_FLAG;
+        bool rtr = f->id & CAN_RTR_FLAG;
+        canid_t id = f->id & (eff ? CAN_EFF_MASK : CAN_SFF_MASK);
+        unsigned int hdr, i;
+
+        memset(win, 0, SIM_CAN_BUF_WINDOW * sizeof(*win));
+        win[0] = (eff << 7) | (rtr << 6) | f->dlc;
+        if (eff) {
+                win[1] = (id >> 21) & 0xFF;
+                win[2] = (id >> 13) & 0xFF;
+                win[3] = (id >> 5) & 0xFF;
+                win[4] = (id & 0x1F) << 3;
+                hdr = 5;
+        } else {
+                win[1] = (id >> 3) & 0xFF;
+                win[2] = (id & 0x7) << 5;
+                hdr = 3;
+        }
+        if (rtr)
+                return hdr;
+        for (i = 0; i < f->dlc && i < 8; i++)
+                win[hdr + i] = f->data[i];
+
+        return hdr + min_t(unsigned int, f->dlc, 8);
+}
+
+static void sim_can_decode(const u32 *win, struct sim_frame *f)
+{
+        unsigned int hdr, i;
+
+        memset(f, 0, sizeof(*f));
+        f->dlc = win[0] & 0xF;
+        if (win[0] & 0x80) {
+                f->id = ((win[1] & 0xFF) << 21) | ((win[2] & 0xFF) << 13) |
+                        ((win[3] & 0xFF) << 5) | ((win[4] >> 3) & 0x1F) | CAN_EFF_FLAG;
+                hdr = 5;
+        } else {
+                f->id = ((win[1] & 0xFF) << 3) | ((win[2] >> 5) & 0x7);
+                hdr = 3;
+        }
+        if (win[0] & 0x40) {
+                f->id |= CAN_RTR_FLAG;
+                return;
+        }
+        for (i = 0; i < f->dlc && i < 8; i++)
+                f->data[i] = win[hdr + i];
+}
+
+static u32 sim_can_arb_key(canid_t id)
+{
+        u32 rtr = (id & CAN_RTR_FLAG) ? 1 : 0;
+
+        if (id & CAN_EFF_FLAG)
+                return (((id & CAN_EFF_MASK) >> 18) << 21) | (0x3 << 19) |
+                        ((id & 0x3FFFF) << 1) | rtr;
+
+        return ((id & CAN_SFF_MASK) << 21) | (rtr << 20);
+}
+
+/* acceptance filter, ACPM bits set are "don't care", see sunxi_can_acp_layout() */
+static bool sim_can_accept(struct sim_can *c, const struct sim_frame *f)
+{
+        bool eff = f->id & CAN_EFF_FLAG;
+        u32 rtr = (f->id & CAN_RTR_FLAG) ? 1 : 0;
+        u32 care = ~c->acpm;
+        u32 val, f0, f1;
+
+        if (c->msel & SINGLE_FILTER) {
+                if (eff) {
+                        val = ((f->id & CAN_EFF_MASK) << 3) | (rtr << 2);
+                        care &= ~0x3;
+                } else {
+                        val = ((f->id & CAN_SFF_MASK) << 21) | (rtr << 20);
+                        care &= ~0x000F0000;
+                        if (!rtr && f->dlc > 0)
+                                val |= f->data[0] << 8;
+                        else
+                                care &= ~0xFF00;
+                        if (!rtr && f->dlc > 1)
+                                val |= f->data[1];
+                        else
+                                care &= ~0xFF;
+                }
+                return !((val ^ c->acpc) & care);
+        }
+
+        /* dual filter: either of the two halves matching accepts the frame */
+        if (eff) {
+                f0 = f1 = (f->id & CAN_EFF_MASK) >> 13;
+        } else {
+                f0 = f1 = ((f->id & CAN_SFF_MASK) << 5) | (rtr << 4);
+                /* filter 0 also compares the upper nibble of the first data byte */
+                if (!rtr && f->dlc > 0)
+                        f0 |= f->data[0] >> 4;
+                else
+                        care &= ~0x000F0000;
+                care &= ~0xF;
+        }
+
+        return !(((f0 << 16) ^ c->acpc) & care & 0xFFFF0000) ||
+                !((f1 ^ c->acpc) & care & 0xFFFF);
+}
+
+static void sim_can_fifo_flush(struct sim_can *c)
+{
+        c->stats.rx_reset_flushed += c->fifo_count;
+        c->fifo_count = 0;
+        c->fifo_bytes = 0;
+        c->data_orun = false;
+}
+
+static void sim_can_fifo_store(struct sim_can *c, const struct sim_frame *f)
+{
+        struct sim_can_rx *rx;
+        u32 win[SIM_CAN_BUF_WINDOW];
+        unsigned int bytes;
+
+        if (!sim_can_accept(c, f)) {
+                c->stats.rx_filtered++;
+                return;
+        }
+
+        bytes = sim_can_encode(f, win);
+        if (c->fifo_bytes + bytes > SIM_CAN_FIFO_BYTES || c->fifo_count == SIM_CAN_FIFO_FRAMES) {
+                c->stats.rx_overruns++;
+                if (!c->data_orun)
+                        sim_can_raise(c, DATA_ORUNI);
+                c->data_orun = true;
+                return;
+        }
+
+        rx = &c->fifo[(c->fifo_head + c->fifo_count) % SIM_CAN_FIFO_FRAMES];
+        memcpy(rx->win, win, sizeof(win));
+        rx->bytes = bytes;
+        c->fifo_count++;
+        c->fifo_bytes += bytes;
+        c->stats.rx_fifo++;
+}
+
+/* TX cancelled by reset mode or bus-off, TBUF_RDY without TRANS_OVER and no interrupt */
+static void sim_can_tx_cancel(struct sim_can *c)
+{
+        if (!c->tx_pending)
+                return;
+        c->tx_pending = false;
+        c->stats.tx_reset_aborted++;
+}
+
+static void sim_can_enter_reset(struct sim_can *c, s64 now)
+{
+        c->msel |= RESET_MODE;
+        sim_can_tx_cancel(c);
+        sim_can_fifo_flush(c);
+
+        /* our frame on the bus is cut short */
+        if (c->busy && c->cur.ours && !c->cur.error && c->cur.end > now) {
+                c->cur.error = true;
+                c->cur.end = now + SIM_CAN_ERR_FRAME_BITS * sim_can_bit_ns(c);
+        }
+}
+
+static void sim_can_err_state(struct sim_can *c, s64 now)
+{
+        bool sta = c->txerr >= 96 || c->rxerr >= 96;
+        bool passive = c->txerr >= 128 || c->rxerr >= 128;
+
+        if (c->rxerr > 255)
+                c->rxerr = 255;
+
+        if (sta != c->err_sta)
+                sim_can_raise(c, ERR_WRN);
+        if (passive != c->passive)
+                sim_can_raise(c, ERR_PASSIVE);
+        c->err_sta = sta;
+        c->passive = passive;
+
+        if (c->txerr >= 256 && !c->bus_off) {
+                c->bus_off = true;
+                c->txerr = 255;
+                c->stats.bus_offs++;
+                sim_can_raise(c, ERR_WRN);
+                sim_can_enter_reset(c, now);
+        }
+}
+
+/* bus-off recovery: 128 occurrences of 11 recessive bits */
+static void sim_can_recover(struct sim_can *c, s64 now)
+{
+        if (c->bus_off && !c->recovery_end)
+                c->recovery_end = now + 128 * 11 * sim_can_bit_ns(c);
+}
+
+static void sim_can_frame_done(struct sim_can *c)
+{
+        struct sim_can_bus_frame *b = &c->cur;
+        s64 t = b->end;
+        u32 dir;
+
+        c->busy = false;
+        c->bus_free = t;
+
+        if (b->error) {
+                /* cut short by reset mode or bus-off */
+                if (b->ours && !c->tx_pending)
+                        return;
+                c->stats.bus_errors++;
+                if (b->ours) {
+                        /* the controller retransmits unless TX was cancelled meanwhile */
+                        c->stats.tx_retries++;
+                        c->tx_ready = t;
+                } else {
+                        sim_gen_retry(c->gen, &b->f, t);
+                }
+                if (!b->listening || !sim_can_listening(c))
+                        return;
+
+                dir = b->ours ? 0 : ERR_DIR;
+                c->ecc = (((sim_rand(&c->rng) % 3) + 1) << 22) | dir |
+                        ((sim_rand(&c->rng) % 0x1c) << 16);
+                if (b->ours)
+                        c->txerr = b->force_busoff ? 256 : c->txerr + 8;
+                else
+                        c->rxerr++;
+                sim_can_raise(c, BUS_ERR);
+                sim_can_err_state(c, t);
+                return;
+        }
+
+        if (b->ours) {
+                c->tx_pending = false;
+                c->tx_over = true;
+                c->stats.tx_frames++;
+                if (c->txerr > 0)
+                        c->txerr--;
+                sim_can_err_state(c, t);
+                if (bus_hook)
+                        bus_hook(c, &b->f, true);
+                if (c->tx_self || (c->msel & LOOPBACK_MODE))
+                        sim_can_fifo_store(c, &b->f);
+                sim_can_raise(c, TBUF_VLD);
+                return;
+        }
+
+        sim_gen_pop(c->gen);
+        c->stats.bus_frames++;
+        if (bus_hook)
+                bus_hook(c, &b->f, false);
+        if (!b->listening || !sim_can_listening(c)) {
+                c->stats.rx_not_listening++;
+                return;
+        }
+        if (c->rxerr > 0)
+                c->rxerr--;
+        sim_can_err_state(c, t);
+        sim_can_fifo_store(c, &b->f);
+}
+
+/* start the next frame on the bus if one is ready by now, returns its start or KTIME_MAX */
+static s64 sim_can_arbitrate(struct sim_can *c, s64 now, bool start)
+{
+        struct sim_frame gf;
+        s64 gready = KTIME_MAX, tready = KTIME_MAX, t;
+        bool gen_ok, tx_ok, ours;
+        struct sim_can_bus_frame *b = &c->cur;
+        s64 bit = sim_can_bit_ns(c);
+
+        gen_ok = sim_gen_peek(c->gen, &gready, &gf);
+        tx_ok = sim_can_tx_ready(c);
+        if (tx_ok)
+                tready = c->tx_ready;
+        if (!gen_ok && !tx_ok)
+                return KTIME_MAX;
+
+        t = max(c->bus_free, min(gready, tready));
+        if (!start || t > now)
+                return t;
+
+        /* both ready at the start of frame: the lower arbitration key wins */
+        ours = tx_ok && tready <= t;
+        if (ours && gen_ok && gready <= t) {
+                if (sim_can_arb_key(gf.id) < sim_can_arb_key(c->tx_frame.id)) {
+                        ours = false;
+                        c->stats.tx_arb_lost++;
+                        if (sim_can_listening(c))
+                                sim_can_raise(c, ARB_LOST);
+                }
+        }
+
+        memset(b, 0, sizeof(*b));
+        b->f = ours ? c->tx_frame : gf;
+        b->ours = ours;
+        b->listening = sim_can_listening(c);
+        b->start = t;
+        b->end = t + (s64)sim_frame_bits(&b->f) * bit;
+        c->busy = true;
+
+        /* bus errors are a Poisson process over the time frames are on the bus */
+        if (c->cfg.err_rate) {
+                while (c->next_err < t)
+                        c->next_err += sim_can_exp_ns(c, c->cfg.err_rate);
+                if (c->next_err < b->end) {
+                        b->error = true;
+                        b->end = max(c->next_err, t + bit) + SIM_CAN_ERR_FRAME_BITS * bit;
+                        c->next_err = b->end + sim_can_exp_ns(c, c->cfg.err_rate);
+                }
+        }
+        if (ours && c->cfg.busoff_ms && t >= c->next_busoff) {
+                b->error = true;
+                b->force_busoff = true;
+                b->end = t + (1 + SIM_CAN_ERR_FRAME_BITS) * bit;
+                c->next_busoff = t + (s64)c->cfg.busoff_ms * NSEC_PER_MSEC;
+        }
+
+        return t;
+}
+
+/* bring the model up to the current time */
+void sim_can_sync(struct sim_can *c)
+{
+        s64 now = sim_now();
+
+        for (;;) {
+                if (c->busy) {
+                        if (c->cur.end > now)
+                                break;
+                        sim_can_frame_done(c);
+                        continue;
+                }
+                if (c->recovery_end && c->recovery_end <= now) {
+                        c->bus_off = false;
+                        c->recovery_end = 0;
+                        c->txerr = 0;
+                        c->rxerr = 0;
+                        c->stats.recoveries++;
+                        sim_can_err_state(c, now);
+                        sim_can_raise(c, ERR_WRN);
+                        continue;
+                }
+                if (sim_can_arbitrate(c, now, true) > now)
+                        break;
+        }
+
+}
+
+s64 sim_can_next_event(struct sim_can *c)
+{
+        s64 next = KTIME_MAX;
+
+        sim_can_sync(c);
+        if (c->busy)
+                next = c->cur.end;
+        else
+                next = sim_can_arbitrate(c, sim_now(), false);
+        if (c->recovery_end && c->recovery_end < next)
+                next = c->recovery_end;
+
+        return next;
+}
+
+static u32 sim_can_int(struct sim_can *c)
+{
+        u32 v = c->intr;
+
+        if (c->fifo_count && (c->inten & RX_IRQ_EN))
+                v |= RBUF_VLD;
+
+        return v;
+}
+
+bool sim_can_irq_line(struct sim_can *c)
+{
+        sim_can_sync(c);
+        return sim_can_int(c) != 0;
+}
+
+static u32 sim_can_status(struct sim_can *c)
+{
+        u32 v = c->ecc;
+
+        if (c->fifo_count)
+                v |= RBUF_RDY;
+        if (c->data_orun)
+                v |= DATA_ORUN;
+        if (!c->tx_pending)
+                v |= TBUF_RDY;
+        if (c->tx_over)
+                v |= TRANS_OVER;
+        if (c->busy && !c->cur.ours)
+                v |= RCV_BUSY;
+        if (c->busy && c->cur.ours)
+                v |= TRANS_BUSY;
+        if (c->err_sta)
+                v |= ERR_STA;
+        if (c->bus_off)
+                v |= BUS_OFF;
+
+        return v;
+}
+
+static u32 sim_can_reg_read(struct sim_can *c, unsigned long off)
+{
+        struct sim_can_rx *rx;
+
+        switch (off) {
+        case SIM_CAN_MSEL:
+                return c->msel;
+        case SIM_CAN_CMD:
+                return 0;
+        case SIM_CAN_STA:
+                return sim_can_status(c);
+        case SIM_CAN_INT:
+                return sim_can_int(c);
+        case SIM_CAN_INTEN:
+                return c->inten;
+        case SIM_CAN_BTIME:
+                return c->btime;
+        case SIM_CAN_TEWL:
+                return c->tewl;
+        case SIM_CAN_ERRC:
+                return (min(c->rxerr, 255) << 16) | min(c->txerr, 255);
+        case SIM_CAN_RMCNT:
+                return c->fifo_count;
+        }
+
+        if (off >= SIM_CAN_BUF0 && off <= SIM_CAN_BUF12) {
+                if (c->msel & RESET_MODE) {
+                        if (off == SIM_CAN_ACPC)
+                                return c->acpc;
+                        if (off == SIM_CAN_ACPM)
+                                return c->acpm;
+                        return 0;
+                }
+                if (!c->fifo_count)
+                        return 0;
+                rx = &c->fifo[c->fifo_head];
+                return rx->win[(off - SIM_CAN_BUF0) / 4];
+        }
+
+        return 0;
+}
+
+static void sim_can_command(struct sim_can *c, u32 cmd, s64 now)
+{
+        if (cmd & (TRANS_REQ | SELF_RCV_REQ)) {
+                if (c->msel & RESET_MODE)
+                        sim_can_protocol_error(c, "transmission requested in reset mode");
+                else if (c->tx_pending)
+                        sim_can_protocol_error(c, "transmission requested with the TX buffer busy");
+                else {
+                        sim_can_decode(c->txbuf, &c->tx_frame);
+                        c->tx_pending = true;
+                        c->tx_self = cmd & SELF_RCV_REQ;
+                        c->tx_over = false;
+                        c->tx_ready = now;
+                }
+        }
+
+        /* only a frame not yet on the bus can be aborted */
+        if ((cmd & ABORT_REQ) && c->tx_pending && !(c->busy && c->cur.ours)) {
+                c->tx_pending = false;
+                c->stats.tx_aborted++;
+                sim_can_raise(c, TBUF_VLD);
+        }
+
+        if (cmd & RELEASE_RBUF) {
+                if (!c->fifo_count) {
+                        sim_can_protocol_error(c, "RX buffer released with the RX FIFO empty");
+                } else {
+                        c->fifo_bytes -= c->fifo[c->fifo_head].bytes;
+                        c->fifo_head = (c->fifo_head + 1) % SIM_CAN_FIFO_FRAMES;
+                        c->fifo_count--;
+                }
+        }
+
+        if (cmd & CLEAR_DOVERRUN)
+                c->data_orun = false;
+
+        if (cmd & BUS_OFF_REQ)
+                sim_can_recover(c, now);
+}
+
+static void sim_can_reg_write(struct sim_can *c, u32 val, unsigned long off)
+{
+        s64 now = sim_now();
+
+        switch (off) {
+        case SIM_CAN_MSEL:
+                if ((val & RESET_MODE) && !(c->msel & RESET_MODE))
+                        sim_can_enter_reset(c, now);
+                if (!(val & RESET_MODE) && (c->msel & RESET_MODE))
+                        sim_can_recover(c, now);
+                c->msel = val & 0x1F;
+                return;
+        case SIM_CAN_CMD:
+                sim_can_command(c, val, now);
+                return;
+        case SIM_CAN_INT:
+                c->intr &= ~(val & ~RBUF_VLD);
+                return;
+        case SIM_CAN_INTEN:
+                c->inten = val;
+                return;
+        case SIM_CAN_BTIME:
+                if (!(c->msel & RESET_MODE))
+                        sim_can_protocol_error(c, "SIM_CAN_BTIME written outside reset mode");
+                else
+                        c->btime = val;
+                return;
+        case SIM_CAN_TEWL:
+                c->tewl = val;
+                return;
+        case SIM_CAN_ERRC:
+                if (!(c->msel & RESET_MODE)) {
+                        sim_can_protocol_error(c, "SIM_CAN_ERRC written outside reset mode");
+                } else {
+                        c->txerr = val & 0xFF;
+                        c->rxerr = (val >> 16) & 0xFF;
+                        c->ecc = 0;
+                }
+                return;
+        }
+
+        if (off >= SIM_CAN_BUF0 && off <= SIM_CAN_BUF12) {
+                if (c->msel & RESET_MODE) {
+                        if (off == SIM_CAN_ACPC)
+                                c->acpc = val;
+                        else if (off == SIM_CAN_ACPM)
+                                c->acpm = val;
+                        else
+                                sim_can_protocol_error(c, "TX buffer written in reset mode");
+                        return;
+                }
+                if (c->tx_pending) {
+                        sim_can_protocol_error(c, "TX buffer written while it is busy");
+                        return;
+                }
+                c->txbuf[(off - SIM_CAN_BUF0) / 4] = val & 0xFF;
+        }
+}
+
+/* the window ioremap() returned, or the static mapping of the board's I/O area */
+static struct sim_can *sim_can_find(const volatile void *addr, unsigned long *off)
+{
+        unsigned long a = (unsigned long)addr;
+        int i;
+
+        for (i = 0; i < n_cans; i++) {
+                unsigned long base = (unsigned long)cans[i]->window;
+                unsigned long io = SIM_CAN_IO_VIRT + cans[i]->phys;
+
+                if (a >= base && a < base + SIM_CAN_WINDOW) {
+                        *off = a - base;
+                        return cans[i];
+                }
+                if (a >= io && a < io + SIM_CAN_WINDOW) {
+                        *off = a - io;
+                        return cans[i];
+                }
+        }
+
+        sim_warn("access to unmapped register %p", addr);
+        abort();
+}
+
+static u32 ccu[SIM_CCU_SIZE / 4];
+
+/* the CCU through the static mapping, NULL for anything else */
+static u32 *sim_ccu_reg(const volatile void *addr)
+{
+        unsigned long off = (unsigned long)addr - (SIM_CAN_IO_VIRT + SIM_CCU_PHYS);
+
+        return off < SIM_CCU_SIZE ? &ccu[off / 4] : NULL;
+}
+
+u32 sim_mmio_read(const volatile void __iomem *addr, bool relaxed)
+{
+        unsigned long off;
+        struct sim_can *c;
+        u32 *reg = sim_ccu_reg(addr);
+
+        if (reg) {
+                sim_advance(sim_costs.mmio_read_ns + (relaxed ? 0 : sim_costs.barrier_ns));
+                sim_mmio[sim_act()]++;
+                return *reg;
+        }
+        c = sim_can_find(addr, &off);
+
+        sim_advance(sim_costs.mmio_read_ns + (relaxed ? 0 : sim_costs.barrier_ns));
+        sim_mmio[sim_act()]++;
+        c->stats.mmio_reads++;
+        sim_can_sync(c);
+
+        return sim_can_reg_read(c, off);
+}
+
+void sim_mmio_write(u32 val, volatile void __iomem *addr, bool relaxed)
+{
+        unsigned long off;
+        struct sim_can *c;
+        u32 *reg = sim_ccu_reg(addr);
+
+        if (reg) {
+                sim_advance(sim_costs.mmio_write_ns + (relaxed ? 0 : sim_costs.barrier_ns));
+                sim_mmio[sim_act()]++;
+                *reg = val;
+                return;
+        }
+        c = sim_can_find(addr, &off);
+
+        sim_advance(sim_costs.mmio_write_ns + (relaxed ? 0 : sim_costs.barrier_ns));
+        sim_mmio[sim_act()]++;
+        c->stats.mmio_writes++;
+        sim_can_sync(c);
+        sim_can_reg_write(c, val, off);
+}
+
+struct sim_can *sim_can_create(unsigned long phys, unsigned int irq, const struct sim_can_cfg *cfg,
+                               struct sim_gen *gen)
+{
+        struct sim_can *c;
+
+        if (n_cans == SIM_CAN_MAX)
+                return NULL;
+        if (posix_memalign((void **)&c, SIM_CAN_WINDOW, sizeof(*c)))
+                return NULL;
+        memset(c, 0, sizeof(*c));
+
+        c->phys = phys;
+        c->irq = irq;
+        c->cfg = *cfg;
+        c->gen = gen;
+        c->rng = cfg->seed ? cfg->seed : 0x2545F491;
+        c->bus_free = sim_now();
+        c->next_err = sim_now();
+        c->next_busoff = sim_now() + (s64)cfg->busoff_ms * NSEC_PER_MSEC;
+
+        /* reset values, see sunxi_can.h */
+        c->msel = RESET_MODE;
+        c->acpm = 0xFFFFFFFF;
+        c->tewl = 96;
+
+        cans[n_cans++] = c;
+        return c;
+}
+
+void sim_can_destroy(struct sim_can *c)
+{
+        int i, j;
+
+        for (i = 0, j = 0; i < n_cans; i++)
+                if (cans[i] != c)
+                        cans[j++] = cans[i];
+        n_cans = j;
+        free(c);
+}
+
+void __iomem *sim_can_map(unsigned long phys, size_t size)
+{
+        int i;
+
+        for (i = 0; i < n_cans; i++) {
+                if (cans[i]->phys == phys && size <= SIM_CAN_WINDOW)
+                        return cans[i]->window;
+        }
+
+        return NULL;
+}
+
+unsigned int sim_can_irq(struct sim_can *c)
+{
+        return c->irq;
+}
+
+const struct sim_can_stats *sim_can_stats(struct sim_can *c)
+{
+        return &c->stats;
+}
+
+unsigned int sim_can_fifo_frames(struct sim_can *c)
+{
+        return c->fifo_count;
+}
+
+struct sim_can *sim_can_get(int i)
+{
+        return i < n_cans ? cans[i] : NULL;
+}
+
+void sim_can_set_bus_hook(void (*hook)(struct sim_can *c, const struct sim_frame *f, bool ours))
+{
+        bus_hook = hook;
+}
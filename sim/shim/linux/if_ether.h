@@ -0,0 +1,2 @@
+/* see sim_kernel.h */
+#include <sim_kernel.h>
@@ -0,0 +1,857 @@
+/*
+* sim_kernel.h - kernel API of the sunxi_can simulation
+*
+* Every <linux/...>, <asm/...>, <mach/...> and <plat/...> header the
+* driver includes resolves to this one. Types and inline helpers follow
+* the Linux 3.4 API closely enough for sunxi_can.c to build unchanged;
+* the out of line functions are in kernel.c, register accesses go to the
+* controller model in model.c.
+*/
+
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef u32 canid_t;
+typedef unsigned int gfp_t;
+typedef int irqreturn_t;
+typedef int netdev_tx_t;
+typedef u64 cycles_t;
+
+#define __init
+#define __exit
+#define __devinit
+#define __devexit
+#define __devexit_p(x) x
+#define __iomem
+#define __user
+#define __rcu
+#define __read_mostly
+#undef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#define ____cacheline_aligned
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define EXPORT_SYMBOL_GPL(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_ALIAS(x)
+#define MODULE_PARM_DESC(a, b)
+#define THIS_MODULE NULL
+
+/*
+* module parameters are registered by name before main() runs and are
+* set from the command line with --param name=value
+*/
+void sim_param_add(const char *name, const char *type, void *var);
+#define module_param(name, type, perm)                                          \
+static void __attribute__((constructor)) __sim_param_##name(void)              \
+{                                                                              \
+        sim_param_add(#name, #type, &name);                                    \
+}
+
+/* the simulation loads and unloads the "module" itself */
+#define module_init(fn) int sim_module_init(void) { return fn(); }
+#define module_exit(fn) void sim_module_exit(void) { fn(); }
+
+#define IRQ_NONE 0
+#define IRQ_HANDLED 1
+#define IRQ_WAKE_THREAD 2
+#define NETDEV_TX_OK 0
+#define NETDEV_TX_BUSY 0x10
+#define NET_XMIT_SUCCESS 0
+
+#define KERN_INFO ""
+#define KERN_ERR ""
+#define KERN_WARNING ""
+#define KERN_DEBUG ""
+
+#define GFP_ATOMIC 1
+#define GFP_KERNEL 2
+#define S_IRUGO 0444
+#define S_IWUSR 0200
+#define S_IRUSR 0400
+
+#define HZ 100
+#define INITIAL_JIFFIES ((unsigned long)(-300 * HZ))
+#define USEC_PER_SEC 1000000L
+#define MSEC_PER_SEC 1000L
+#define NSEC_PER_USEC 1000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_SEC 1000000000L
+#define PAGE_SIZE 4096
+
+#define EPERM 1
+#define ENOENT 2
+#define EINTR 4
+#define ENXIO 6
+#define E2BIG 7
+#define EAGAIN 11
+#define ENOMEM 12
+#define EFAULT 14
+#define EBUSY 16
+#define ENODEV 19
+#define EINVAL 22
+#define ENOSPC 28
+#define ERANGE 34
+#define EOPNOTSUPP 95
+#define ENETDOWN 100
+#define ETIMEDOUT 110
+
+#define BITS_PER_LONG (8 * (int)sizeof(long))
+#define BITS_TO_LONGS(n) (((n) + 8 * sizeof(long) - 1) / (8 * sizeof(long)))
+#define DIV_ROUND_UP(a, b) (((a) + (b) - 1) / (b))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define U32_MAX ((u32)~0U)
+#define KTIME_MAX ((s64)~((u64)1 << 63))
+
+#define min(a, b) ({ __typeof__(a) __a = (a); __typeof__(b) __b = (b); __a < __b ? __a : __b; })
+#define max(a, b) ({ __typeof__(a) __a = (a); __typeof__(b) __b = (b); __a > __b ? __a : __b; })
+#define min3(a, b, c) min(min(a, b), c)
+#define min_t(t, a, b) ({ t __a = (a); t __b = (b); __a < __b ? __a : __b; })
+#define max_t(t, a, b) ({ t __a = (a); t __b = (b); __a > __b ? __a : __b; })
+#define clamp_t(t, v, lo, hi) min_t(t, max_t(t, v, lo), hi)
+#define clamp(v, lo, hi) min(max(v, lo), hi)
+#define swap(a, b) do { __typeof__(a) __t = (a); (a) = (b); (b) = __t; } while (0)
+#define container_of(p, t, m) ((t *)((char *)(p) - offsetof(t, m)))
+#define ACCESS_ONCE(x) (*(volatile __typeof__(x) *)&(x))
+#define BUILD_BUG_ON(c) ((void)sizeof(char[1 - 2 * !!(c)]))
+#define __stringify_1(x) #x
+#define __stringify(x) __stringify_1(x)
+
+#define IS_ERR_VALUE(x) ((unsigned long)(x) >= (unsigned long)-4095)
+#define IS_ERR(p) IS_ERR_VALUE(p)
+#define PTR_ERR(p) ((long)(p))
+#define ERR_PTR(e) ((void *)(long)(e))
+#define IS_ERR_OR_NULL(p) (!(p) || IS_ERR(p))
+
+/* diagnostics, a WARN counts as a failure of the run */
+void sim_warn(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#define WARN_ON(c) ({ bool __c = !!(c); if (__c) sim_warn("WARN_ON(%s) at %s:%d", #c, __FILE__, __LINE__); __c; })
+#define WARN_ON_ONCE(c) WARN_ON(c)
+#define BUG_ON(c) do { if (c) { sim_warn("BUG_ON(%s) at %s:%d", #c, __FILE__, __LINE__); abort(); } } while (0)
+
+/* the simulation is single threaded, ordering only has to stop the compiler */
+#define barrier() __asm__ __volatile__("" ::: "memory")
+#define rmb() barrier()
+#define wmb() barrier()
+#define mb() barrier()
+#define smp_rmb() barrier()
+#define smp_wmb() barrier()
+#define smp_mb() barrier()
+#define cpu_relax() barrier()
+
+int printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#define pr_info(...) printk(__VA_ARGS__)
+#define pr_err(...) printk(__VA_ARGS__)
+#define pr_warn(...) printk(__VA_ARGS__)
+#define pr_debug(...) do { if (0) printk(__VA_ARGS__); } while (0)
+int net_ratelimit(void);
+
+/* bit operations */
+static inline int fls(unsigned int x)
+{
+        return x ? 32 - __builtin_clz(x) : 0;
+}
+#define ffs(x) __builtin_ffs(x)
+#define hweight8(x) __builtin_popcount((u8)(x))
+#define hweight32(x) __builtin_popcount((u32)(x))
+#define ilog2(x) (31 - __builtin_clz((u32)(x)))
+#define is_power_of_2(n) ((n) != 0 && (((n) & ((n) - 1)) == 0))
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+        unsigned long r = 1;
+
+        while (r < n)
+                r <<= 1;
+        return r;
+}
+
+#define BIT_WORD(nr) ((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr) (1UL << ((nr) % BITS_PER_LONG))
+static inline void set_bit(int nr, volatile unsigned long *p)
+{
+        p[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+static inline void clear_bit(int nr, volatile unsigned long *p)
+{
+        p[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+#define __set_bit set_bit
+#define __clear_bit clear_bit
+static inline int test_bit(int nr, const volatile unsigned long *p)
+{
+        return (p[BIT_WORD(nr)] & BIT_MASK(nr)) != 0;
+}
+static inline int test_and_set_bit(int nr, volatile unsigned long *p)
+{
+        int old = test_bit(nr, p);
+
+        set_bit(nr, p);
+        return old;
+}
+static inline int test_and_clear_bit(int nr, volatile unsigned long *p)
+{
+        int old = test_bit(nr, p);
+
+        clear_bit(nr, p);
+        return old;
+}
+static inline unsigned long find_first_zero_bit(const unsigned long *p, unsigned long size)
+{
+        unsigned long i;
+
+        for (i = 0; i < size; i++)
+                if (!test_bit(i, p))
+                        return i;
+        return size;
+}
+static inline void bitmap_zero(unsigned long *p, int bits)
+{
+        memset(p, 0, BITS_TO_LONGS(bits) * sizeof(long));
+}
+static inline void bitmap_set(unsigned long *p, int start, int n)
+{
+        while (n--)
+                set_bit(start++, p);
+}
+
+/* 64-bit arithmetic */
+static inline u64 div_u64(u64 a, u32 b)
+{
+        return a / b;
+}
+static inline s64 div_s64(s64 a, s32 b)
+{
+        return a / b;
+}
+static inline u64 div64_u64(u64 a, u64 b)
+{
+        return a / b;
+}
+#define do_div(n, b) ({ u32 __r = (n) % (b); (n) /= (b); __r; })
+
+#define GOLDEN_RATIO_PRIME_32 0x9e370001UL
+static inline u32 hash_32(u32 val, unsigned int bits)
+{
+        u32 hash = val * (u32)GOLDEN_RATIO_PRIME_32;
+
+        return hash >> (32 - bits);
+}
+
+/* strings and memory */
+int scnprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+char *skip_spaces(const char *s);
+char *strim(char *s);
+int kstrtouint(const char *s, unsigned int base, unsigned int *res);
+int kstrtoint(const char *s, unsigned int base, int *res);
+int kstrtoul(const char *s, unsigned int base, unsigned long *res);
+int kstrtou32(const char *s, unsigned int base, u32 *res);
+int strtobool(const char *s, bool *res);
+unsigned long simple_strtoul(const char *s, char **end, unsigned int base);
+char *kstrdup(const char *s, gfp_t gfp);
+char *kstrndup(const char *s, size_t n, gfp_t gfp);
+
+void *kmalloc(size_t size, gfp_t gfp);
+void *kzalloc(size_t size, gfp_t gfp);
+void *kcalloc(size_t n, size_t size, gfp_t gfp);
+void kfree(const void *p);
+void *vmalloc(size_t size);
+void *vzalloc(size_t size);
+void vfree(const void *p);
+void sort(void *base, size_t num, size_t size, int (*cmp)(const void *, const void *),
+          void (*swap_fn)(void *, void *, int));
+unsigned long copy_to_user(void __user *to, const void *from, unsigned long n);
+unsigned long copy_from_user(void *to, const void __user *from, unsigned long n);
+
+/* execution context, see kernel.c */
+int in_interrupt(void);
+int in_irq(void);
+void might_sleep(void);
+void cond_resched(void);
+
+/* atomics */
+typedef struct { int counter; } atomic_t;
+#define atomic_read(a) ((a)->counter)
+#define atomic_set(a, v) ((a)->counter = (v))
+#define atomic_inc(a) ((a)->counter++)
+#define atomic_dec(a) ((a)->counter--)
+#define xchg(p, v) ({ __typeof__(*(p)) __o = *(p); *(p) = (v); __o; })
+#define cmpxchg(p, o, n) ({ __typeof__(*(p)) __o = *(p); if (__o == (o)) *(p) = (n); __o; })
+
+/*
+* locks: nothing runs concurrently, but lock nesting is tracked so the
+* model can flag sleeping or RT-sleeping calls made under a raw lock
+*/
+typedef struct { int held; } spinlock_t;
+typedef struct { int held; } raw_spinlock_t;
+struct mutex { int held; };
+void sim_lock(int *held, bool raw);
+void sim_unlock(int *held, bool raw);
+#define spin_lock_init(l) ((l)->held = 0)
+#define spin_lock(l) sim_lock(&(l)->held, false)
+#define spin_unlock(l) sim_unlock(&(l)->held, false)
+#define spin_lock_bh(l) spin_lock(l)
+#define spin_unlock_bh(l) spin_unlock(l)
+#define spin_lock_irq(l) spin_lock(l)
+#define spin_unlock_irq(l) spin_unlock(l)
+#define spin_lock_irqsave(l, f) ((f) = 0, spin_lock(l))
+#define spin_unlock_irqrestore(l, f) ((void)(f), spin_unlock(l))
+#define raw_spin_lock_init(l) ((l)->held = 0)
+#define raw_spin_lock(l) sim_lock(&(l)->held, true)
+#define raw_spin_unlock(l) sim_unlock(&(l)->held, true)
+#define raw_spin_lock_irq(l) raw_spin_lock(l)
+#define raw_spin_unlock_irq(l) raw_spin_unlock(l)
+#define raw_spin_lock_irqsave(l, f) ((f) = 0, raw_spin_lock(l))
+#define raw_spin_unlock_irqrestore(l, f) ((void)(f), raw_spin_unlock(l))
+#define mutex_init(m) ((m)->held = 0)
+#define DEFINE_MUTEX(m) struct mutex m = { 0 }
+void mutex_lock(struct mutex *m);
+void mutex_unlock(struct mutex *m);
+int mutex_lock_interruptible(struct mutex *m);
+int mutex_trylock(struct mutex *m);
+#define local_irq_save(f) ((f) = 0)
+#define local_irq_restore(f) ((void)(f))
+#define local_irq_disable() do { } while (0)
+#define local_irq_enable() do { } while (0)
+void local_bh_disable(void);
+void local_bh_enable(void);
+
+/* rcu, readers and the single writer never overlap */
+struct rcu_head {
+        struct rcu_head *next;
+        void (*func)(struct rcu_head *);
+};
+#define rcu_read_lock() do { } while (0)
+#define rcu_read_unlock() do { } while (0)
+#define rcu_dereference(p) (p)
+#define rcu_dereference_protected(p, c) (p)
+#define rtnl_dereference(p) (p)
+#define rcu_access_pointer(p) (p)
+#define rcu_assign_pointer(p, v) ((p) = (v))
+#define RCU_INIT_POINTER(p, v) ((p) = (v))
+#define kfree_rcu(p, f) kfree(p)
+#define synchronize_rcu() do { } while (0)
+
+/* time, all of it virtual: MMIO and delays advance the clock */
+typedef s64 ktime_t;
+ktime_t ktime_get(void);
+#define ktime_sub(a, b) ((a) - (b))
+#define ktime_add_ns(a, n) ((a) + (n))
+#define ktime_to_ns(a) ((s64)(a))
+#define ktime_to_us(a) ((s64)(a) / 1000)
+#define ns_to_ktime(n) ((ktime_t)(n))
+#define ktime_set(s, n) ((ktime_t)((s64)(s) * NSEC_PER_SEC + (n)))
+#define ktime_us_delta(a, b) (((a) - (b)) / 1000)
+#define get_cycles() ((cycles_t)ktime_get())
+
+extern unsigned long jiffies;
+#define time_after(a, b) ((long)((b) - (a)) < 0)
+#define time_before(a, b) time_after(b, a)
+#define time_after_eq(a, b) ((long)((a) - (b)) >= 0)
+#define time_before_eq(a, b) time_after_eq(b, a)
+static inline unsigned long msecs_to_jiffies(unsigned int m)
+{
+        return DIV_ROUND_UP((unsigned long)m * HZ, MSEC_PER_SEC);
+}
+static inline unsigned long usecs_to_jiffies(unsigned int u)
+{
+        return DIV_ROUND_UP((unsigned long)u * HZ, USEC_PER_SEC);
+}
+static inline unsigned int jiffies_to_msecs(unsigned long j)
+{
+        return j * (MSEC_PER_SEC / HZ);
+}
+void udelay(unsigned long us);
+void ndelay(unsigned long ns);
+void mdelay(unsigned long ms);
+void msleep(unsigned int ms);
+void usleep_range(unsigned long min, unsigned long max);
+
+struct task_struct {
+        int pid;
+};
+extern struct task_struct *current;
+int signal_pending(struct task_struct *t);
+struct sched_param {
+        int sched_priority;
+};
+#define SCHED_FIFO 1
+#define MAX_USER_RT_PRIO 100
+int sched_setscheduler(struct task_struct *t, int policy, const struct sched_param *param);
+
+/* timers, run from the softirq of the event loop once jiffies passed expires */
+struct timer_list {
+        unsigned long expires;
+        void (*function)(unsigned long);
+        unsigned long data;
+        bool pending;
+};
+void init_timer(struct timer_list *t);
+void setup_timer(struct timer_list *t, void (*fn)(unsigned long), unsigned long data);
+int mod_timer(struct timer_list *t, unsigned long expires);
+int del_timer(struct timer_list *t);
+#define del_timer_sync(t) del_timer(t)
+#define timer_pending(t) ((t)->pending)
+
+enum hrtimer_restart { HRTIMER_NORESTART, HRTIMER_RESTART };
+enum hrtimer_mode { HRTIMER_MODE_ABS, HRTIMER_MODE_REL };
+#define CLOCK_MONOTONIC 1
+struct hrtimer {
+        enum hrtimer_restart (*function)(struct hrtimer *);
+        ktime_t expires;
+        bool active;
+};
+void hrtimer_init(struct hrtimer *t, int clock, enum hrtimer_mode mode);
+int hrtimer_start(struct hrtimer *t, ktime_t tim, enum hrtimer_mode mode);
+int hrtimer_cancel(struct hrtimer *t);
+#define hrtimer_try_to_cancel(t) hrtimer_cancel(t)
+u64 hrtimer_forward_now(struct hrtimer *t, ktime_t interval);
+#define hrtimer_active(t) ((t)->active)
+
+/* work, run by the event loop in process context */
+struct work_struct {
+        void (*func)(struct work_struct *);
+        bool pending;
+};
+void sim_init_work(struct work_struct *w, void (*fn)(struct work_struct *));
+#define INIT_WORK(w, f) sim_init_work(w, f)
+int schedule_work(struct work_struct *w);
+int cancel_work_sync(struct work_struct *w);
+
+/* register access, each one costs virtual time in the model */
+u32 sim_mmio_read(const volatile void __iomem *addr, bool relaxed);
+void sim_mmio_write(u32 val, volatile void __iomem *addr, bool relaxed);
+/* like __raw_readl() on ARM, the address may be a pointer or an integer */
+#define sim_iomem(a) ((volatile void __iomem *)(unsigned long)(a))
+#define readl(a) sim_mmio_read(sim_iomem(a), false)
+#define readl_relaxed(a) sim_mmio_read(sim_iomem(a), true)
+#define writel(v, a) sim_mmio_write(v, sim_iomem(a), false)
+#define writel_relaxed(v, a) sim_mmio_write(v, sim_iomem(a), true)
+
+/* driver model */
+struct kobject {
+        int unused;
+};
+struct device {
+        struct kobject kobj;
+        void *platform_data;
+        void *driver_data;
+        struct device *parent;
+        const char *init_name;
+};
+const char *dev_name(const struct device *dev);
+struct attribute {
+        const char *name;
+        unsigned short mode;
+};
+struct device_attribute {
+        struct attribute attr;
+        ssize_t (*show)(struct device *, struct device_attribute *, char *);
+        ssize_t (*store)(struct device *, struct device_attribute *, const char *, size_t);
+};
+#define DEVICE_ATTR(_name, _mode, _show, _store) \
+        struct device_attribute dev_attr_##_name = { { #_name, _mode }, _show, _store }
+struct attribute_group {
+        const char *name;
+        struct attribute **attrs;
+};
+#define dev_err(d, ...) printk(__VA_ARGS__)
+#define dev_warn(d, ...) printk(__VA_ARGS__)
+#define dev_info(d, ...) printk(__VA_ARGS__)
+
+struct resource {
+        unsigned long start;
+        unsigned long end;
+        const char *name;
+        unsigned long flags;
+};
+#define IORESOURCE_MEM 0x200
+#define IORESOURCE_IRQ 0x400
+#define resource_size(r) ((r)->end - (r)->start + 1)
+
+struct platform_device {
+        const char *name;
+        int id;
+        struct device dev;
+        unsigned int num_resources;
+        struct resource *resource;
+};
+struct device_driver {
+        const char *name;
+        void *owner;
+};
+struct platform_driver {
+        int (*probe)(struct platform_device *);
+        int (*remove)(struct platform_device *);
+        struct device_driver driver;
+};
+struct resource *platform_get_resource(struct platform_device *pdev, unsigned int type, unsigned int n);
+int platform_get_irq(struct platform_device *pdev, unsigned int n);
+#define platform_set_drvdata(pdev, data) ((pdev)->dev.driver_data = (data))
+#define platform_get_drvdata(pdev) ((pdev)->dev.driver_data)
+int platform_driver_register(struct platform_driver *drv);
+void platform_driver_unregister(struct platform_driver *drv);
+struct platform_device *platform_device_register_resndata(struct device *parent, const char *name,
+                                                          int id, const struct resource *res,
+                                                          unsigned int num, const void *data,
+                                                          size_t size);
+void platform_device_unregister(struct platform_device *pdev);
+void __iomem *devm_request_and_ioremap(struct device *dev, struct resource *res);
+
+struct clk;
+struct clk *clk_get(struct device *dev, const char *id);
+void clk_put(struct clk *clk);
+int clk_enable(struct clk *clk);
+void clk_disable(struct clk *clk);
+unsigned long clk_get_rate(struct clk *clk);
+
+/* debugfs, the files are reached through sim_debugfs_read()/sim_debugfs_write() */
+struct inode {
+        void *i_private;
+};
+struct file {
+        void *private_data;
+};
+struct seq_file {
+        void *private;
+        int (*show)(struct seq_file *, void *);
+        char *buf;
+        size_t size;
+        size_t count;
+};
+struct dentry;
+struct file_operations {
+        void *owner;
+        int (*open)(struct inode *, struct file *);
+        ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+        ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+        loff_t (*llseek)(struct file *, loff_t, int);
+        int (*release)(struct inode *, struct file *);
+};
+enum sim_debugfs_type {
+        SIM_DEBUGFS_FOPS,
+        SIM_DEBUGFS_U8,
+        SIM_DEBUGFS_U32,
+        SIM_DEBUGFS_X32,
+        SIM_DEBUGFS_BOOL,
+};
+struct dentry *sim_debugfs_create(const char *name, struct dentry *parent, void *data,
+                                  const struct file_operations *fops, enum sim_debugfs_type type);
+#define debugfs_create_dir(name, parent) sim_debugfs_create(name, parent, NULL, NULL, SIM_DEBUGFS_FOPS)
+#define debugfs_create_file(name, mode, parent, data, fops) \
+        sim_debugfs_create(name, parent, data, fops, SIM_DEBUGFS_FOPS)
+#define debugfs_create_u8(name, mode, parent, p) sim_debugfs_create(name, parent, p, NULL, SIM_DEBUGFS_U8)
+#define debugfs_create_u32(name, mode, parent, p) sim_debugfs_create(name, parent, p, NULL, SIM_DEBUGFS_U32)
+#define debugfs_create_x32(name, mode, parent, p) sim_debugfs_create(name, parent, p, NULL, SIM_DEBUGFS_X32)
+#define debugfs_create_bool(name, mode, parent, p) sim_debugfs_create(name, parent, p, NULL, SIM_DEBUGFS_BOOL)
+void debugfs_remove_recursive(struct dentry *d);
+int seq_printf(struct seq_file *m, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int seq_puts(struct seq_file *m, const char *s);
+ssize_t seq_read(struct file *f, char __user *buf, size_t size, loff_t *ppos);
+loff_t seq_lseek(struct file *f, loff_t off, int whence);
+int simple_open(struct inode *inode, struct file *f);
+int single_open(struct file *f, int (*show)(struct seq_file *, void *), void *data);
+int single_release(struct inode *inode, struct file *f);
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+                                const void *from, size_t available);
+loff_t default_llseek(struct file *f, loff_t off, int whence);
+
+/* network stack */
+struct net_device;
+struct sk_buff {
+        unsigned char *data;
+        unsigned int len;
+        unsigned int size;
+        struct net_device *dev;
+        u16 protocol;
+        u8 pkt_type;
+        u8 ip_summed;
+        void *sk;               /* sending socket, a marker in the simulation */
+        bool destructor;        /* socket accounting not released by skb_orphan() yet */
+        unsigned char buf[];
+};
+#define PACKET_BROADCAST 1
+#define PACKET_LOOPBACK 5
+#define CHECKSUM_UNNECESSARY 1
+#define ETH_P_CAN 0x000C
+#define htons(x) ((u16)(x))
+struct sk_buff *alloc_skb(unsigned int size, gfp_t gfp);
+struct sk_buff *__netdev_alloc_skb(struct net_device *dev, unsigned int size, gfp_t gfp);
+unsigned char *skb_put(struct sk_buff *skb, unsigned int len);
+void kfree_skb(struct sk_buff *skb);
+#define dev_kfree_skb(s) kfree_skb(s)
+#define dev_kfree_skb_any(s) kfree_skb(s)
+#define dev_kfree_skb_irq(s) kfree_skb(s)
+#define consume_skb(s) kfree_skb(s)
+
+struct net_device_stats {
+        unsigned long rx_packets;
+        unsigned long tx_packets;
+        unsigned long rx_bytes;
+        unsigned long tx_bytes;
+        unsigned long rx_errors;
+        unsigned long tx_errors;
+        unsigned long rx_dropped;
+        unsigned long tx_dropped;
+        unsigned long rx_over_errors;
+        unsigned long rx_fifo_errors;
+        unsigned long tx_aborted_errors;
+};
+
+#define NAPI_STATE_SCHED 0
+#define NAPI_STATE_DISABLE 1
+struct napi_struct {
+        int (*poll)(struct napi_struct *, int);
+        int weight;
+        unsigned long state;
+        struct net_device *dev;
+        bool sim_listed;        /* on the poll list */
+        bool sim_completed;     /* napi_complete() called during the poll */
+        s64 sim_due;            /* the poll runs from then on */
+        unsigned long sim_scheduled;    /* polls scheduled since the start */
+};
+
+struct ethtool_stats {
+        u32 cmd;
+        u32 n_stats;
+};
+#define ETH_SS_STATS 1
+#define ETH_GSTRING_LEN 32
+struct ethtool_ops {
+        int (*get_sset_count)(struct net_device *, int);
+        void (*get_strings)(struct net_device *, u32, u8 *);
+        void (*get_ethtool_stats)(struct net_device *, struct ethtool_stats *, u64 *);
+};
+struct net_device_ops {
+        int (*ndo_open)(struct net_device *);
+        int (*ndo_stop)(struct net_device *);
+        netdev_tx_t (*ndo_start_xmit)(struct sk_buff *, struct net_device *);
+};
+#define IFF_UP 0x1
+#define IFF_ECHO 0x40000
+struct net_device {
+        char name[16];
+        unsigned long base_addr;
+        int irq;
+        unsigned int flags;
+        struct net_device_stats stats;
+        const struct net_device_ops *netdev_ops;
+        const struct ethtool_ops *ethtool_ops;
+        struct device dev;
+        const struct attribute_group *sysfs_groups[4];
+        bool queue_stopped;
+        bool carrier;
+        bool running;
+        unsigned int priv_offset;
+        size_t sim_size;        /* allocation, netdev_priv() included */
+};
+#define SET_NETDEV_DEV(n, d) ((n)->dev.parent = (d))
+#define to_net_dev(d) container_of(d, struct net_device, dev)
+static inline void *netdev_priv(const struct net_device *dev)
+{
+        return (char *)dev + dev->priv_offset;
+}
+int netif_rx(struct sk_buff *skb);
+int netif_receive_skb(struct sk_buff *skb);
+#define netif_rx_ni(s) netif_rx(s)
+#define netif_start_queue(d) ((d)->queue_stopped = false)
+#define netif_stop_queue(d) ((d)->queue_stopped = true)
+#define netif_wake_queue(d) ((d)->queue_stopped = false)
+#define netif_queue_stopped(d) ((d)->queue_stopped)
+#define netif_running(d) ((d)->running)
+#define netif_carrier_on(d) ((d)->carrier = true)
+#define netif_carrier_off(d) ((d)->carrier = false)
+#define netif_tx_lock_bh(d) local_bh_disable()
+#define netif_tx_unlock_bh(d) local_bh_enable()
+int dev_queue_xmit(struct sk_buff *skb);
+void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
+                    int (*poll)(struct napi_struct *, int), int weight);
+void netif_napi_del(struct napi_struct *napi);
+void napi_enable(struct napi_struct *napi);
+void napi_disable(struct napi_struct *napi);
+int napi_schedule_prep(struct napi_struct *napi);
+void __napi_schedule(struct napi_struct *napi);
+void napi_complete(struct napi_struct *napi);
+static inline void napi_schedule(struct napi_struct *napi)
+{
+        if (napi_schedule_prep(napi))
+                __napi_schedule(napi);
+}
+#define netdev_err(d, ...) printk(__VA_ARGS__)
+#define netdev_warn(d, ...) printk(__VA_ARGS__)
+#define netdev_info(d, ...) printk(__VA_ARGS__)
+#define netdev_dbg(d, ...) do { if (0) printk(__VA_ARGS__); } while (0)
+#define rtnl_lock() do { } while (0)
+#define rtnl_unlock() do { } while (0)
+#define rtnl_trylock() 1
+#define restart_syscall() (-EINTR)
+
+/* interrupts */
+typedef irqreturn_t (*irq_handler_t)(int, void *);
+#define IRQF_SHARED 0x80
+#define IRQF_ONESHOT 0x2000
+#define IRQF_NO_THREAD 0x10000
+int request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags,
+                const char *name, void *dev_id);
+int request_threaded_irq(unsigned int irq, irq_handler_t handler, irq_handler_t thread_fn,
+                         unsigned long flags, const char *name, void *dev_id);
+void free_irq(unsigned int irq, void *dev_id);
+void disable_irq(unsigned int irq);
+void enable_irq(unsigned int irq);
+#define synchronize_irq(irq) do { } while (0)
+
+/* SocketCAN */
+#define CAN_EFF_FLAG 0x80000000U
+#define CAN_RTR_FLAG 0x40000000U
+#define CAN_ERR_FLAG 0x20000000U
+#define CAN_SFF_MASK 0x000007FFU
+#define CAN_EFF_MASK 0x1FFFFFFFU
+#define CAN_ERR_MASK 0x1FFFFFFFU
+#define CAN_SFF_ID_BITS 11
+#define CAN_EFF_ID_BITS 29
+struct can_frame {
+        canid_t can_id;
+        u8 can_dlc;
+        u8 __pad;
+        u8 __res0;
+        u8 __res1;
+        u8 data[8] __attribute__((aligned(8)));
+};
+#define CAN_ERR_DLC 8
+#define CAN_ERR_TX_TIMEOUT 0x00000001U
+#define CAN_ERR_LOSTARB 0x00000002U
+#define CAN_ERR_CRTL 0x00000004U
+#define CAN_ERR_PROT 0x00000008U
+#define CAN_ERR_TRX 0x00000010U
+#define CAN_ERR_ACK 0x00000020U
+#define CAN_ERR_BUSOFF 0x00000040U
+#define CAN_ERR_BUSERROR 0x00000080U
+#define CAN_ERR_RESTARTED 0x00000100U
+#define CAN_ERR_CRTL_UNSPEC 0x00
+#define CAN_ERR_CRTL_RX_OVERFLOW 0x01
+#define CAN_ERR_CRTL_TX_OVERFLOW 0x02
+#define CAN_ERR_CRTL_RX_WARNING 0x04
+#define CAN_ERR_CRTL_TX_WARNING 0x08
+#define CAN_ERR_CRTL_RX_PASSIVE 0x10
+#define CAN_ERR_CRTL_TX_PASSIVE 0x20
+#define CAN_ERR_PROT_UNSPEC 0x00
+#define CAN_ERR_PROT_BIT 0x01
+#define CAN_ERR_PROT_FORM 0x02
+#define CAN_ERR_PROT_STUFF 0x04
+#define CAN_ERR_PROT_OVERLOAD 0x20
+#define CAN_ERR_PROT_ACTIVE 0x40
+#define CAN_ERR_PROT_TX 0x80
+
+enum can_state {
+        CAN_STATE_ERROR_ACTIVE = 0,
+        CAN_STATE_ERROR_WARNING,
+        CAN_STATE_ERROR_PASSIVE,
+        CAN_STATE_BUS_OFF,
+        CAN_STATE_STOPPED,
+        CAN_STATE_SLEEPING,
+};
+enum can_mode {
+        CAN_MODE_STOP = 0,
+        CAN_MODE_START,
+        CAN_MODE_SLEEP,
+};
+#define CAN_CTRLMODE_LOOPBACK 0x01
+#define CAN_CTRLMODE_LISTENONLY 0x02
+#define CAN_CTRLMODE_3_SAMPLES 0x04
+#define CAN_CTRLMODE_ONE_SHOT 0x08
+#define CAN_CTRLMODE_BERR_REPORTING 0x10
+struct can_bittiming {
+        u32 bitrate;
+        u32 sample_point;
+        u32 tq;
+        u32 prop_seg;
+        u32 phase_seg1;
+        u32 phase_seg2;
+        u32 sjw;
+        u32 brp;
+};
+struct can_bittiming_const {
+        char name[16];
+        u32 tseg1_min;
+        u32 tseg1_max;
+        u32 tseg2_min;
+        u32 tseg2_max;
+        u32 sjw_max;
+        u32 brp_min;
+        u32 brp_max;
+        u32 brp_inc;
+};
+struct can_clock {
+        u32 freq;
+};
+struct can_berr_counter {
+        u16 txerr;
+        u16 rxerr;
+};
+struct can_device_stats {
+        u32 bus_error;
+        u32 error_warning;
+        u32 error_passive;
+        u32 bus_off;
+        u32 arbitration_lost;
+        u32 restarts;
+};
+struct can_priv {
+        struct can_device_stats can_stats;
+        struct can_bittiming bittiming;
+        const struct can_bittiming_const *bittiming_const;
+        struct can_clock clock;
+        enum can_state state;
+        u32 ctrlmode;
+        u32 ctrlmode_supported;
+        int restart_ms;
+        struct timer_list restart_timer;
+        int (*do_set_bittiming)(struct net_device *dev);
+        int (*do_set_mode)(struct net_device *dev, enum can_mode mode);
+        int (*do_get_berr_counter)(const struct net_device *dev, struct can_berr_counter *bec);
+        unsigned int echo_skb_max;
+        struct sk_buff **echo_skb;
+};
+struct net_device *alloc_candev(int sizeof_priv, unsigned int echo_skb_max);
+void free_candev(struct net_device *dev);
+int register_candev(struct net_device *dev);
+void unregister_candev(struct net_device *dev);
+int open_candev(struct net_device *dev);
+void close_candev(struct net_device *dev);
+void can_bus_off(struct net_device *dev);
+void can_put_echo_skb(struct sk_buff *skb, struct net_device *dev, unsigned int idx);
+unsigned int can_get_echo_skb(struct net_device *dev, unsigned int idx);
+void can_free_echo_skb(struct net_device *dev, unsigned int idx);
+struct sk_buff *alloc_can_skb(struct net_device *dev, struct can_frame **cf);
+struct sk_buff *alloc_can_err_skb(struct net_device *dev, struct can_frame **cf);
+int can_dropped_invalid_skb(struct net_device *dev, struct sk_buff *skb);
+static inline u8 get_can_dlc(u8 dlc)
+{
+        return dlc > 8 ? 8 : dlc;
+}
+
+/* sunxi platform: script.bin and the pin controller */
+#define SW_INT_IRQNO_CAN 58
+int gpio_request_ex(char *main_name, const char *sub_name);
+int script_parser_fetch(char *main_name, char *sub_name, int value[], int count);
+
+#endif
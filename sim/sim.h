@@ -0,0 +1,145 @@
+/*
+* sim.h - internals of the sunxi_can simulation shared by kernel.c,
+* model.c, gen.c and main.c
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <sim_kernel.h>
+
+/* activities the virtual and host time is accounted to */
+enum sim_act {
+        SIM_ACT_IDLE,
+        SIM_ACT_IRQ,            /* hard interrupt handler */
+        SIM_ACT_THREAD,         /* IRQ thread */
+        SIM_ACT_HRTIMER,
+        SIM_ACT_SOFTIRQ,        /* timers and NAPI polls */
+        SIM_ACT_WORK,
+        SIM_ACT_XMIT,           /* start_xmit from the traffic generator */
+        SIM_ACT_CTRL,           /* open, close and other process context calls */
+        SIM_ACT_NR,
+};
+
+struct sim_costs {
+        s64 mmio_read_ns;       /* relaxed register read */
+        s64 mmio_write_ns;      /* relaxed register write */
+        s64 barrier_ns;         /* the barrier of readl()/writel() */
+        s64 irq_ns;             /* interrupt entry and exit */
+        s64 softirq_ns;         /* one softirq round, timer or NAPI poll */
+        s64 softirq_delay_ns;   /* a scheduled NAPI poll waits this long, ksoftirqd under load */
+        s64 stack_ns;           /* one frame handed to the stack */
+        s64 xmit_ns;            /* one frame from the socket down to start_xmit */
+};
+
+/* kernel.c */
+extern struct sim_costs sim_costs;
+extern bool sim_verbose;
+extern unsigned long sim_clk_rate;     /* rate of every clock the driver asks for */
+extern unsigned long sim_warnings;
+extern unsigned long sim_skbs;          /* skbs allocated and not freed */
+extern s64 sim_act_ns[SIM_ACT_NR];      /* virtual time per activity */
+extern u64 sim_host_ns[SIM_ACT_NR];     /* host time per activity */
+extern u64 sim_mmio[SIM_ACT_NR];        /* register accesses per activity */
+s64 sim_now(void);
+void sim_advance(s64 ns);
+void sim_set_time(s64 ns);
+enum sim_act sim_act(void);
+enum sim_act sim_act_enter(enum sim_act act);
+void sim_act_exit(enum sim_act saved);
+int sim_param_set(const char *arg);
+long long sim_param(const char *name);
+void sim_params_list(FILE *f);
+bool sim_run_irq(unsigned int irq, bool line);
+bool sim_run_irq_threads(void);
+bool sim_run_hrtimers(void);
+bool sim_run_softirq(void);
+bool sim_run_work(void);
+s64 sim_next_timer_ns(void);
+extern void (*sim_sleep_hook)(s64 until);
+struct net_device *sim_netdev(int i);
+netdev_tx_t sim_xmit(struct net_device *dev, struct sk_buff *skb);
+ssize_t sim_sysfs_show(struct net_device *dev, const char *name, char *buf);
+ssize_t sim_sysfs_store(struct net_device *dev, const char *name, const char *buf);
+ssize_t sim_debugfs_read(const char *path, char *buf, size_t size);
+ssize_t sim_debugfs_write(const char *path, const char *buf);
+
+/* main.c, the protocol stack above the driver */
+void sim_stack_rx(struct sk_buff *skb);
+
+/* a frame on the bus */
+struct sim_frame {
+        canid_t id;             /* CAN_EFF_FLAG / CAN_RTR_FLAG as in struct can_frame */
+        u8 dlc;
+        u8 data[8];
+};
+
+/* gen.c, frames other nodes put on the bus */
+struct sim_gen {
+        unsigned int load;      /* percent of the bus time */
+        unsigned int ids;       /* distinct identifiers */
+        int dlc;                /* data length, < 0 for random */
+        unsigned int eff_pct;   /* share of EFF frames */
+        u32 rng;
+        s64 next_ns;            /* the next new frame is ready to be sent */
+        struct sim_frame next;
+        s64 bit_ns;
+        canid_t id[64];
+        u32 seq[64];
+        struct sim_frame retry; /* frame destroyed by an error, sent again first */
+        bool has_retry;
+        s64 retry_ns;
+        unsigned long offered;
+};
+void sim_gen_init(struct sim_gen *g, u32 seed, s64 start_ns);
+bool sim_gen_peek(struct sim_gen *g, s64 *ready, struct sim_frame *f);
+void sim_gen_pop(struct sim_gen *g);
+void sim_gen_retry(struct sim_gen *g, const struct sim_frame *f, s64 ready);
+u32 sim_rand(u32 *state);
+unsigned int sim_frame_bits(const struct sim_frame *f);
+void sim_frame_stamp(struct sim_frame *f, u32 seq);
+int sim_frame_check(const struct sim_frame *f, u32 *seq);
+
+/* model.c, the controller and its bus */
+struct sim_can_stats {
+        unsigned long mmio_reads;
+        unsigned long mmio_writes;
+        unsigned long bus_frames;       /* frames of other nodes completed on the bus */
+        unsigned long rx_fifo;          /* frames stored in the RX FIFO */
+        unsigned long rx_filtered;      /* frames rejected by the acceptance filter */
+        unsigned long rx_overruns;      /* frames lost to a full RX FIFO */
+        unsigned long rx_not_listening; /* frames sent while in reset mode or bus-off */
+        unsigned long rx_reset_flushed; /* frames dropped from the RX FIFO by a reset */
+        unsigned long tx_frames;        /* our frames completed on the bus */
+        unsigned long tx_aborted;       /* TX requests aborted by ABORT_REQ */
+        unsigned long tx_reset_aborted; /* TX requests cancelled by reset mode or bus-off */
+        unsigned long tx_arb_lost;
+        unsigned long tx_retries;       /* our frames destroyed by a bus error */
+        unsigned long bus_errors;
+        unsigned long bus_offs;
+        unsigned long recoveries;
+        unsigned long irq_raised[8];    /* INT bits raised */
+        unsigned long protocol_errors;  /* register use the hardware does not allow */
+};
+struct sim_can_cfg {
+        unsigned long clock;            /* bit timing clock in Hz */
+        unsigned int err_rate;          /* bus errors per second */
+        unsigned int busoff_ms;         /* force bus-off this often, 0 never */
+        u32 seed;
+};
+struct sim_can;
+struct sim_can *sim_can_create(unsigned long phys, unsigned int irq, const struct sim_can_cfg *cfg,
+                               struct sim_gen *gen);
+void sim_can_destroy(struct sim_can *c);
+void __iomem *sim_can_map(unsigned long phys, size_t size);
+void sim_can_sync(struct sim_can *c);
+bool sim_can_irq_line(struct sim_can *c);
+unsigned int sim_can_irq(struct sim_can *c);
+s64 sim_can_next_event(struct sim_can *c);
+s64 sim_can_bit_ns(struct sim_can *c);
+const struct sim_can_stats *sim_can_stats(struct sim_can *c);
+unsigned int sim_can_fifo_frames(struct sim_can *c);
+struct sim_can *sim_can_get(int i);
+void sim_can_set_bus_hook(void (*hook)(struct sim_can *c, const struct sim_frame *f, bool ours));
+
+#endif
@@ -27,6 +27,15 @@
 #include <linux/skbuff.h>
 #include <linux/delay.h>
 #include <linux/clk.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/rtnetlink.h>
+#include <linux/sort.h>
+#include <linux/debugfs.h>
+#include <linux/ethtool.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/seq_file.h>
 
 #include <linux/can/dev.h>
 #include <linux/can/error.h>
@@ -42,7 +51,71 @@ MODULE_AUTHOR("Peter Chen <xingkongcp@gmail.com>");
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_DESCRIPTION(DRV_NAME "CAN netdevice driver");
 
-static struct net_device *sunxican_dev;
+static unsigned int tx_ring_len = 16;
+module_param(tx_ring_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tx_ring_len, "Frames queued in the driver while the TX buffer is busy, applied on open (default: 16)");
+
+static unsigned int tx_abort_gap;
+module_param(tx_abort_gap, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tx_abort_gap, "Abort the frame in the TX buffer for one this many priority classes higher, aborts cost a retransmission, 0 disables (default: 0)");
+
+static bool use_napi = true;
+module_param(use_napi, bool, S_IRUGO);
+MODULE_PARM_DESC(use_napi, "Receive frames from NAPI poll instead of the ISR, 0 also disables hrtimer polling and rx_ring_len (default: 1)");
+
+static bool threaded_irq;
+module_param(threaded_irq, bool, S_IRUGO);
+MODULE_PARM_DESC(threaded_irq, "Handle interrupts in an IRQ thread, the hard handler only wakes it (default: 0)");
+
+static int irq_thread_prio = MAX_USER_RT_PRIO / 2;
+module_param(irq_thread_prio, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(irq_thread_prio, "SCHED_FIFO priority of the IRQ thread in threaded_irq mode (default: 50)");
+
+static unsigned int hrpoll_irq_rate = 5000;
+module_param(hrpoll_irq_rate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(hrpoll_irq_rate, "RX interrupts per second above which the RX FIFO is polled from an hrtimer, 0 disables, needs use_napi (default: 5000)");
+
+static unsigned int hrpoll_period_us;
+module_param(hrpoll_period_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(hrpoll_period_us, "RX poll period, 0 sizes it from the bitrate so the RX FIFO cannot overflow (default: 0)");
+
+static unsigned int rx_ring_len;
+module_param(rx_ring_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_ring_len, "Frames the ISR copies into a ring for the NAPI poll, rounded up to a power of 2, 0 disables, applied on open, needs use_napi (default: 0)");
+
+static unsigned int skb_pool_size = 32;
+module_param(skb_pool_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(skb_pool_size, "Preallocated skbs for RX and error frames, 0 disables, applied on open (default: 32)");
+
+static unsigned int err_coalesce_ms = 100;
+module_param(err_coalesce_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(err_coalesce_ms, "Send at most one error frame per interval, state changes are sent at once, 0 sends every event (default: 100)");
+
+static unsigned int berr_storm_rate = 2000;
+module_param(berr_storm_rate, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(berr_storm_rate, "Bus error interrupts per second that throttle them, 0 disables (default: 2000)");
+
+static unsigned int berr_backoff_ms = 100;
+module_param(berr_backoff_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(berr_backoff_ms, "First bus error interrupt throttle time, doubled for every storm that follows right after re-enabling (default: 100)");
+
+static bool busoff_fast_recovery = true;
+module_param(busoff_fast_recovery, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(busoff_fast_recovery, "With restart-ms set, recover from bus-off in the driver instead of restarting the controller (default: 1)");
+
+static bool shadow_check;
+module_param(shadow_check, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(shadow_check, "Compare the register shadows with the hardware on every interrupt (debug, default: 0)");
+
+static bool id_stats;
+module_param(id_stats, bool, S_IRUGO);
+MODULE_PARM_DESC(id_stats, "Keep per-identifier receive statistics in debugfs (default: 0)");
+
+static bool rx_fast_decode = true;
+module_param(rx_fast_decode, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_fast_decode, "Fetch the RX frame window with relaxed reads and one barrier (default: 1)");
+
+static struct dentry *sunxi_can_debugfs;
 static struct can_bittiming_const sunxi_can_bittiming_const = {
         .name = DRV_NAME,
         .tseg1_min = 1,
@@ -63,14 +136,42 @@ static void sunxi_can_write_cmdreg(struct sunxi_can_priv *priv, u8 val)
          * The command register needs some locking and time to settle
          * the write_reg() operation - especially on SMP systems.
          */
-        spin_lock_irqsave(&priv->cmdreg_lock, flags);
-        writel(val, CAN_CMD_ADDR);
-        spin_unlock_irqrestore(&priv->cmdreg_lock, flags);
+        raw_spin_lock_irqsave(&priv->cmdreg_lock, flags);
+        sunxi_can_write(priv, val, CAN_CMD_ADDR);
+        raw_spin_unlock_irqrestore(&priv->cmdreg_lock, flags);
+}
+
+/*
+* CAN_INTEN_ADDR is only written from priv->inten, so masking and
+* unmasking a source costs a single write
+*/
+static void sunxi_can_update_inten(struct sunxi_can_priv *priv, u32 clear, u32 set)
+{
+        unsigned long flags;
+
+        /* the ISR and the NAPI poll both toggle bits in CAN_INTEN_ADDR */
+        raw_spin_lock_irqsave(&priv->inten_lock, flags);
+        priv->inten = (priv->inten & ~clear) | set;
+        sunxi_can_write(priv, priv->inten, CAN_INTEN_ADDR);
+        raw_spin_unlock_irqrestore(&priv->inten_lock, flags);
+}
+
+/* register read on the RX path, counted to show the MMIO cost per frame */
+static inline u32 sunxi_can_rx_readl(struct sunxi_can_priv *priv, unsigned long addr)
+{
+        priv->xstats.rx_mmio_reads++;
+        return sunxi_can_read(priv, addr);
+}
+
+/* frames sent are received back, either by ctrlmode or for a benchmark run */
+static inline bool sunxi_can_loopback(struct sunxi_can_priv *priv)
+{
+        return (priv->can.ctrlmode & CAN_CTRLMODE_LOOPBACK) || priv->bench.active;
 }
 
 static int sunxi_can_is_absent(struct sunxi_can_priv *priv)
 {
-        return ((readl(CAN_MSEL_ADDR) & 0xFF) == 0xFF);
+        return ((sunxi_can_read(priv, CAN_MSEL_ADDR) & 0xFF) == 0xFF);
 }
 
 static int sunxi_can_probe(struct net_device *dev)
@@ -85,91 +186,493 @@ static int sunxi_can_probe(struct net_device *dev)
         return -1;
 }
 
-static void set_reset_mode(struct net_device *dev)
+/*
+* priv->msel shadows CAN_MSEL_ADDR, so mode bits are changed without
+* reading the register back. The controller itself only ever sets
+* RESET_MODE (on bus-off), so a shadow with RESET_MODE set is always
+* right, and a shadow without it at worst misses a reset the next
+* set_normal_mode() undoes anyway.
+*/
+static void sunxi_can_update_msel(struct sunxi_can_priv *priv, u32 clear, u32 set)
+{
+        unsigned long flags;
+
+        raw_spin_lock_irqsave(&priv->msel_lock, flags);
+        priv->msel = (priv->msel & ~clear) | set;
+        sunxi_can_write(priv, priv->msel, CAN_MSEL_ADDR);
+        raw_spin_unlock_irqrestore(&priv->msel_lock, flags);
+}
+
+/* load the register shadows from the hardware, once at init */
+static void sunxi_can_sync_shadows(struct sunxi_can_priv *priv)
+{
+        priv->msel = sunxi_can_read(priv, CAN_MSEL_ADDR);
+        priv->inten = sunxi_can_read(priv, CAN_INTEN_ADDR);
+        priv->btime = sunxi_can_read(priv, CAN_BTIME_ADDR);
+}
+
+/*
+* debug check of the register shadows against the hardware, enabled by
+* shadow_check; RESET_MODE set by the controller on bus-off is not drift
+*/
+static void sunxi_can_check_shadows(struct net_device *dev)
 {
         struct sunxi_can_priv *priv = netdev_priv(dev);
-        uint32_t status = readl(CAN_MSEL_ADDR);
-        int i;
+        unsigned long flags;
+        u32 hw;
+
+        raw_spin_lock_irqsave(&priv->msel_lock, flags);
+        hw = sunxi_can_read(priv, CAN_MSEL_ADDR);
+        if ((hw | RESET_MODE) != (priv->msel | RESET_MODE) ||
+            ((priv->msel & RESET_MODE) && !(hw & RESET_MODE))) {
+                priv->xstats.shadow_drift++;
+                if (net_ratelimit())
+                        netdev_warn(dev, "MSEL 0x%08x, shadow 0x%08x\n", hw, priv->msel);
+        }
+        raw_spin_unlock_irqrestore(&priv->msel_lock, flags);
+
+        raw_spin_lock_irqsave(&priv->inten_lock, flags);
+        hw = sunxi_can_read(priv, CAN_INTEN_ADDR);
+        if (hw != priv->inten) {
+                priv->xstats.shadow_drift++;
+                if (net_ratelimit())
+                        netdev_warn(dev, "INTEN 0x%08x, shadow 0x%08x\n", hw, priv->inten);
+        }
+        raw_spin_unlock_irqrestore(&priv->inten_lock, flags);
+
+        /* only written under rtnl in reset mode */
+        hw = sunxi_can_read(priv, CAN_BTIME_ADDR);
+        if (hw != priv->btime) {
+                priv->xstats.shadow_drift++;
+                if (net_ratelimit())
+                        netdev_warn(dev, "BTIME 0x%08x, shadow 0x%08x\n", hw, priv->btime);
+        }
+}
+
+/*
+* wait for the controller to enter (reset) or leave reset mode
+* sleepable callers poll every 10-20us for up to SUNXI_CAN_MODE_TIMEOUT_US,
+* atomic ones (the restart timer) spin for up to SUNXI_CAN_MODE_SPIN_US;
+* the time taken is recorded for the mode_switch sysfs attribute
+*/
+static int sunxi_can_mode_wait(struct net_device *dev, bool reset, bool can_sleep)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        s64 limit = (can_sleep ? SUNXI_CAN_MODE_TIMEOUT_US : SUNXI_CAN_MODE_SPIN_US) * NSEC_PER_USEC;
+        s64 start = ktime_to_ns(ktime_get());
+        s64 ns;
+
+        for (;;) {
+                bool in_reset = sunxi_can_read(priv, CAN_MSEL_ADDR) & RESET_MODE;
+
+                ns = ktime_to_ns(ktime_get()) - start;
+                if (in_reset == reset)
+                        break;
+                if (ns >= limit) {
+                        priv->xstats.mode_timeouts++;
+                        return -ETIMEDOUT;
+                }
+                if (can_sleep)
+                        usleep_range(10, 20);
+                else
+                        udelay(1);
+        }
+
+        if (!priv->xstats.mode_switches || ns < priv->mode_min_ns)
+                priv->mode_min_ns = ns;
+        if (ns > priv->mode_max_ns)
+                priv->mode_max_ns = ns;
+        priv->mode_total_ns += ns;
+        priv->xstats.mode_switches++;
 
-        for (i = 0; i < 100; i++) {
-                /* check reset bit */
-                if (status & RESET_MODE) {
-                        priv->can.state = CAN_STATE_STOPPED;
+        return 0;
+}
+
+static void set_reset_mode(struct net_device *dev, bool can_sleep)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        if (!(priv->msel & RESET_MODE)) {
+                sunxi_can_update_msel(priv, 0, RESET_MODE);        /* select reset mode */
+                if (sunxi_can_mode_wait(dev, true, can_sleep)) {
+                        netdev_err(dev, "setting SUNXI_CAN into reset mode failed!\n");
                         return;
                 }
+        }
+
+        priv->can.state = CAN_STATE_STOPPED;
+}
+
+static void set_normal_mode(struct net_device *dev, bool can_sleep)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        u32 inten;
 
-                writel(readl(CAN_MSEL_ADDR) | RESET_MODE, CAN_MSEL_ADDR);        /* select reset mode */
-                //writel(RESET_MODE, CAN_MSEL_ADDR);        /* select reset mode */
-                udelay(10);
-                status = readl(CAN_MSEL_ADDR);
+        /* set chip to normal mode, also after a bus-off the shadow did not see */
+        sunxi_can_update_msel(priv, RESET_MODE, 0);
+        if (sunxi_can_mode_wait(dev, false, can_sleep)) {
+                netdev_err(dev, "setting SUNXI_CAN into normal mode failed!\n");
+                return;
+        }
+
+        priv->can.state = CAN_STATE_ERROR_ACTIVE;
+
+        /* enable interrupts */
+        inten = 0xFFFF;
+        if (!(priv->can.ctrlmode & CAN_CTRLMODE_BERR_REPORTING) ||
+            priv->berr_throttled)
+                inten &= ~BERR_IRQ_EN;
+        /* RX stays masked while the NAPI poll or poll_timer own the RX FIFO */
+        if (priv->hrpoll || priv->rx_recs_full || priv->rx_napi_masked)
+                inten &= ~RX_IRQ_EN;
+        sunxi_can_update_inten(priv, ~0, inten);
+
+        if (sunxi_can_loopback(priv)) {
+                /* Put device into loopback mode */
+                sunxi_can_update_msel(priv, 0, LOOPBACK_MODE);
+        } else if (priv->can.ctrlmode & CAN_CTRLMODE_LISTENONLY) {
+                /* Put device into listen-only mode */
+                sunxi_can_update_msel(priv, 0, LISTEN_ONLY_MODE);
         }
+}
 
-        netdev_err(dev, "setting SUNXI_CAN into reset mode failed!\n");
+/*
+* hand RX back to the interrupt after napi_enable(), with the IRQ disabled
+* a poll that used up its quota while napi_disable() was pending is
+* completed without restarting RX, which leaves RX_IRQ_EN clear and no
+* poll scheduled; frames already waiting go to a new poll, with RX masked
+* as the poll itself does when it finds them on completion
+*/
+static void sunxi_can_rx_restart(struct sunxi_can_priv *priv)
+{
+        /* while polling, poll_timer owns the RX FIFO */
+        if (priv->hrpoll)
+                return;
+
+        priv->rx_napi_masked = false;
+        priv->rx_recs_full = false;
+        smp_wmb();
+        sunxi_can_update_inten(priv, 0, RX_IRQ_EN);
+
+        priv->xstats.rx_mmio_reads++;
+        if (sunxi_can_read(priv, CAN_STA_ADDR) & RBUF_RDY) {
+                if (priv->rx_recs)
+                        priv->rx_recs_full = true;
+                else
+                        priv->rx_napi_masked = true;
+                sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+                napi_schedule(&priv->napi);
+        } else if (ACCESS_ONCE(priv->rx_head) != priv->rx_tail) {
+                napi_schedule(&priv->napi);
+        }
 }
 
-static void set_normal_mode(struct net_device *dev)
+/*
+* program the acceptance filter
+* CAN_ACPC_ADDR/CAN_ACPM_ADDR share their addresses with the TX/RX buffer
+* and are only accessible in reset mode.
+*/
+static void sunxi_can_set_acceptance(struct net_device *dev)
 {
         struct sunxi_can_priv *priv = netdev_priv(dev);
-        unsigned char status = readl(CAN_MSEL_ADDR);
-        int i;
 
-        for (i = 0; i < 100; i++) {
-                /* check reset bit */
-                if ((status & RESET_MODE) == 0) {
-                        priv->can.state = CAN_STATE_ERROR_ACTIVE;												
-						
-						/* enable interrupts */
-                        if (priv->can.ctrlmode & CAN_CTRLMODE_BERR_REPORTING) {
-								writel(0xFFFF, CAN_INTEN_ADDR);
-						} else {
-								writel(0xFFFF & ~BERR_IRQ_EN, CAN_INTEN_ADDR);
-						}
-											
-						if (priv->can.ctrlmode & CAN_CTRLMODE_LOOPBACK) {
-							/* Put device into loopback mode */
-							writel(readl(CAN_MSEL_ADDR) | LOOPBACK_MODE, CAN_MSEL_ADDR);
-						} else if (priv->can.ctrlmode & CAN_CTRLMODE_LISTENONLY) {
-							/* Put device into listen-only mode */
-							writel(readl(CAN_MSEL_ADDR) | LISTEN_ONLY_MODE, CAN_MSEL_ADDR);
-						}
-                        return;
+        if (priv->filter_mode == FILTER_CLOSE) {
+                sunxi_can_write(priv, 0x0, CAN_ACPC_ADDR);
+                sunxi_can_write(priv, 0xffffffff, CAN_ACPM_ADDR);        /* accept all frames */
+        } else {
+                sunxi_can_write(priv, priv->acp_code, CAN_ACPC_ADDR);
+                sunxi_can_write(priv, priv->acp_mask, CAN_ACPM_ADDR);
+        }
+
+        if (priv->filter_mode == SINGLE_FLTER_MODE)
+                sunxi_can_update_msel(priv, 0, SINGLE_FILTER);
+        else
+                sunxi_can_update_msel(priv, SINGLE_FILTER, 0);
+}
+
+/*
+* place an identifier into the acceptance code/mask layout
+* ACR0 is bits 31..24 of CAN_ACPC_ADDR, ACR3 bits 7..0:
+* single filter, SFF: ACR0 = ID10..3, ACR1 = ID2..0 RTR, ACR2/3 = data 0/1
+* single filter, EFF: ACR0..3 = ID28..0 RTR
+* dual filter, SFF:   filter 0 ACR0/1 = ID10..0 RTR, filter 1 ACR2/3 = ID10..0 RTR
+* dual filter, EFF:   filter 0 ACR0/1 = ID28..13, filter 1 ACR2/3 = ID28..13
+* the same helper maps a can_filter style mask (set bits must match)
+*/
+static u32 sunxi_can_acp_layout(canid_t id, bool eff, bool dual, int filter)
+{
+        u32 rtr = (id & CAN_RTR_FLAG) ? 1 : 0;
+        u32 val;
+
+        if (eff) {
+                if (!dual)
+                        return ((id & CAN_EFF_MASK) << 3) | (rtr << 2);
+                val = (id & CAN_EFF_MASK) >> 13;
+        } else {
+                val = ((id & CAN_SFF_MASK) << 5) | (rtr << 4);
+                if (!dual)
+                        return val << 16;
+        }
+
+        return filter ? val : val << 16;
+}
+
+static void sunxi_can_cube_add(struct sunxi_can_cube *c, bool first, u32 lo, u32 hi)
+{
+        u32 var = (lo == hi) ? 0 : (u32)((1ULL << fls(lo ^ hi)) - 1);
+
+        if (first) {
+                c->base = lo & ~var;
+                c->var = var;
+        } else {
+                c->var |= var | (c->base ^ lo);
+                c->base &= ~c->var;
+        }
+}
+
+static u64 sunxi_can_cube_size(const struct sunxi_can_cube *c)
+{
+        return 1ULL << hweight32(c->var);
+}
+
+/* identifiers accepted by one or two (possibly overlapping) cubes */
+static u64 sunxi_can_cover_size(const struct sunxi_can_cube *a, const struct sunxi_can_cube *b)
+{
+        struct sunxi_can_cube both;
+        u64 size = sunxi_can_cube_size(a) + sunxi_can_cube_size(b);
+
+        if (!((a->base ^ b->base) & ~(a->var | b->var))) {
+                both.var = a->var & b->var;
+                size -= sunxi_can_cube_size(&both);
+        }
+
+        return size;
+}
+
+/*
+* cover ranges of one frame format, shifted right by shift bits, with the
+* two cubes of a dual filter accepting the fewest identifiers
+* up to SUNXI_CAN_COVER_EXHAUSTIVE ranges every split is tried, above that
+* the splits at each position of the sorted ranges and at each ID bit
+*/
+static u64 sunxi_can_dual_cover(const struct sunxi_can_id_range *range, unsigned int n,
+                                bool eff, unsigned int shift, struct sunxi_can_cube *best)
+{
+        unsigned int i, k, bits = eff ? 29 : 11;
+        struct sunxi_can_cube c[2];
+        bool used[2];
+        u64 size, best_size = ~0ULL;
+        u32 split, splits;
+
+        memset(c, 0, sizeof(c));
+        splits = (n <= SUNXI_CAN_COVER_EXHAUSTIVE) ? (1 << (n - 1)) : n + bits;
+        for (split = 0; split < splits; split++) {
+                used[0] = used[1] = false;
+                for (i = 0; i < n; i++) {
+                        if (n <= SUNXI_CAN_COVER_EXHAUSTIVE)
+                                k = (split >> i) & 1;
+                        else if (split < n)
+                                k = i >= split;
+                        else
+                                k = (range[i].lo >> (split - n)) & 1;
+
+                        sunxi_can_cube_add(&c[k], !used[k],
+                                           range[i].lo >> shift, range[i].hi >> shift);
+                        used[k] = true;
                 }
+                if (!used[0])
+                        c[0] = c[1];
+                else if (!used[1])
+                        c[1] = c[0];
+
+                size = sunxi_can_cover_size(&c[0], &c[1]);
+                if (size < best_size) {
+                        best_size = size;
+                        best[0] = c[0];
+                        best[1] = c[1];
+                }
+        }
+
+        return best_size << shift;
+}
+
+/*
+* compute the acceptance code/mask for an ID set, returns the filter mode
+* the single filter is the smallest cube holding every range, the dual
+* filter the best pair of cubes; whichever accepts fewer identifiers is used
+* EFF dual filters only see ID28..13, so they are computed on that part
+* the acceptance filter cannot serve SFF and EFF sets at once, mixed sets
+* leave it open and rely on the filter bank alone
+*/
+static u8 sunxi_can_cover_ids(struct sunxi_can_id_set *ids, u32 *code, u32 *mask)
+{
+        const struct sunxi_can_id_range *range = ids->range;
+        struct sunxi_can_cube single, dual[2];
+        bool eff = !ids->n_sff;
+        unsigned int i, shift = eff ? 13 : 0;
+        u32 idmask = eff ? CAN_EFF_MASK : CAN_SFF_MASK;
+        u32 care;
+        u64 single_size, dual_size;
+
+        if (ids->n_sff && ids->n_sff != ids->n) {
+                ids->accepted = 0;
+                return FILTER_CLOSE;
+        }
+
+        /* an empty set is never passed in, but keep the cubes defined */
+        memset(&single, 0, sizeof(single));
+        memset(dual, 0, sizeof(dual));
+        for (i = 0; i < ids->n; i++)
+                sunxi_can_cube_add(&single, !i, range[i].lo, range[i].hi);
+        single_size = sunxi_can_cube_size(&single);
+        dual_size = sunxi_can_dual_cover(range, ids->n, eff, shift, dual);
+
+        if (single_size <= dual_size) {
+                ids->accepted = single_size;
+                care = sunxi_can_acp_layout(~single.var & idmask, eff, false, 0);
+                *code = sunxi_can_acp_layout(single.base, eff, false, 0);
+                *mask = ~care;
+                return SINGLE_FLTER_MODE;
+        }
+
+        ids->accepted = dual_size;
+        care = sunxi_can_acp_layout((~dual[0].var << shift) & idmask, eff, true, 0)
+                | sunxi_can_acp_layout((~dual[1].var << shift) & idmask, eff, true, 1);
+        *code = sunxi_can_acp_layout(dual[0].base << shift, eff, true, 0)
+                | sunxi_can_acp_layout(dual[1].base << shift, eff, true, 1);
+        *mask = ~care;
+        return DUAL_FILTER_MODE;
+}
+
+/*
+* look a received identifier up in the filter bank
+* SFF identifiers are rejected by the bitmap alone, the range is only
+* searched to account the hit
+*/
+static struct sunxi_can_id_range *sunxi_can_id_lookup(struct sunxi_can_id_set *ids, canid_t id)
+{
+        unsigned int lo, hi, mid;
+        u32 val;
+
+        if (id & CAN_EFF_FLAG) {
+                val = id & CAN_EFF_MASK;
+                lo = ids->n_sff;
+                hi = ids->n;
+        } else {
+                val = id & CAN_SFF_MASK;
+                if (!test_bit(val, ids->sff_map))
+                        return NULL;
+                lo = 0;
+                hi = ids->n_sff;
+        }
 
-                /* set chip to normal mode */
-                writel(readl(CAN_MSEL_ADDR) & (~RESET_MODE), CAN_MSEL_ADDR);
-                udelay(10);
-                status = readl(CAN_MSEL_ADDR);
+        while (lo < hi) {
+                mid = (lo + hi) / 2;
+                if (val < ids->range[mid].lo)
+                        hi = mid;
+                else if (val > ids->range[mid].hi)
+                        lo = mid + 1;
+                else
+                        return &ids->range[mid];
         }
 
-        netdev_err(dev, "setting SUNXI_CAN into normal mode failed!\n");
+        return NULL;
 }
 
+static void sunxi_can_tx_halt(struct net_device *dev);
+static void sunxi_can_tx_resume(struct net_device *dev);
+static void sunxi_can_tx_purge(struct net_device *dev);
+
+/*
+* install a new filter bank and acceptance filter, called under rtnl
+* the filter bank is swapped under RCU; only if the acceptance filter
+* changes on a running controller, the ISR, the NAPI poll and the TX path
+* are kept off the TX/RX buffer while the acceptance registers are mapped
+* over it in reset mode
+*/
+static void sunxi_can_update_acceptance(struct net_device *dev, u8 mode, u32 code, u32 mask,
+                                        struct sunxi_can_id_set *ids)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_id_set *old = rtnl_dereference(priv->rx_ids);
+
+        rcu_assign_pointer(priv->rx_ids, ids);
+        if (old)
+                kfree_rcu(old, rcu);
+
+        if (mode == FILTER_CLOSE) {
+                code = 0x0;
+                mask = 0xffffffff;
+        }
+        if (mode == priv->filter_mode && code == priv->acp_code && mask == priv->acp_mask)
+                return;
+
+        if (!priv->open_time) {
+                priv->filter_mode = mode;
+                priv->acp_code = code;
+                priv->acp_mask = mask;
+                return;        /* programmed on open */
+        }
+
+        disable_irq(dev->irq);
+        napi_disable(&priv->napi);
+        sunxi_can_tx_halt(dev);
+
+        priv->filter_mode = mode;
+        priv->acp_code = code;
+        priv->acp_mask = mask;
+
+        set_reset_mode(dev, true);
+        sunxi_can_set_acceptance(dev);
+        set_normal_mode(dev, true);
+
+        sunxi_can_tx_resume(dev);
+        napi_enable(&priv->napi);
+        sunxi_can_rx_restart(priv);
+        enable_irq(dev->irq);
+}
 
-static void sunxi_can_start(struct net_device *dev)
+static void sunxi_can_start(struct net_device *dev, bool can_sleep)
 {
         struct sunxi_can_priv *priv = netdev_priv(dev);
 
         /* leave reset mode */
         if (priv->can.state != CAN_STATE_STOPPED)
-                set_reset_mode(dev);
+                set_reset_mode(dev, can_sleep);
+
+        /* a bus-off or restart may have left the filter registers reset */
+        sunxi_can_set_acceptance(dev);
 
         /* Clear error counters and error code capture */
-        writel(0x0, CAN_ERRC_ADDR);
+        sunxi_can_write(priv, 0x0, CAN_ERRC_ADDR);
 
         /* leave reset mode */
-        set_normal_mode(dev);
+        set_normal_mode(dev, can_sleep);
 }
 
 static int sunxi_can_set_mode(struct net_device *dev, enum can_mode mode)
 {
         struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned long flags;
 
         if (!priv->open_time)
                 return -EINVAL;
 
         switch (mode) {
         case CAN_MODE_START:
-                sunxi_can_start(dev);
+                sunxi_can_tx_halt(dev);
+                /*
+                * can_restart() has dropped every echo skb and counted the
+                * frames as tx_dropped, so they must not go out after the restart
+                */
+                raw_spin_lock_irqsave(&priv->tx_lock, flags);
+                sunxi_can_tx_purge(dev);
+                priv->tx_halted = true;
+                raw_spin_unlock_irqrestore(&priv->tx_lock, flags);
+                priv->busoff_recovering = false;
+                /* also called from the restart timer */
+                sunxi_can_start(dev, !in_interrupt());
+                sunxi_can_tx_resume(dev);
                 if (netif_queue_stopped(dev))
                         netif_wake_queue(dev);
                 break;
@@ -196,9 +699,10 @@ static int sunxi_can_set_bittiming(struct net_device *dev)
 
         netdev_info(dev, "setting BITTIMING=0x%08x\n", cfg);
 
-        set_reset_mode(dev);                //CAN_BTIME_ADDR only writable in reset mode
-        writel(cfg, CAN_BTIME_ADDR);
-        set_normal_mode(dev);
+        set_reset_mode(dev, true);                //CAN_BTIME_ADDR only writable in reset mode
+        priv->btime = cfg;
+        sunxi_can_write(priv, priv->btime, CAN_BTIME_ADDR);
+        set_normal_mode(dev, true);
 
         return 0;
 }
@@ -206,8 +710,10 @@ static int sunxi_can_set_bittiming(struct net_device *dev)
 static int sunxi_can_get_berr_counter(const struct net_device *dev,
                                  struct can_berr_counter *bec)
 {
-        bec->txerr = readl(CAN_ERRC_ADDR) & 0x000F;
-        bec->rxerr = (readl(CAN_ERRC_ADDR) & 0x0F00) >> 16;
+        const struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        bec->txerr = sunxi_can_read(priv, CAN_ERRC_ADDR) & 0x000F;
+        bec->rxerr = (sunxi_can_read(priv, CAN_ERRC_ADDR) & 0x0F00) >> 16;
 
         return 0;
 }
@@ -220,400 +726,2748 @@ static int sunxi_can_get_berr_counter(const struct net_device *dev,
 * - enable interrupts
 * - start operating mode
 */
-static void chipset_init(struct net_device *dev)
+static void chipset_init(struct net_device *dev, char *para)
 {
+        struct sunxi_can_priv *priv = netdev_priv(dev);
         u32 temp_irqen;
 		
         /* config pins
-         * PH20-TX, PH21-RX :4 */
+         * PH20-TX, PH21-RX :4 on the first controller */
 
-		if (gpio_request_ex("can_para", "can_tx") == 0 || gpio_request_ex("can_para", "can_rx") == 0 ) {
+		if (gpio_request_ex(para, "can_tx") == 0 || gpio_request_ex(para, "can_rx") == 0 ) {
 			pr_info("can request gpio fail!\n");
         }
 
-        //enable clock
-        writel(readl(0xF1C20000 + 0x6C) | (1 << 4), 0xF1C20000 + 0x6C);
+        /* the bus clock is enabled by the platform probe */
+        sunxi_can_sync_shadows(priv);
 
         //set can controller in reset mode
-        set_reset_mode(dev);
+        set_reset_mode(dev, true);
 
         //enable interrupt
         temp_irqen = BERR_IRQ_EN | ERR_PASSIVE_IRQ_EN
                         | OR_IRQ_EN | RX_IRQ_EN;
-        writel(readl(CAN_INTEN_ADDR) | temp_irqen, CAN_INTEN_ADDR);
+        sunxi_can_update_inten(priv, 0, temp_irqen);
 
         //return to transfer mode
-        set_normal_mode(dev);
+        set_normal_mode(dev, true);
 }
 
 /*
-* transmit a CAN message
+* arbitration priority of a CAN identifier, lower values win on the bus
+* the key follows the bit order of the arbitration field:
+* SFF: ID10..0 RTR IDE(0)
+* EFF: ID28..18 SRR(1) IDE(1) ID17..0 RTR
+*/
+static inline u32 sunxi_can_arb_key(canid_t id)
+{
+        u32 rtr = (id & CAN_RTR_FLAG) ? 1 : 0;
+
+        if (id & CAN_EFF_FLAG)
+                return (((id & CAN_EFF_MASK) >> 18) << 21) | (0x3 << 19)
+                        | ((id & 0x3FFFF) << 1) | rtr;
+
+        return ((id & CAN_SFF_MASK) << 21) | (rtr << 20);
+}
+
+static inline unsigned int sunxi_can_prio_class(u32 key)
+{
+        return key >> (32 - SUNXI_CAN_TX_PRIO_CLASS_BITS);
+}
+
+/*
+* write a pre-encoded frame into the TX buffer and request transmission
+* must be called with tx_lock held and the TX buffer released
+*/
+static void sunxi_can_tx_load(struct net_device *dev, struct sunxi_can_tx_entry *entry)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_tx_lat *lat = &priv->tx_lat[sunxi_can_prio_class(entry->key)];
+        unsigned long addr = CAN_BUF0_ADDR;
+        uint8_t i;
+        s64 wait;
+
+        /*
+        * the writel() of TRANS_REQ carries the barrier that orders the
+        * relaxed buffer writes before the command, one barrier per frame
+        * instead of one per buffer register
+        */
+        for (i = 0; i < entry->len; i++, addr += 4)
+                sunxi_can_write_relaxed(priv, entry->regs[i], addr);
+        priv->xstats.tx_mmio_writes += entry->len + 1;
+
+        priv->tx_cur = *entry;
+        priv->tx_cur.loaded = true;
+        priv->tx_busy = true;
+
+        /* in loopback the frame must be received by the controller itself */
+        sunxi_can_write_cmdreg(priv, sunxi_can_loopback(priv) ? SELF_RCV_REQ : TRANS_REQ);
+
+        /* time the frame spent queued behind other frames, up to its first load */
+        if (entry->loaded)
+                return;
+        wait = ktime_to_ns(ktime_sub(ktime_get(), entry->queued));
+        lat->frames++;
+        lat->total_ns += wait;
+        if (wait > lat->max_ns)
+                lat->max_ns = wait;
+}
+
+/*
+* encode a frame into the register image of the TX buffer window
 * message layout in the sk_buff should be like this:
 * xx xx xx xx         ff         ll 00 11 22 33 44 55 66 77
 * [ can_id ] [flags] [len] [can data (up to 8 bytes]
+* SFF and EFF have their own encoders so that the register layout of
+* each is fixed at compile time
 */
-static netdev_tx_t sunxi_can_start_xmit(struct sk_buff *skb,
-                                         struct net_device *dev)
+static __always_inline void sunxi_can_encode_data(u8 *regs, const struct can_frame *cf)
 {
-        struct sunxi_can_priv *priv = netdev_priv(dev);
-        struct can_frame *cf = (struct can_frame *)skb->data;
-        uint8_t dlc;
-        canid_t id;
-        uint32_t temp = 0;
         uint8_t i;
-        
-        //wait buff ready
-        while (!(readl(CAN_STA_ADDR) & TBUF_RDY));
 
-        set_reset_mode(dev);
+        for (i = 0; i < cf->can_dlc; i++)
+                regs[i] = cf->data[i];
+}
 
-        writel(0xffffffff, CAN_ACPM_ADDR);
+static void sunxi_can_encode_eff(struct sunxi_can_tx_entry *entry, const struct can_frame *cf)
+{
+        canid_t id = cf->can_id;
+
+        entry->regs[0] = ((id >> 30) << 6) | cf->can_dlc;
+        entry->regs[1] = 0xFF & (id >> 21);        //id28~21
+        entry->regs[2] = 0xFF & (id >> 13);        //id20~13
+        entry->regs[3] = 0xFF & (id >> 5);        //id12~5
+        entry->regs[4] = (id & 0x1F) << 3;        //id4~0
+        sunxi_can_encode_data(&entry->regs[5], cf);
+        entry->len = 5 + cf->can_dlc;
+}
 
-        //enter transfer mode
-        set_normal_mode(dev);
+static void sunxi_can_encode_sff(struct sunxi_can_tx_entry *entry, const struct can_frame *cf)
+{
+        canid_t id = cf->can_id;
 
-        if (can_dropped_invalid_skb(dev, skb))
-                return NETDEV_TX_OK;
+        entry->regs[0] = ((id >> 30) << 6) | cf->can_dlc;
+        entry->regs[1] = 0xFF & (id >> 3);        //id28~21
+        entry->regs[2] = (id & 0x7) << 5;        //id20~18
+        sunxi_can_encode_data(&entry->regs[3], cf);
+        entry->len = 3 + cf->can_dlc;
+}
 
-        netif_stop_queue(dev);
+/*
+* insert a frame into the TX ring, which is kept sorted by descending
+* arbitration key so the highest-priority frame sits at the end;
+* frames with the same key are sent in FIFO order; a frame taken back
+* from the TX buffer (requeue) was queued before all frames with its key
+* still in the ring and goes ahead of them
+* must be called with tx_lock held
+*/
+static void sunxi_can_tx_enqueue(struct sunxi_can_priv *priv, struct sunxi_can_tx_entry *entry,
+                                 bool requeue)
+{
+        unsigned int i = priv->tx_count;
 
-        dlc = cf->can_dlc;
-        id = cf->can_id;
+        while (i > 0 && (requeue ? priv->tx_ring[i - 1].key < entry->key :
+                                   priv->tx_ring[i - 1].key <= entry->key))
+                i--;
 
-        temp = ((id >> 30) << 6) | dlc;
-        writel(temp, CAN_BUF0_ADDR);
-        if (id & CAN_EFF_FLAG) {/* extern frame */
-                writel(0xFF & (id >> 21), CAN_BUF1_ADDR);        //id28~21
-                writel(0xFF & (id >> 13), CAN_BUF2_ADDR);         //id20~13
-                writel(0xFF & (id >> 5), CAN_BUF3_ADDR);         //id12~5
-                writel((id & 0x1F) << 3, CAN_BUF4_ADDR);         //id4~0
-                
-                for (i = 0; i < dlc; i++) {
-                        writel(cf->data[i], CAN_BUF5_ADDR + i * 4);
-                }
-        } else {                /* standard frame*/        
-                writel(0xFF & (id >> 3), CAN_BUF1_ADDR);         //id28~21
-                writel((id & 0x7) << 5, CAN_BUF2_ADDR);                //id20~13
-                
-                for (i = 0; i < dlc; i++) {
-                        writel(cf->data[i], CAN_BUF3_ADDR + i * 4);
-                }
-        }
+        memmove(&priv->tx_ring[i + 1], &priv->tx_ring[i],
+                (priv->tx_count - i) * sizeof(*priv->tx_ring));
+        priv->tx_ring[i] = *entry;
+        priv->tx_count++;
+}
 
-        can_put_echo_skb(skb, dev, 0);
+/*
+* load the highest-priority frame from the TX ring into the released
+* TX buffer
+* must be called with tx_lock held
+*/
+static void sunxi_can_tx_next(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
 
-        while (!(readl(CAN_STA_ADDR) & TBUF_RDY));
-        sunxi_can_write_cmdreg(priv, TRANS_REQ);
+        if (priv->tx_count && !priv->tx_halted)
+                sunxi_can_tx_load(dev, &priv->tx_ring[--priv->tx_count]);
 
-        return NETDEV_TX_OK;
+        if (netif_queue_stopped(dev) && priv->tx_count < priv->tx_ring_len)
+                netif_wake_queue(dev);
 }
 
-static void sunxi_can_rx(struct net_device *dev)
+/*
+* account the frame the controller released from the TX buffer, or
+* requeue it if it was aborted
+* returns the echo slot of a sent frame, -1 otherwise
+* must be called with tx_lock held, tx_busy set and TBUF_RDY in status
+*/
+static int sunxi_can_tx_finish(struct net_device *dev, uint32_t status)
 {
         struct sunxi_can_priv *priv = netdev_priv(dev);
         struct net_device_stats *stats = &dev->stats;
-        struct can_frame *cf;
-        struct sk_buff *skb;
-        uint8_t fi;
-        canid_t id;
-        int i;
-
-        /* create zero'ed CAN frame buffer */
-        skb = alloc_can_skb(dev, &cf);
-        if (skb == NULL)
-                return;
-
-        fi = readl(CAN_BUF0_ADDR);
-        cf->can_dlc = get_can_dlc(fi & 0x0F);
-        if (fi >> 7) {
-                /* extended frame format (EFF) */
-                id = (readl(CAN_BUF1_ADDR) << 21)        //id28~21
-                 | (readl(CAN_BUF2_ADDR) << 13)        //id20~13
-                 | (readl(CAN_BUF3_ADDR) << 5)        //id12~5
-                 | ((readl(CAN_BUF4_ADDR) >> 3) & 0x1f);        //id4~0
-                id |= CAN_EFF_FLAG;
+        int sent = -1;
 
-                if ((fi >> 6) & 0x1) {        /* remote transmission request */
-                id |= CAN_RTR_FLAG;
-                } else {
-                        for (i = 0; i < cf->can_dlc; i++)
-                                cf->data[i] = readl(CAN_BUF5_ADDR + i * 4);
-                }
+        if (!(status & TRANS_OVER)) {
+                priv->xstats.tx_aborts++;
+                sunxi_can_tx_enqueue(priv, &priv->tx_cur, true);
         } else {
-                /* standard frame format (SFF) */
-                id = (readl(CAN_BUF1_ADDR) << 3)        //id28~21
-                 | ((readl(CAN_BUF2_ADDR) >> 5) & 0x7);        //id20~18
-
-                if ((fi >> 6) & 0x1) {        /* remote transmission request */
-                id |= CAN_RTR_FLAG;
-                } else {
-                        for (i = 0; i < cf->can_dlc; i++)
-                                cf->data[i] = readl(CAN_BUF3_ADDR + i * 4);
-                }
+                stats->tx_bytes += priv->tx_cur.dlc;
+                stats->tx_packets++;
+                sent = priv->tx_cur.echo;
         }
+        priv->tx_busy = false;
+        priv->tx_aborting = false;
 
-        cf->can_id = id;
+        return sent;
+}
 
-        /* release receive buffer */
-        sunxi_can_write_cmdreg(priv, RELEASE_RBUF);
+/*
+* hand the echo skb of a sent frame to the stack, outside tx_lock
+* the echo skb was stored in start_xmit, so this never frees an skb
+*/
+static void sunxi_can_tx_echo(struct net_device *dev, int sent)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
 
-        netif_rx(skb);
+        if (sent < 0)
+                return;
 
-        stats->rx_packets++;
-        stats->rx_bytes += cf->can_dlc;
+        if (in_interrupt()) {
+                can_get_echo_skb(dev, sent);
+        } else {
+                /* netif_rx() from process context, e.g. a halt under rtnl */
+                local_bh_disable();
+                can_get_echo_skb(dev, sent);
+                local_bh_enable();
+        }
+        clear_bit(sent, priv->tx_echo_used);
 }
 
-static int sunxi_can_err(struct net_device *dev, uint8_t isrc, uint8_t status)
+/*
+* TX buffer released: account the sent frame, or requeue it if it was
+* aborted, and load the next one right away, so back-to-back frames do not
+* wait for a softirq round trip
+* called from the ISR or the IRQ thread
+*/
+static void sunxi_can_tx_done(struct net_device *dev)
 {
         struct sunxi_can_priv *priv = netdev_priv(dev);
-        struct net_device_stats *stats = &dev->stats;
-        struct can_frame *cf;
-        struct sk_buff *skb;
-        enum can_state state = priv->can.state;
-        uint32_t ecc, alc;
+        int sent = -1;
+        unsigned long flags;
+        uint32_t status;
 
-        skb = alloc_can_err_skb(dev, &cf);
-        if (skb == NULL)
-                return -ENOMEM;
+        /* also taken in the IRQ thread, where softirqs may call start_xmit */
+        raw_spin_lock_irqsave(&priv->tx_lock, flags);
 
-        if (isrc & DATA_ORUNI) {
-                /* data overrun interrupt */
-                netdev_dbg(dev, "data overrun interrupt\n");
-                cf->can_id |= CAN_ERR_CRTL;
-                cf->data[1] = CAN_ERR_CRTL_RX_OVERFLOW;
+        if (priv->tx_busy) {
+                /* ignore a stale interrupt for a frame that was requeued */
+                status = sunxi_can_read(priv, CAN_STA_ADDR);
+                priv->xstats.tx_mmio_reads++;
+                if (!(status & TBUF_RDY))
+                        goto out;
+
+                sent = sunxi_can_tx_finish(dev, status);
+        }
+
+        sunxi_can_tx_next(dev);
+out:
+        raw_spin_unlock_irqrestore(&priv->tx_lock, flags);
+
+        /*
+        * echo outside the raw lock, the next completion is handled by this
+        * same context only after we return
+        */
+        sunxi_can_tx_echo(dev, sent);
+}
+
+/*
+* stop loading the TX buffer before the controller enters reset mode,
+* where CAN_BUF0/1 turn into the acceptance registers; the frame in the
+* TX buffer is aborted by the reset and goes back to the TX ring, unless
+* it already completed and only its interrupt is still pending
+*/
+static void sunxi_can_tx_halt(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned long flags;
+        uint32_t status;
+        int sent = -1;
+
+        raw_spin_lock_irqsave(&priv->tx_lock, flags);
+
+        priv->tx_halted = true;
+        if (priv->tx_busy) {
+                status = sunxi_can_read(priv, CAN_STA_ADDR);
+                priv->xstats.tx_mmio_reads++;
+                if (status & TBUF_RDY) {
+                        sent = sunxi_can_tx_finish(dev, status);
+                } else {
+                        sunxi_can_tx_enqueue(priv, &priv->tx_cur, true);
+                        priv->tx_busy = false;
+                        priv->tx_aborting = false;
+                }
+        }
+
+        raw_spin_unlock_irqrestore(&priv->tx_lock, flags);
+
+        sunxi_can_tx_echo(dev, sent);
+}
+
+/*
+* restart transmission of the TX ring once the controller is back in
+* normal mode
+*/
+static void sunxi_can_tx_resume(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned long flags;
+
+        raw_spin_lock_irqsave(&priv->tx_lock, flags);
+
+        priv->tx_halted = false;
+        sunxi_can_tx_next(dev);
+
+        raw_spin_unlock_irqrestore(&priv->tx_lock, flags);
+}
+
+static void sunxi_can_tx_purge(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        while (priv->tx_count) {
+                can_free_echo_skb(dev, priv->tx_ring[--priv->tx_count].echo);
+                clear_bit(priv->tx_ring[priv->tx_count].echo, priv->tx_echo_used);
+        }
+
+        if (priv->tx_busy) {
+                can_free_echo_skb(dev, priv->tx_cur.echo);
+                clear_bit(priv->tx_cur.echo, priv->tx_echo_used);
+        }
+        priv->tx_busy = false;
+        priv->tx_aborting = false;
+        priv->tx_halted = false;
+}
+
+/*
+* transmit a CAN message
+* the frame goes straight into the TX buffer if it is free, otherwise it is
+* queued on the TX ring in arbitration order and sent from the TX interrupt;
+* the queue is only stopped when the ring is full
+* a frame that is tx_abort_gap priority classes above the one occupying the
+* TX buffer aborts that transmission, the aborted frame is requeued
+* the echo skb is stored here, in process or softirq context, so the TX
+* interrupt never frees an skb; every queued frame has its own echo slot
+*/
+static netdev_tx_t sunxi_can_start_xmit(struct sk_buff *skb,
+                                         struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct can_frame *cf = (struct can_frame *)skb->data;
+        struct sunxi_can_tx_entry entry;
+        unsigned long flags;
+        int echo;
+
+        if (can_dropped_invalid_skb(dev, skb))
+                return NETDEV_TX_OK;
+
+        entry.key = sunxi_can_arb_key(cf->can_id);
+        if (cf->can_id & CAN_EFF_FLAG)
+                sunxi_can_encode_eff(&entry, cf);
+        else
+                sunxi_can_encode_sff(&entry, cf);
+        entry.dlc = cf->can_dlc;
+        entry.loaded = false;
+        entry.queued = ktime_get();
+
+        /* the queue stops before the TX ring and buffer hold more frames than slots */
+        do {
+                echo = find_first_zero_bit(priv->tx_echo_used, SUNXI_CAN_ECHO_SKB_MAX);
+                if (echo >= SUNXI_CAN_ECHO_SKB_MAX) {
+                        kfree_skb(skb);
+                        dev->stats.tx_dropped++;
+                        return NETDEV_TX_OK;
+                }
+        } while (test_and_set_bit(echo, priv->tx_echo_used));
+        entry.echo = echo;
+        can_put_echo_skb(skb, dev, echo);
+
+        raw_spin_lock_irqsave(&priv->tx_lock, flags);
+
+        if (!priv->tx_busy && !priv->tx_halted) {
+                sunxi_can_tx_load(dev, &entry);
+        } else {
+                sunxi_can_tx_enqueue(priv, &entry, false);
+                if (priv->tx_count >= priv->tx_ring_len)
+                        netif_stop_queue(dev);
+
+                if (tx_abort_gap && priv->tx_busy && !priv->tx_aborting &&
+                    sunxi_can_prio_class(entry.key) + tx_abort_gap <=
+                    sunxi_can_prio_class(priv->tx_cur.key)) {
+                        priv->tx_aborting = true;
+                        sunxi_can_write_cmdreg(priv, ABORT_REQ);
+                }
+        }
+
+        raw_spin_unlock_irqrestore(&priv->tx_lock, flags);
+
+        return NETDEV_TX_OK;
+}
+
+/*
+* account a benchmark frame received back
+* the frame data carries as many low bytes of the sequence number as the
+* DLC allows, the rest is taken from the sequence number expected next;
+* frames lost on the way are skipped
+*/
+static void sunxi_can_bench_rx(struct sunxi_can_priv *priv, const struct can_frame *cf)
+{
+        struct sunxi_can_bench *b = &priv->bench;
+        struct sunxi_can_bench_result *r = &b->result;
+        u8 n = min_t(u8, cf->can_dlc, sizeof(u32));
+        u32 seq = 0, mask;
+        s64 lat;
+
+        memcpy(&seq, cf->data, n);
+        mask = n < sizeof(u32) ? (1U << (n * 8)) - 1 : ~0U;
+        seq = b->rx_next + ((seq - b->rx_next) & mask);
+        if (seq - b->rx_next >= SUNXI_CAN_BENCH_INFLIGHT || seq - b->tx_seq < SUNXI_CAN_BENCH_INFLIGHT)
+                return;        /* not a frame of this run */
+
+        lat = ktime_to_ns(ktime_sub(ktime_get(), b->sent[seq % SUNXI_CAN_BENCH_INFLIGHT]));
+        b->rx_next = seq + 1;
+        r->rx++;
+        b->hist[min_t(s64, div_s64(lat, SUNXI_CAN_BENCH_BUCKET_NS), SUNXI_CAN_BENCH_BUCKETS - 1)]++;
+        if (lat > r->max_ns)
+                r->max_ns = lat;
+}
+
+/*
+* skb pool
+* RX and error frames take their skb from a pool filled in process context
+* with GFP_KERNEL, so a frame received under memory pressure does not
+* depend on a GFP_ATOMIC allocation; only when the pool is empty the skb
+* is allocated in place. Every skb taken triggers a refill.
+*/
+static struct sk_buff *sunxi_can_pool_new_skb(struct net_device *dev, gfp_t gfp)
+{
+        struct sk_buff *skb;
+
+        /* as alloc_can_skb(), with a choice of gfp */
+        skb = __netdev_alloc_skb(dev, sizeof(struct can_frame), gfp);
+        if (unlikely(!skb))
+                return NULL;
+
+        skb->protocol = htons(ETH_P_CAN);
+        skb->pkt_type = PACKET_BROADCAST;
+        skb->ip_summed = CHECKSUM_UNNECESSARY;
+        memset(skb_put(skb, sizeof(struct can_frame)), 0, sizeof(struct can_frame));
+
+        return skb;
+}
+
+static void sunxi_can_pool_refill(struct work_struct *work)
+{
+        struct sunxi_can_priv *priv = container_of(work, struct sunxi_can_priv, pool_work);
+        struct sk_buff *skb;
+        unsigned long flags;
+        bool full;
+        s64 lat;
+
+        for (;;) {
+                raw_spin_lock_irqsave(&priv->pool_lock, flags);
+                full = priv->pool_count >= priv->pool_len;
+                raw_spin_unlock_irqrestore(&priv->pool_lock, flags);
+                if (full)
+                        break;
+
+                skb = sunxi_can_pool_new_skb(priv->dev, GFP_KERNEL);
+                if (!skb)
+                        break;
+
+                raw_spin_lock_irqsave(&priv->pool_lock, flags);
+                if (priv->pool_count < priv->pool_len) {
+                        priv->pool[priv->pool_count++] = skb;
+                        skb = NULL;
+                }
+                raw_spin_unlock_irqrestore(&priv->pool_lock, flags);
+
+                if (skb) {
+                        kfree_skb(skb);
+                        break;
+                }
+        }
+
+        raw_spin_lock_irqsave(&priv->pool_lock, flags);
+        if (priv->pool_refill_ns) {
+                lat = ktime_to_ns(ktime_get()) - priv->pool_refill_ns;
+                priv->pool_refill_ns = 0;
+                priv->xstats.skb_pool_refills++;
+                if (lat > priv->xstats.skb_pool_refill_max_ns)
+                        priv->xstats.skb_pool_refill_max_ns = lat;
+        }
+        raw_spin_unlock_irqrestore(&priv->pool_lock, flags);
+}
+
+/* take a zeroed CAN frame skb, from the pool if possible */
+static struct sk_buff *sunxi_can_pool_get(struct net_device *dev, struct can_frame **cf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sk_buff *skb = NULL;
+        unsigned long flags;
+        bool refill = false;
+
+        raw_spin_lock_irqsave(&priv->pool_lock, flags);
+        if (priv->pool_count) {
+                skb = priv->pool[--priv->pool_count];
+                priv->xstats.skb_pool_hits++;
+        } else if (priv->pool_len) {
+                priv->xstats.skb_pool_misses++;
+        }
+        if (priv->pool_len && !priv->pool_refill_ns) {
+                priv->pool_refill_ns = ktime_to_ns(ktime_get());
+                refill = true;
+        }
+        raw_spin_unlock_irqrestore(&priv->pool_lock, flags);
+
+        /* schedule_work() takes sleeping locks on PREEMPT_RT, never under a raw lock */
+        if (refill)
+                schedule_work(&priv->pool_work);
+
+        if (!skb)
+                return alloc_can_skb(dev, cf);
+
+        *cf = (struct can_frame *)skb->data;
+
+        return skb;
+}
+
+static struct sk_buff *sunxi_can_pool_get_err(struct net_device *dev, struct can_frame **cf)
+{
+        struct sk_buff *skb = sunxi_can_pool_get(dev, cf);
+
+        if (unlikely(!skb))
+                return NULL;
+
+        (*cf)->can_id = CAN_ERR_FLAG;
+        (*cf)->can_dlc = CAN_ERR_DLC;
+
+        return skb;
+}
+
+static int sunxi_can_pool_init(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        priv->pool_len = min_t(unsigned int, skb_pool_size, SUNXI_CAN_SKB_POOL_MAX);
+        priv->pool_count = 0;
+        priv->pool_refill_ns = 0;
+        if (!priv->pool_len)
+                return 0;
+
+        priv->pool = kcalloc(priv->pool_len, sizeof(*priv->pool), GFP_KERNEL);
+        if (!priv->pool) {
+                priv->pool_len = 0;
+                return -ENOMEM;
+        }
+
+        sunxi_can_pool_refill(&priv->pool_work);
+
+        return 0;
+}
+
+/* called with the interrupt and the NAPI poll stopped */
+static void sunxi_can_pool_free(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        cancel_work_sync(&priv->pool_work);
+
+        while (priv->pool_count)
+                kfree_skb(priv->pool[--priv->pool_count]);
+        kfree(priv->pool);
+        priv->pool = NULL;
+        priv->pool_len = 0;
+}
+
+/* read the data registers of the RX FIFO head into win, after its frame info and identifier */
+static void sunxi_can_rx_fetch_data(struct sunxi_can_priv *priv, u32 *win)
+{
+        int hdr = (win[0] >> 7) ? 5 : 3;
+        int i, dlc = ((win[0] >> 6) & 0x1) ? 0 : get_can_dlc(win[0] & 0x0F);
+
+        for (i = hdr; i < hdr + dlc; i++)
+                win[i] = sunxi_can_rx_readl(priv, CAN_BUF0_ADDR + i * 4);
+}
+
+/*
+* fetch the frame window BUF0..BUF12 of the RX FIFO head into win
+* the fast path issues relaxed reads followed by a single barrier, the
+* other one keeps the per-register readl() of the original driver and
+* only reads the registers the frame actually uses; with head_only it
+* stops after the identifier and the data is read once the frame passed
+* the filter, see sunxi_can_rx_frame()
+*/
+static void sunxi_can_rx_fetch(struct sunxi_can_priv *priv, u32 *win, bool head_only)
+{
+        unsigned long addr = CAN_BUF0_ADDR;
+        int i, len;
+
+        if (!head_only && rx_fast_decode) {
+                for (i = 0; i < SUNXI_CAN_BUF_WINDOW; i++, addr += 4)
+                        win[i] = sunxi_can_read_relaxed(priv, addr);
+                rmb();
+                priv->xstats.rx_mmio_reads += SUNXI_CAN_BUF_WINDOW;
+                return;
+        }
+
+        win[0] = sunxi_can_rx_readl(priv, addr);
+        len = (win[0] >> 7) ? 5 : 3;
+        for (i = 1, addr += 4; i < len; i++, addr += 4)
+                win[i] = sunxi_can_rx_readl(priv, addr);
+
+        if (!head_only)
+                sunxi_can_rx_fetch_data(priv, win);
+}
+
+/*
+* slot of an EFF identifier in the ID statistics hash, linear probing
+* over SUNXI_CAN_ID_STATS_PROBE slots; slots are never freed except by
+* clearing the whole table
+*/
+static struct sunxi_can_id_stat *sunxi_can_id_stat_eff(struct sunxi_can_id_stats *st, u32 key)
+{
+        unsigned int i = hash_32(key, SUNXI_CAN_ID_STATS_EFF_BITS);
+        struct sunxi_can_id_stat *e;
+        int n;
+
+        for (n = 0; n < SUNXI_CAN_ID_STATS_PROBE; n++) {
+                e = &st->eff[i];
+                if (e->id == key)
+                        return e;
+                if (!e->id) {
+                        e->id = key;
+                        return e;
+                }
+                i = (i + 1) & (SUNXI_CAN_ID_STATS_EFF - 1);
+        }
+
+        return NULL;
+}
+
+/* count a received frame in the ID statistics, RX path only, no locking */
+static void sunxi_can_id_stat_update(struct sunxi_can_priv *priv, canid_t id, u8 dlc)
+{
+        struct sunxi_can_id_stat *e;
+        u64 now = ktime_to_ns(ktime_get());
+        u32 gap;
+
+        if (id & CAN_EFF_FLAG) {
+                e = sunxi_can_id_stat_eff(priv->id_stats, id & (CAN_EFF_FLAG | CAN_EFF_MASK));
+                if (!e) {
+                        priv->xstats.id_stats_overflow++;
+                        return;
+                }
+        } else {
+                e = &priv->id_stats->sff[id & CAN_SFF_MASK];
+        }
+
+        if (e->count) {
+                gap = min_t(u64, now - e->last_ns, UINT_MAX);
+                if (e->count == 1 || gap < e->min_gap_ns)
+                        e->min_gap_ns = gap;
+                if (gap > e->max_gap_ns)
+                        e->max_gap_ns = gap;
+        }
+        e->count++;
+        e->bytes += dlc;
+        e->last_ns = now;
+}
+
+/*
+* turn a frame window image into an skb
+* with fetch_data only the frame info and identifier are in win, the data
+* is read from the RX FIFO head once the frame is known to be wanted
+* returns the frame's skb, or NULL if it was filtered or could not be
+* allocated
+*/
+static struct sk_buff *sunxi_can_rx_frame(struct net_device *dev, u32 *win, bool fetch_data)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct net_device_stats *stats = &dev->stats;
+        struct sunxi_can_id_set *ids;
+        struct sunxi_can_id_range *range = NULL;
+        struct can_frame *cf;
+        struct sk_buff *skb;
+        const u32 *data;
+        uint8_t fi;
+        canid_t id;
+        int i;
+
+        /* decode the identifier first, unwanted frames cost no skb */
+        fi = win[0];
+        if (fi >> 7) {
+                /* extended frame format (EFF) */
+                id = ((win[1] & 0xFF) << 21)        //id28~21
+                 | ((win[2] & 0xFF) << 13)        //id20~13
+                 | ((win[3] & 0xFF) << 5)        //id12~5
+                 | ((win[4] >> 3) & 0x1f);        //id4~0
+                id |= CAN_EFF_FLAG;
+                data = &win[5];
+        } else {
+                /* standard frame format (SFF) */
+                id = ((win[1] & 0xFF) << 3)        //id28~21
+                 | ((win[2] >> 5) & 0x7);        //id20~18
+                data = &win[3];
+        }
+        if ((fi >> 6) & 0x1)        /* remote transmission request */
+                id |= CAN_RTR_FLAG;
+
+        if (priv->filter_mode != FILTER_CLOSE)
+                priv->xstats.hw_filter_accepted++;
+
+        /* every frame off the bus counts, also those the filter bank drops */
+        if (priv->id_stats)
+                sunxi_can_id_stat_update(priv, id, (id & CAN_RTR_FLAG) ? 0 : get_can_dlc(fi & 0x0F));
+
+        rcu_read_lock();
+        ids = rcu_dereference(priv->rx_ids);
+        if (ids) {
+                range = sunxi_can_id_lookup(ids, id);
+                if (range)
+                        range->hits++;
+        }
+        rcu_read_unlock();
+
+        if (ids && !range) {
+                priv->xstats.sw_filter_rejected++;
+                return NULL;
+        }
+
+        /* create zero'ed CAN frame buffer */
+        skb = sunxi_can_pool_get(dev, &cf);
+        if (skb == NULL) {
+                priv->xstats.rx_alloc_failed++;
+                stats->rx_dropped++;
+                return NULL;
+        }
+
+        if (fetch_data)
+                sunxi_can_rx_fetch_data(priv, win);
+
+        cf->can_id = id;
+        cf->can_dlc = get_can_dlc(fi & 0x0F);
+        if (!(id & CAN_RTR_FLAG)) {
+                for (i = 0; i < cf->can_dlc; i++)
+                        cf->data[i] = data[i];
+        }
+
+        stats->rx_packets++;
+        stats->rx_bytes += cf->can_dlc;
+
+        if (unlikely(priv->bench.active) && id == priv->bench.can_id)
+                sunxi_can_bench_rx(priv, cf);
+
+        return skb;
+}
+
+/*
+* read one frame from the RX FIFO, turn it into an skb and release it
+* the per-register path reads the data only of frames that pass the filter
+*/
+static struct sk_buff *sunxi_can_rx(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        u32 win[SUNXI_CAN_BUF_WINDOW];
+        bool head_only = !ACCESS_ONCE(rx_fast_decode);
+        struct sk_buff *skb;
+
+        sunxi_can_rx_fetch(priv, win, head_only);
+        skb = sunxi_can_rx_frame(dev, win, head_only);
+
+        /* release receive buffer */
+        sunxi_can_write_cmdreg(priv, RELEASE_RBUF);
+        priv->xstats.rx_mmio_writes++;
+
+        return skb;
+}
+
+/* time from the RX interrupt to handing the first frame to the stack */
+static void sunxi_can_rx_irq_latency(struct sunxi_can_priv *priv, s64 irq_ns)
+{
+        s64 lat = ktime_to_ns(ktime_get()) - irq_ns;
+
+        if (lat > priv->xstats.rx_irq_latency_max_ns)
+                priv->xstats.rx_irq_latency_max_ns = lat;
+}
+
+/*
+* drain up to quota frames from the RX FIFO
+* CAN_RMCNT_ADDR is read once per pass instead of checking RBUF_RDY and
+* the controller's presence after every frame; the frames of a pass are
+* handed up together once the FIFO slots are released
+*/
+static int sunxi_can_rx_drain(struct net_device *dev, int quota, bool napi)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sk_buff *batch[SUNXI_CAN_RX_BATCH];
+        int work_done = 0, pending, n, i;
+
+        while (work_done < quota) {
+                pending = sunxi_can_rx_readl(priv, CAN_RMCNT_ADDR) & 0xFF;
+                if (!pending)
+                        break;
+
+                /* check for absent controller due to hw unplug */
+                priv->xstats.rx_mmio_reads++;
+                if (sunxi_can_is_absent(priv))
+                        break;
+
+                pending = min3(pending, quota - work_done, SUNXI_CAN_RX_BATCH);
+                for (i = 0, n = 0; i < pending; i++) {
+                        batch[n] = sunxi_can_rx(dev);
+                        if (batch[n])
+                                n++;
+                }
+                work_done += pending;
+                priv->xstats.rx_drained += pending;
+                priv->xstats.rx_passes++;
+                if (pending > priv->xstats.rx_pass_max)
+                        priv->xstats.rx_pass_max = pending;
+
+                if (n && priv->rx_irq_ns) {
+                        sunxi_can_rx_irq_latency(priv, priv->rx_irq_ns);
+                        priv->rx_irq_ns = 0;
+                }
+
+                for (i = 0; i < n; i++) {
+                        if (napi)
+                                netif_receive_skb(batch[i]);
+                        else
+                                netif_rx(batch[i]);
+                }
+        }
+
+        return work_done;
+}
+
+/*
+* RX record ring, rx_ring_len > 0
+* the hard interrupt handler only copies the frame window of each frame in
+* the RX FIFO into rx_recs and releases the FIFO slot; the NAPI poll turns
+* the records into skbs. The ring has a single producer, the hard handler,
+* and a single consumer, the poll, and needs no lock.
+* When the ring is full the producer stops and masks RX interrupts, and
+* when RX is polled from poll_timer it does not run at all; in both cases
+* the poll empties the ring and then reads the FIFO itself.
+*/
+static inline bool sunxi_can_rx_ring_stopped(struct sunxi_can_priv *priv)
+{
+        return priv->rx_recs_full || priv->hrpoll;
+}
+
+static void sunxi_can_rx_ring_fill(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned int head = priv->rx_head;
+        unsigned int tail = ACCESS_ONCE(priv->rx_tail);
+        struct sunxi_can_rx_rec *rec;
+        s64 now;
+        int pending, n = 0;
+
+        if (sunxi_can_rx_ring_stopped(priv)) {
+                /* RX was unmasked meanwhile, leave the FIFO to the poll */
+                sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+                napi_schedule(&priv->napi);
+                return;
+        }
+
+        /* the records carry the interrupt time from here on */
+        now = priv->rx_irq_ns ? priv->rx_irq_ns : ktime_to_ns(ktime_get());
+        priv->rx_irq_ns = 0;
+
+        pending = sunxi_can_rx_readl(priv, CAN_RMCNT_ADDR) & 0xFF;
+        for (; n < pending; n++, head++) {
+                if (head - tail == priv->rx_recs_len) {
+                        priv->rx_recs_full = true;
+                        sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+                        break;
+                }
+
+                rec = &priv->rx_recs[head & (priv->rx_recs_len - 1)];
+                sunxi_can_rx_fetch(priv, rec->win, false);
+                sunxi_can_write_cmdreg(priv, RELEASE_RBUF);
+                priv->xstats.rx_mmio_writes++;
+                rec->irq_ns = now;
+
+                /* publish the record after its contents */
+                smp_wmb();
+                priv->rx_head = head + 1;
+        }
+
+        if (n) {
+                priv->xstats.rx_drained += n;
+                priv->xstats.rx_passes++;
+                if (n > priv->xstats.rx_pass_max)
+                        priv->xstats.rx_pass_max = n;
+        }
+
+        napi_schedule(&priv->napi);
+}
+
+static int sunxi_can_rx_ring_consume(struct net_device *dev, int quota)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned int tail = priv->rx_tail;
+        unsigned int head = ACCESS_ONCE(priv->rx_head);
+        struct sunxi_can_rx_rec *rec;
+        struct sk_buff *skb;
+        int work_done = 0;
+
+        /* read the records only after seeing them published */
+        smp_rmb();
+
+        for (; work_done < quota && tail != head; work_done++, tail++) {
+                rec = &priv->rx_recs[tail & (priv->rx_recs_len - 1)];
+                if (!work_done)
+                        sunxi_can_rx_irq_latency(priv, rec->irq_ns);
+                skb = sunxi_can_rx_frame(dev, rec->win, false);
+
+                /* hand the slot back once the record is consumed */
+                smp_mb();
+                priv->rx_tail = tail + 1;
+
+                if (skb)
+                        netif_receive_skb(skb);
+        }
+
+        return work_done;
+}
+
+/*
+* restart the producer after a poll round; the poll is rescheduled for
+* records published after the ring was emptied, and for frames left in
+* the FIFO while the producer was stopped
+*/
+static void sunxi_can_rx_ring_complete(struct sunxi_can_priv *priv)
+{
+        struct napi_struct *napi = &priv->napi;
+        bool again = false;
+
+        if (priv->rx_recs_full) {
+                priv->rx_recs_full = false;
+                smp_wmb();
+                sunxi_can_update_inten(priv, 0, RX_IRQ_EN);
+                priv->xstats.rx_mmio_reads++;
+                if (sunxi_can_read(priv, CAN_STA_ADDR) & RBUF_RDY) {
+                        /* read them from the poll, in order after the ring */
+                        priv->rx_recs_full = true;
+                        sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+                        again = true;
+                }
+        }
+
+        if (ACCESS_ONCE(priv->rx_head) != priv->rx_tail)
+                again = true;
+
+        if (again && napi_schedule_prep(napi))
+                __napi_schedule(napi);
+}
+
+static int sunxi_can_poll(struct napi_struct *napi, int quota)
+{
+        struct sunxi_can_priv *priv = container_of(napi, struct sunxi_can_priv, napi);
+        struct net_device *dev = priv->dev;
+        bool bench = priv->bench.active;
+        ktime_t start = ktime_set(0, 0);
+        int work_done;
+
+        if (unlikely(bench))
+                start = ktime_get();
+
+        if (priv->rx_recs) {
+                work_done = sunxi_can_rx_ring_consume(dev, quota);
+                if (sunxi_can_rx_ring_stopped(priv) && work_done < quota)
+                        work_done += sunxi_can_rx_drain(dev, quota - work_done, true);
+        } else {
+                work_done = sunxi_can_rx_drain(dev, quota, true);
+        }
+
+        if (work_done < quota) {
+                napi_complete(napi);
+
+                /* while polling, poll_timer schedules the next round */
+                if (!priv->hrpoll && priv->rx_recs) {
+                        sunxi_can_rx_ring_complete(priv);
+                } else if (!priv->hrpoll) {
+                        priv->rx_napi_masked = false;
+                        sunxi_can_update_inten(priv, 0, RX_IRQ_EN);
+
+                        /* a frame may have arrived while RX interrupts were masked */
+                        priv->xstats.rx_mmio_reads++;
+                        if ((sunxi_can_read(priv, CAN_STA_ADDR) & RBUF_RDY) && napi_schedule_prep(napi)) {
+                                priv->rx_napi_masked = true;
+                                sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+                                __napi_schedule(napi);
+                        }
+                }
+        }
+
+        if (unlikely(bench))
+                priv->bench.result.poll_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+        return work_done;
+}
+
+/*
+* bus error storm guard
+* more than berr_storm_rate bus error interrupts per second clear
+* BERR_IRQ_EN; berr_timer sets it again after berr_backoff_ms, doubled
+* (up to SUNXI_CAN_BERR_BACKOFF_MAX_MS) for each storm that starts again
+* within twice the previous throttle time. The interrupts missed while
+* throttled are estimated from the rate that tripped the guard.
+* returns true when this bus error started throttling
+*/
+static bool sunxi_can_berr_storm(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned long now = jiffies;
+        unsigned long elapsed;
+
+        if (!berr_storm_rate || priv->berr_throttled)
+                return false;
+
+        if (time_after_eq(now, priv->berr_window + SUNXI_CAN_BERR_WINDOW)) {
+                priv->berr_window = now;
+                priv->berr_count = 0;
+        }
+        priv->berr_count++;
+
+        elapsed = max_t(unsigned long, now - priv->berr_window, 1);
+        if ((u64)priv->berr_count * HZ < (u64)berr_storm_rate * SUNXI_CAN_BERR_WINDOW)
+                return false;
+
+        priv->berr_rate = div_u64((u64)priv->berr_count * HZ, elapsed);
+        if (priv->berr_backoff_ms && priv->berr_rearmed &&
+            time_before(now, priv->berr_rearmed + 2 * msecs_to_jiffies(priv->berr_backoff_ms)))
+                priv->berr_backoff_ms = min_t(unsigned int, priv->berr_backoff_ms * 2,
+                                              SUNXI_CAN_BERR_BACKOFF_MAX_MS);
+        else
+                priv->berr_backoff_ms = max_t(unsigned int, berr_backoff_ms, 1);
+
+        priv->berr_throttled = true;
+        priv->berr_masked = now;
+        priv->xstats.berr_storms++;
+        sunxi_can_update_inten(priv, BERR_IRQ_EN, 0);
+        mod_timer(&priv->berr_timer, now + msecs_to_jiffies(priv->berr_backoff_ms));
+
+        return true;
+}
+
+static void sunxi_can_berr_timer(unsigned long data)
+{
+        struct net_device *dev = (struct net_device *)data;
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned long masked = jiffies - priv->berr_masked;
+
+        priv->xstats.berr_suppressed += div_u64((u64)priv->berr_rate * masked, HZ);
+        priv->berr_throttled = false;
+        priv->berr_rearmed = jiffies;
+        priv->berr_window = jiffies;
+        priv->berr_count = 0;
+        if (priv->can.ctrlmode & CAN_CTRLMODE_BERR_REPORTING)
+                sunxi_can_update_inten(priv, 0, BERR_IRQ_EN);
+}
+
+/*
+* bus-off recovery
+* with an automatic restart configured (restart-ms) and busoff_fast_recovery
+* set, bus-off does not go through can_bus_off() and the restart timer:
+* the TX ring is halted, keeping the aborted frame and everything queued,
+* and the recovery sequence is started right away with BUS_OFF_REQ and by
+* leaving reset mode; the controller returns to error active after 128
+* occurrences of 11 recessive bits and signals it with an error warning
+* interrupt, where transmission resumes. The carrier stays on, so the
+* stack keeps its queue as well.
+* returns true if the driver handles the bus-off
+*/
+static bool sunxi_can_busoff_recover(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        if (!busoff_fast_recovery || !priv->can.restart_ms)
+                return false;
+
+        if (!priv->busoff_recovering) {
+                priv->busoff_recovering = true;
+                priv->busoff_ns = ktime_to_ns(ktime_get());
+                priv->can.can_stats.bus_off++;
+                sunxi_can_tx_halt(dev);
+        }
+
+        sunxi_can_write_cmdreg(priv, BUS_OFF_REQ);
+        sunxi_can_update_msel(priv, RESET_MODE, 0);
+
+        return true;
+}
+
+static void sunxi_can_busoff_done(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        u64 lat = ktime_to_ns(ktime_get()) - priv->busoff_ns;
+        unsigned int i;
+
+        priv->busoff_recovering = false;
+        priv->can.can_stats.restarts++;
+        priv->xstats.busoff_recoveries++;
+
+        priv->busoff_last_ns = lat;
+        if (lat > priv->busoff_max_ns)
+                priv->busoff_max_ns = lat;
+        for (i = 0; i < SUNXI_CAN_BUSOFF_HIST - 1; i++) {
+                if (lat < ((u64)NSEC_PER_MSEC << i))
+                        break;
+        }
+        priv->busoff_hist[i]++;
+
+        sunxi_can_tx_resume(dev);
+}
+
+/*
+* error frame coalescing
+* error events are merged into err_acc and sent as one error frame per
+* err_coalesce_ms; events that change the controller state are sent at
+* once, together with whatever is pending. The flags of all merged events
+* are or'ed, the error location and counters are those of the latest
+* event, and data[5] (controller specific) holds the number of merged
+* events when there is more than one, saturated at 255.
+* takes the pending summary into cf, must be called with err_lock held;
+* returns the number of events merged into it, 0 if nothing is pending
+*/
+static unsigned int sunxi_can_err_take(struct net_device *dev, struct can_frame *cf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_err_acc *acc = &priv->err_acc;
+        unsigned int events = acc->events;
+
+        if (!events)
+                return 0;
+
+        *cf = acc->cf;
+        if (events > 1)
+                cf->data[5] = min_t(unsigned int, events, 0xFF);
+
+        memset(acc, 0, offsetof(struct sunxi_can_err_acc, last));
+        acc->last = jiffies;
+
+        return events;
+}
+
+/*
+* hand an error summary to the stack, called after dropping err_lock:
+* the skb pool may schedule its refill
+*/
+static void sunxi_can_err_send(struct net_device *dev, const struct can_frame *summary,
+                               unsigned int events)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct net_device_stats *stats = &dev->stats;
+        struct can_frame *cf;
+        struct sk_buff *skb;
+
+        skb = sunxi_can_pool_get_err(dev, &cf);
+        if (!skb) {
+                priv->xstats.err_alloc_failed++;
+                return;
+        }
+
+        *cf = *summary;
+        stats->rx_packets++;
+        stats->rx_bytes += cf->can_dlc;
+        priv->xstats.err_frames++;
+        priv->xstats.err_coalesced += events - 1;
+
+        netif_rx(skb);
+}
+
+static void sunxi_can_err_post(struct net_device *dev, const struct can_frame *ev, bool urgent)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_err_acc *acc = &priv->err_acc;
+        unsigned long interval = msecs_to_jiffies(err_coalesce_ms);
+        struct can_frame summary;
+        unsigned int events = 0;
+        unsigned long flags;
+        int i;
+
+        raw_spin_lock_irqsave(&priv->err_lock, flags);
+
+        if (!acc->events) {
+                acc->cf.can_id = CAN_ERR_FLAG;
+                acc->cf.can_dlc = CAN_ERR_DLC;
+        }
+        acc->cf.can_id |= ev->can_id;
+        for (i = 1; i <= 2; i++)
+                acc->cf.data[i] |= ev->data[i];
+        if (ev->can_id & CAN_ERR_LOSTARB) {
+                acc->cf.data[0] = ev->data[0];
+                acc->arb_lost++;
+                priv->xstats.err_arb_lost++;
+        }
+        if (ev->can_id & CAN_ERR_PROT) {
+                acc->cf.data[3] = ev->data[3];
+                acc->bus_errors++;
+                priv->xstats.err_bus_errors++;
+        }
+        if (ev->data[1] & CAN_ERR_CRTL_RX_OVERFLOW) {
+                acc->overruns++;
+                priv->xstats.err_overruns++;
+        }
+        if (ev->data[6] || ev->data[7]) {
+                acc->cf.data[6] = ev->data[6];
+                acc->cf.data[7] = ev->data[7];
+        }
+        acc->events++;
+        priv->xstats.err_events++;
+
+        if (urgent || !interval || time_after_eq(jiffies, acc->last + interval))
+                events = sunxi_can_err_take(dev, &summary);
+        else if (!timer_pending(&priv->err_timer))
+                mod_timer(&priv->err_timer, acc->last + interval);
+
+        raw_spin_unlock_irqrestore(&priv->err_lock, flags);
+
+        if (events)
+                sunxi_can_err_send(dev, &summary, events);
+}
+
+static void sunxi_can_err_timer(unsigned long data)
+{
+        struct net_device *dev = (struct net_device *)data;
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct can_frame summary;
+        unsigned int events;
+        unsigned long flags;
+
+        raw_spin_lock_irqsave(&priv->err_lock, flags);
+        events = sunxi_can_err_take(dev, &summary);
+        raw_spin_unlock_irqrestore(&priv->err_lock, flags);
+
+        if (events)
+                sunxi_can_err_send(dev, &summary, events);
+}
+
+static int sunxi_can_err(struct net_device *dev, uint8_t isrc, uint8_t status)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct net_device_stats *stats = &dev->stats;
+        struct can_frame ev = { .can_id = CAN_ERR_FLAG, .can_dlc = CAN_ERR_DLC };
+        struct can_frame *cf = &ev;
+        enum can_state state = priv->can.state;
+        bool urgent = false;
+        uint32_t ecc, alc;
+
+        if (isrc & DATA_ORUNI) {
+                /* data overrun interrupt */
+                netdev_dbg(dev, "data overrun interrupt\n");
+                cf->can_id |= CAN_ERR_CRTL;
+                cf->data[1] = CAN_ERR_CRTL_RX_OVERFLOW;
                 stats->rx_over_errors++;
                 stats->rx_errors++;
                 sunxi_can_write_cmdreg(priv, CLEAR_DOVERRUN);        /* clear bit */
+                /* the poll period was too long for this traffic */
+                if (priv->hrpoll)
+                        priv->poll_period_ns = max_t(u64, priv->poll_period_ns / 2,
+                                                     SUNXI_CAN_HRPOLL_PERIOD_MIN_NS);
+        }
+
+        if (isrc & ERR_WRN) {
+                /* error warning interrupt */
+                netdev_dbg(dev, "error warning interrupt\n");
+
+                if (status & BUS_OFF) {
+                        state = CAN_STATE_BUS_OFF;
+                        cf->can_id |= CAN_ERR_BUSOFF;
+                        if (!sunxi_can_busoff_recover(dev)) {
+                                /* the controller is in reset mode now */
+                                sunxi_can_tx_halt(dev);
+                                can_bus_off(dev);
+                        }
+                } else if (status & ERR_STA) {
+                        state = CAN_STATE_ERROR_WARNING;
+                } else
+                        state = CAN_STATE_ERROR_ACTIVE;
+        }
+        if (isrc & BUS_ERR) {
+                /* bus error interrupt */
+                priv->can.can_stats.bus_error++;
+                stats->rx_errors++;
+
+                ecc = sunxi_can_read(priv, CAN_STA_ADDR);
+
+                cf->can_id |= CAN_ERR_PROT | CAN_ERR_BUSERROR;
+
+                if(ecc & BIT_ERR)
+                        cf->data[2] |= CAN_ERR_PROT_BIT;
+                else if (ecc & FORM_ERR)
+                        cf->data[2] |= CAN_ERR_PROT_FORM;
+                else if (ecc & STUFF_ERR)
+                        cf->data[2] |= CAN_ERR_PROT_STUFF;
+                else {
+                        cf->data[2] |= CAN_ERR_PROT_UNSPEC;
+                        cf->data[3] = (ecc & ERR_SEG_CODE) >> 16;
+                }
+                /* Error occurred during transmission? */
+                if ((ecc & ERR_DIR) == 0)
+                        cf->data[2] |= CAN_ERR_PROT_TX;
+
+                /* report the storm once, when bus error interrupts get throttled */
+                if (sunxi_can_berr_storm(dev)) {
+                        netdev_warn(dev, "bus error storm, bus error interrupts off for %u ms\n",
+                                    priv->berr_backoff_ms);
+                        cf->data[2] |= CAN_ERR_PROT_OVERLOAD;
+                        urgent = true;
+                }
+        }
+        if (isrc & ERR_PASSIVE) {
+                /* error passive interrupt */
+                netdev_dbg(dev, "error passive interrupt\n");
+                if (status & ERR_STA)
+                        state = CAN_STATE_ERROR_PASSIVE;
+                else
+                        state = CAN_STATE_ERROR_ACTIVE;
+        }
+        if (isrc & ARB_LOST) {
+                /* arbitration lost interrupt */
+                netdev_dbg(dev, "arbitration lost interrupt\n");
+                alc = sunxi_can_read(priv, CAN_STA_ADDR);
+                priv->can.can_stats.arbitration_lost++;
+                stats->tx_errors++;
+                cf->can_id |= CAN_ERR_LOSTARB;
+                cf->data[0] = (alc & 0x1f) >> 8;
+        }
+
+        if (state != priv->can.state && (state == CAN_STATE_ERROR_WARNING ||
+                                         state == CAN_STATE_ERROR_PASSIVE)) {
+                uint8_t rxerr = (sunxi_can_read(priv, CAN_ERRC_ADDR) >> 16) & 0xFF;
+                uint8_t txerr = sunxi_can_read(priv, CAN_ERRC_ADDR) & 0xFF;
+                cf->can_id |= CAN_ERR_CRTL;
+                if (state == CAN_STATE_ERROR_WARNING) {
+                        priv->can.can_stats.error_warning++;
+                        cf->data[1] = (txerr > rxerr) ?
+                                CAN_ERR_CRTL_TX_WARNING :
+                                CAN_ERR_CRTL_RX_WARNING;
+                } else {
+                        priv->can.can_stats.error_passive++;
+                        cf->data[1] = (txerr > rxerr) ?
+                                CAN_ERR_CRTL_TX_PASSIVE :
+                                CAN_ERR_CRTL_RX_PASSIVE;
+                }
+                cf->data[6] = txerr;
+                cf->data[7] = rxerr;
+        }
+
+        if (priv->busoff_recovering && state != CAN_STATE_BUS_OFF) {
+                sunxi_can_busoff_done(dev);
+                cf->can_id |= CAN_ERR_RESTARTED;
+        }
+
+        if (state != priv->can.state || state == CAN_STATE_BUS_OFF)
+                urgent = true;
+        priv->can.state = state;
+
+        /* the skb is only allocated when there is something to report */
+        if (cf->can_id != CAN_ERR_FLAG)
+                sunxi_can_err_post(dev, cf, urgent);
+
+        return 0;
+}
+
+/* account one ISR loop iteration with interrupt flags isrc */
+static void sunxi_can_count_irq(struct sunxi_can_priv *priv, uint8_t isrc)
+{
+        int i;
+
+        /* INT, STA and MSEL read, INT written back and read again */
+        priv->xstats.isr_mmio_reads += 4;
+        priv->xstats.isr_mmio_writes++;
+
+        for (i = 0; i < ARRAY_SIZE(priv->xstats.irq_src); i++) {
+                if (isrc & (1 << i))
+                        priv->xstats.irq_src[i]++;
+        }
+}
+
+/* RX masked, the NAPI poll receives the rest */
+static void sunxi_can_rx_defer(struct sunxi_can_priv *priv)
+{
+        priv->xstats.isr_deferrals++;
+        priv->rx_napi_masked = true;
+        sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+        napi_schedule(&priv->napi);
+}
+
+/*
+* receive in the ISR when NAPI is not used
+* at most isr_budget frames are read per interrupt, and none once the
+* ISR used up its time; the rest is deferred to the NAPI poll. The budget
+* follows the RMCNT backlog found on entry: it grows by one while the
+* backlog fits and is halved when it does not, so a flood is pushed to
+* softirq context quickly while short bursts are still handled here
+*/
+static void sunxi_can_rx_isr(struct net_device *dev, s64 deadline)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        unsigned int budget = priv->isr_budget;
+        unsigned int backlog;
+
+        backlog = sunxi_can_rx_readl(priv, CAN_RMCNT_ADDR) & 0xFF;
+        if (backlog <= budget)
+                priv->isr_budget = min(budget + 1, priv->isr_budget_max);
+        else
+                priv->isr_budget = max(budget / 2, priv->isr_budget_min);
+
+        if (ktime_to_ns(ktime_get()) >= deadline ||
+            sunxi_can_rx_drain(dev, budget, false) >= budget)
+                sunxi_can_rx_defer(priv);
+}
+
+/*
+* hybrid interrupt/hrtimer RX
+* once RX interrupts come in faster than hrpoll_irq_rate, they are masked
+* and poll_timer schedules the NAPI poll instead, every poll_period_ns.
+* Unless set by hrpoll_period_us, the period is half the time the bus
+* needs to fill the RX FIFO with the densest frames, and it is halved
+* again on every data overrun. Polling stops when the frame rate drops
+* below half of hrpoll_irq_rate.
+*/
+static u64 sunxi_can_hrpoll_period(struct sunxi_can_priv *priv)
+{
+        u32 bitrate = priv->can.bittiming.bitrate;
+
+        if (hrpoll_period_us)
+                return (u64)hrpoll_period_us * NSEC_PER_USEC;
+        if (!bitrate)
+                bitrate = 1000000;
+
+        return max_t(u64, div_u64((u64)SUNXI_CAN_RX_FIFO_BYTES * SUNXI_CAN_RX_FIFO_BITS_PER_BYTE *
+                                  NSEC_PER_SEC / 2, bitrate),
+                     SUNXI_CAN_HRPOLL_PERIOD_MIN_NS);
+}
+
+/* events per second since the start of the rate window, 0 until it is over */
+static unsigned long sunxi_can_rate(struct sunxi_can_priv *priv, unsigned long count, s64 now)
+{
+        s64 elapsed = now - priv->rate_window_ns;
+        unsigned long rate;
+
+        if (elapsed < SUNXI_CAN_HRPOLL_WINDOW_NS)
+                return 0;
+
+        rate = div64_u64((u64)(count - priv->rate_count) * NSEC_PER_SEC, elapsed);
+        priv->rate_window_ns = now;
+        priv->rate_count = count;
+
+        return rate ? rate : 1;
+}
+
+/*
+* account an RX interrupt, called from hard interrupt context
+* not in threaded_irq mode, where the IRQ thread owns the RX FIFO, nor
+* without NAPI, where the ISR does
+*/
+static void sunxi_can_rx_irq_rate(struct sunxi_can_priv *priv)
+{
+        s64 now = ktime_to_ns(ktime_get());
+        unsigned long rate;
+
+        priv->rx_irq_count++;
+        rate = sunxi_can_rate(priv, priv->rx_irq_count, now);
+        if (!hrpoll_irq_rate || rate <= hrpoll_irq_rate)
+                return;
+
+        priv->hrpoll = true;
+        priv->xstats.rx_poll_switches++;
+        priv->poll_period_ns = sunxi_can_hrpoll_period(priv);
+        priv->rate_count = priv->xstats.rx_drained;
+        sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+        hrtimer_start(&priv->poll_timer, ns_to_ktime(priv->poll_period_ns), HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart sunxi_can_poll_timer(struct hrtimer *timer)
+{
+        struct sunxi_can_priv *priv = container_of(timer, struct sunxi_can_priv, poll_timer);
+        s64 now = ktime_to_ns(ktime_get());
+        unsigned long rate;
+
+        rate = sunxi_can_rate(priv, priv->xstats.rx_drained, now);
+        if (!hrpoll_irq_rate || (rate && rate < hrpoll_irq_rate / 2)) {
+                priv->hrpoll = false;
+                priv->rx_napi_masked = false;
+                priv->xstats.rx_poll_switches++;
+                priv->rate_count = priv->rx_irq_count;
+                smp_wmb();
+                sunxi_can_update_inten(priv, 0, RX_IRQ_EN);
+                if (sunxi_can_read(priv, CAN_STA_ADDR) & RBUF_RDY)
+                        napi_schedule(&priv->napi);
+                return HRTIMER_NORESTART;
+        }
+
+        priv->xstats.rx_mmio_reads++;
+        if (sunxi_can_read(priv, CAN_STA_ADDR) & RBUF_RDY)
+                napi_schedule(&priv->napi);
+
+        hrtimer_forward_now(timer, ns_to_ktime(priv->poll_period_ns));
+
+        return HRTIMER_RESTART;
+}
+
+/* remember when the oldest frame not yet handed up was signalled */
+static inline void sunxi_can_stamp_rx_irq(struct sunxi_can_priv *priv, uint8_t isrc)
+{
+        if ((isrc & RBUF_VLD) && !priv->rx_irq_ns)
+                priv->rx_irq_ns = ktime_to_ns(ktime_get());
+}
+
+/*
+* interrupt work, in the hard interrupt handler or the IRQ thread
+* the IRQ thread is preemptible, so it has no time budget and receives
+* the frames itself instead of deferring them to the NAPI poll
+*/
+static irqreturn_t sunxi_can_handle_irq(struct net_device *dev, bool threaded)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        bool bench = priv->bench.active;
+        ktime_t start = ktime_get();
+        s64 deadline = KTIME_MAX;
+        uint8_t isrc, status;
+        int n = 0;
+
+        if (priv->isr_time_budget_us && !threaded)
+                deadline = ktime_to_ns(start) + (s64)priv->isr_time_budget_us * NSEC_PER_USEC;
+
+        while ((isrc = sunxi_can_read(priv, CAN_INT_ADDR)) && (n < SUNXI_CAN_MAX_IRQ)) {
+                if (n && ktime_to_ns(ktime_get()) >= deadline)
+                        break;
+                n++;
+                status = sunxi_can_read(priv, CAN_STA_ADDR);
+                /* check for absent controller due to hw unplug */
+                if (sunxi_can_is_absent(priv))
+                        return IRQ_NONE;
+
+                sunxi_can_count_irq(priv, isrc);
+
+                if (isrc & WAKEUP)
+                        netdev_warn(dev, "wakeup interrupt\n");
+
+                if (isrc & TBUF_VLD) {
+			pr_debug("sunxicanirq: Tx irq, reg=0x%X\n", isrc);
+                        /* transmission complete interrupt */
+                        sunxi_can_tx_done(dev);
+                }
+                if (isrc & RBUF_VLD) {
+			pr_debug("sunxicanirq: Rx irq, reg=0x%X\n", isrc);
+                        /* receive interrupt */
+                        sunxi_can_stamp_rx_irq(priv, isrc);
+                        if (!threaded && use_napi)
+                                sunxi_can_rx_irq_rate(priv);
+                        if (threaded) {
+                                sunxi_can_rx_drain(dev, INT_MAX, true);
+                        } else if (priv->rx_recs) {
+                                sunxi_can_rx_ring_fill(dev);
+                        } else if (use_napi) {
+                                /* mask RX interrupts until the poll drained the FIFO */
+                                priv->rx_napi_masked = true;
+                                sunxi_can_update_inten(priv, RX_IRQ_EN, 0);
+                                napi_schedule(&priv->napi);
+                        } else {
+                                sunxi_can_rx_isr(dev, deadline);
+                        }
+                }
+                if (isrc & (DATA_ORUNI | ERR_WRN | BUS_ERR | ERR_PASSIVE | ARB_LOST)) {
+			pr_debug("sunxicanirq: error, reg=0x%X\n", isrc);
+                        /* error interrupt */
+                        if (sunxi_can_err(dev, isrc, status))
+                                break;
+                }
+
+                //clear the interrupt
+                sunxi_can_write(priv, isrc, CAN_INT_ADDR);
+                sunxi_can_read(priv, CAN_INT_ADDR);
+        }
+
+        /* the INT read ending the loop */
+        priv->xstats.isr_mmio_reads++;
+        if (unlikely(shadow_check) && n)
+                sunxi_can_check_shadows(dev);
+        if (n) {
+                priv->xstats.isr_calls++;
+                priv->xstats.isr_loops += n;
+        }
+
+        if (isrc) {
+                priv->xstats.isr_budget_exhausted++;
+                netdev_dbg(dev, "%d messages handled in ISR", n);
+        }
+
+        if (unlikely(bench))
+                priv->bench.result.isr_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+        return (n) ? IRQ_HANDLED : IRQ_NONE;
+}
+
+irqreturn_t sunxi_can_interrupt(int irq, void *dev_id)
+{
+        return sunxi_can_handle_irq((struct net_device *)dev_id, false);
+}
+EXPORT_SYMBOL_GPL(sunxi_can_interrupt);
+
+/*
+* hard handler of threaded_irq mode: only check that the interrupt is
+* ours; IRQF_ONESHOT keeps the line masked until the thread acked the
+* interrupt sources
+*/
+static irqreturn_t sunxi_can_hardirq(int irq, void *dev_id)
+{
+        struct net_device *dev = (struct net_device *)dev_id;
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        uint8_t isrc = sunxi_can_read(priv, CAN_INT_ADDR);
+
+        if (!isrc || sunxi_can_is_absent(priv))
+                return IRQ_NONE;
+
+        /*
+        * no switch to hrtimer polling here: the IRQ thread drains the RX
+        * FIFO itself and must not race with the NAPI poll over it
+        */
+        sunxi_can_stamp_rx_irq(priv, isrc);
+
+        return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t sunxi_can_irq_thread(int irq, void *dev_id)
+{
+        struct net_device *dev = (struct net_device *)dev_id;
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sched_param param = {
+                .sched_priority = clamp(irq_thread_prio, 1, MAX_USER_RT_PRIO - 1),
+        };
+
+        if (param.sched_priority != priv->irq_thread_prio &&
+            !sched_setscheduler(current, SCHED_FIFO, &param))
+                priv->irq_thread_prio = param.sched_priority;
+
+        /* the stack expects frames and echoes from softirq context */
+        local_bh_disable();
+        sunxi_can_handle_irq(dev, true);
+        local_bh_enable();
+
+        return IRQ_HANDLED;
+}
+
+static int sunxi_can_open(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        int err;
+
+        /* set chip into reset mode */
+        set_reset_mode(dev, true);
+
+        priv->tx_ring_len = clamp_t(unsigned int, tx_ring_len, 1, SUNXI_CAN_TX_RING_MAX);
+        /* one spare slot for a frame requeued after an abort */
+        priv->tx_ring = kcalloc(priv->tx_ring_len + 1, sizeof(*priv->tx_ring), GFP_KERNEL);
+        if (!priv->tx_ring)
+                return -ENOMEM;
+
+        err = sunxi_can_pool_init(dev);
+        if (err)
+                goto exit_free_ring;
+
+        /* the ring hands frames to the NAPI poll */
+        priv->rx_recs_len = (rx_ring_len && use_napi) ?
+                roundup_pow_of_two(min_t(unsigned int, rx_ring_len, SUNXI_CAN_RX_RING_MAX)) : 0;
+        priv->rx_head = 0;
+        priv->rx_tail = 0;
+        priv->rx_recs_full = false;
+        if (priv->rx_recs_len) {
+                priv->rx_recs = kcalloc(priv->rx_recs_len, sizeof(*priv->rx_recs), GFP_KERNEL);
+                if (!priv->rx_recs) {
+                        err = -ENOMEM;
+                        goto exit_free_ring;
+                }
         }
 
-        if (isrc & ERR_WRN) {
-                /* error warning interrupt */
-                netdev_dbg(dev, "error warning interrupt\n");
+        /* the first error event is sent right away; jiffies starts below 0 */
+        priv->err_acc.last = jiffies - msecs_to_jiffies(err_coalesce_ms);
+        priv->berr_window = jiffies;
+        priv->berr_count = 0;
 
-                if (status & BUS_OFF) {
-                        state = CAN_STATE_BUS_OFF;
-                        cf->can_id |= CAN_ERR_BUSOFF;
-                        can_bus_off(dev);
-                } else if (status & ERR_STA) {
-                        state = CAN_STATE_ERROR_WARNING;
-                } else
-                        state = CAN_STATE_ERROR_ACTIVE;
+        /* common open */
+        err = open_candev(dev);
+        if (err)
+                goto exit_free_ring;
+
+        napi_enable(&priv->napi);
+
+        /* register interrupt handler, if not done by the device driver */
+        if (!(priv->flags & SUNXI_CAN_CUSTOM_IRQ_HANDLER)) {
+                if (threaded_irq) {
+                        priv->irq_thread_prio = 0;
+                        err = request_threaded_irq(dev->irq, sunxi_can_hardirq,
+                                                   sunxi_can_irq_thread,
+                                                   priv->irq_flags | IRQF_ONESHOT,
+                                                   dev->name, (void *)dev);
+                } else {
+                        err = request_irq(dev->irq, sunxi_can_interrupt, priv->irq_flags,
+                                         dev->name, (void *)dev);
+                }
+                if (err) {
+                        napi_disable(&priv->napi);
+                        close_candev(dev);
+                        pr_info("request_irq err:%d\n", err);
+                        err = -EAGAIN;
+                        goto exit_free_ring;
+                }
         }
-        if (isrc & BUS_ERR) {
-                /* bus error interrupt */
-                priv->can.can_stats.bus_error++;
-                stats->rx_errors++;
 
-                ecc = readl(CAN_STA_ADDR);
+        /* init and start chi */
+        sunxi_can_start(dev, true);
+        priv->open_time = jiffies;
 
-                cf->can_id |= CAN_ERR_PROT | CAN_ERR_BUSERROR;
+        netif_start_queue(dev);
 
-                if(ecc & BIT_ERR)
-                        cf->data[2] |= CAN_ERR_PROT_BIT;
-                else if (ecc & FORM_ERR)
-                        cf->data[2] |= CAN_ERR_PROT_FORM;
-                else if (ecc & STUFF_ERR)
-                        cf->data[2] |= CAN_ERR_PROT_STUFF;
-                else {
-                        cf->data[2] |= CAN_ERR_PROT_UNSPEC;
-                        cf->data[3] = (ecc & ERR_SEG_CODE) >> 16;
+        return 0;
+
+exit_free_ring:
+        sunxi_can_pool_free(dev);
+        kfree(priv->rx_recs);
+        priv->rx_recs = NULL;
+        kfree(priv->tx_ring);
+        priv->tx_ring = NULL;
+
+        return err;
+}
+
+static int sunxi_can_close(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        netif_stop_queue(dev);
+        /* a late TX interrupt must not load the buffer in reset mode */
+        sunxi_can_tx_halt(dev);
+        set_reset_mode(dev, true);
+
+        if (!(priv->flags & SUNXI_CAN_CUSTOM_IRQ_HANDLER))
+                free_irq(dev->irq, (void *)dev);
+
+        napi_disable(&priv->napi);
+
+        hrtimer_cancel(&priv->poll_timer);
+        priv->hrpoll = false;
+        priv->rx_napi_masked = false;
+
+        /* pending error events are dropped with the interface */
+        del_timer_sync(&priv->err_timer);
+        memset(&priv->err_acc, 0, sizeof(priv->err_acc));
+
+        del_timer_sync(&priv->berr_timer);
+        priv->berr_throttled = false;
+        priv->berr_rearmed = 0;
+
+        priv->busoff_recovering = false;
+
+        sunxi_can_tx_purge(dev);
+        kfree(priv->tx_ring);
+        priv->tx_ring = NULL;
+        kfree(priv->rx_recs);
+        priv->rx_recs = NULL;
+        sunxi_can_pool_free(dev);
+
+        close_candev(dev);
+
+        priv->open_time = 0;
+
+        return 0;
+}
+
+struct net_device *alloc_sunxicandev(int sizeof_priv)
+{
+        struct net_device *dev;
+        struct sunxi_can_priv *priv;
+
+        dev = alloc_candev(sizeof(struct sunxi_can_priv) + sizeof_priv,
+                SUNXI_CAN_ECHO_SKB_MAX);
+        if (!dev)
+                return NULL;
+
+        priv = netdev_priv(dev);
+
+        priv->dev = dev;
+        priv->can.bittiming_const = &sunxi_can_bittiming_const;
+        priv->can.do_set_bittiming = sunxi_can_set_bittiming;
+        priv->can.do_set_mode = sunxi_can_set_mode;
+        priv->can.do_get_berr_counter = sunxi_can_get_berr_counter;
+        priv->can.ctrlmode_supported = CAN_CTRLMODE_LOOPBACK |
+                CAN_CTRLMODE_LISTENONLY |
+                CAN_CTRLMODE_3_SAMPLES |
+                CAN_CTRLMODE_BERR_REPORTING;
+
+        raw_spin_lock_init(&priv->cmdreg_lock);
+        raw_spin_lock_init(&priv->inten_lock);
+        raw_spin_lock_init(&priv->msel_lock);
+        raw_spin_lock_init(&priv->tx_lock);
+        raw_spin_lock_init(&priv->pool_lock);
+        raw_spin_lock_init(&priv->err_lock);
+        setup_timer(&priv->err_timer, sunxi_can_err_timer, (unsigned long)dev);
+        setup_timer(&priv->berr_timer, sunxi_can_berr_timer, (unsigned long)dev);
+        INIT_WORK(&priv->pool_work, sunxi_can_pool_refill);
+
+        priv->isr_budget_min = SUNXI_CAN_ISR_BUDGET_MIN;
+        priv->isr_budget_max = SUNXI_CAN_ISR_BUDGET_MAX;
+        priv->isr_budget = SUNXI_CAN_ISR_BUDGET_MAX;
+        priv->isr_time_budget_us = SUNXI_CAN_ISR_TIME_BUDGET_US;
+
+        mutex_init(&priv->bench.lock);
+        priv->bench.secs = 5;
+        priv->bench.id = 0x555;
+        priv->bench.dlc = 8;
+
+        netif_napi_add(dev, &priv->napi, sunxi_can_poll, SUNXI_CAN_NAPI_WEIGHT);
+
+        hrtimer_init(&priv->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+        priv->poll_timer.function = sunxi_can_poll_timer;
+
+        if (sizeof_priv)
+                priv->priv = (void *)priv + sizeof(struct sunxi_can_priv);
+
+        return dev;
+}
+EXPORT_SYMBOL_GPL(alloc_sunxicandev);
+
+void free_sunxicandev(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        kfree(rcu_dereference_protected(priv->rx_ids, 1));
+        netif_napi_del(&priv->napi);
+        free_candev(dev);
+}
+EXPORT_SYMBOL_GPL(free_sunxicandev);
+
+#define SUNXI_CAN_XSTAT_ATTR(_name)                                                \
+static ssize_t sunxi_can_show_##_name(struct device *d,                        \
+                                      struct device_attribute *attr, char *buf) \
+{                                                                              \
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));              \
+                                                                               \
+        return sprintf(buf, "%lu\n", priv->xstats._name);                      \
+}                                                                              \
+static DEVICE_ATTR(_name, S_IRUGO, sunxi_can_show_##_name, NULL)
+
+SUNXI_CAN_XSTAT_ATTR(mode_switches);
+SUNXI_CAN_XSTAT_ATTR(shadow_drift);
+SUNXI_CAN_XSTAT_ATTR(tx_aborts);
+
+static ssize_t sunxi_can_show_tx_latency(struct device *d,
+                                         struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        struct sunxi_can_tx_lat lat;
+        ssize_t len = 0;
+        unsigned long flags;
+        u64 avg;
+        int i;
+
+        len += sprintf(buf + len, "class  frames  avg_us  max_us\n");
+        for (i = 0; i < SUNXI_CAN_TX_PRIO_CLASSES; i++) {
+                raw_spin_lock_irqsave(&priv->tx_lock, flags);
+                lat = priv->tx_lat[i];
+                raw_spin_unlock_irqrestore(&priv->tx_lock, flags);
+
+                avg = lat.frames ? div_u64(lat.total_ns, lat.frames) : 0;
+                len += sprintf(buf + len, "%5d %7lu %7llu %7llu\n", i, lat.frames,
+                               div_u64(avg, NSEC_PER_USEC),
+                               div_u64(lat.max_ns, NSEC_PER_USEC));
+        }
+
+        return len;
+}
+static DEVICE_ATTR(tx_latency, S_IRUGO, sunxi_can_show_tx_latency, NULL);
+
+SUNXI_CAN_XSTAT_ATTR(rx_mmio_reads);
+SUNXI_CAN_XSTAT_ATTR(rx_drained);
+
+static ssize_t sunxi_can_show_rx_mmio_per_frame(struct device *d,
+                                                struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        unsigned long reads = priv->xstats.rx_mmio_reads;
+        unsigned long frames = priv->xstats.rx_drained;
+
+        if (!frames)
+                return sprintf(buf, "0\n");
+
+        return sprintf(buf, "%lu.%02lu\n", reads / frames, reads * 100 / frames % 100);
+}
+static DEVICE_ATTR(rx_mmio_per_frame, S_IRUGO, sunxi_can_show_rx_mmio_per_frame, NULL);
+
+SUNXI_CAN_XSTAT_ATTR(hw_filter_accepted);
+
+/*
+* acceptance filter, written as one of
+*   off
+*   single sff|eff <id> <mask>
+*   dual sff|eff <id0> <mask0> <id1> <mask1>
+*   single|dual raw <acpc> <acpm>
+* id/mask follow struct can_filter: set mask bits must match, CAN_RTR_FLAG
+* selects remote frames; the raw form takes the register values directly
+*/
+static ssize_t sunxi_can_show_acceptance_filter(struct device *d,
+                                                struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+
+        if (priv->filter_mode == FILTER_CLOSE)
+                return sprintf(buf, "off\n");
+
+        return sprintf(buf, "%s raw 0x%08x 0x%08x\n",
+                       priv->filter_mode == SINGLE_FLTER_MODE ? "single" : "dual",
+                       priv->acp_code, priv->acp_mask);
+}
+
+static ssize_t sunxi_can_store_acceptance_filter(struct device *d,
+                                                 struct device_attribute *attr,
+                                                 const char *buf, size_t count)
+{
+        struct net_device *dev = to_net_dev(d);
+        char mode[8], format[8];
+        u32 v[4], code = 0, care = 0;
+        bool eff, dual;
+        int n;
+
+        n = sscanf(buf, "%7s %7s %x %x %x %x", mode, format, &v[0], &v[1], &v[2], &v[3]);
+        if (n < 1)
+                return -EINVAL;
+
+        if (!strcmp(mode, "off")) {
+                if (n != 1)
+                        return -EINVAL;
+                dual = false;
+                goto update;
+        }
+
+        if (!strcmp(mode, "single"))
+                dual = false;
+        else if (!strcmp(mode, "dual"))
+                dual = true;
+        else
+                return -EINVAL;
+
+        if (n >= 2 && !strcmp(format, "raw")) {
+                if (n != 4)
+                        return -EINVAL;
+                code = v[0];
+                care = ~v[1];
+        } else {
+                if (n < 2 || n != (dual ? 6 : 4))
+                        return -EINVAL;
+                if (!strcmp(format, "eff"))
+                        eff = true;
+                else if (!strcmp(format, "sff"))
+                        eff = false;
+                else
+                        return -EINVAL;
+
+                code = sunxi_can_acp_layout(v[0], eff, dual, 0);
+                care = sunxi_can_acp_layout(v[1], eff, dual, 0);
+                if (dual) {
+                        code |= sunxi_can_acp_layout(v[2], eff, dual, 1);
+                        care |= sunxi_can_acp_layout(v[3], eff, dual, 1);
                 }
-                /* Error occurred during transmission? */
-                if ((ecc & ERR_DIR) == 0)
-                        cf->data[2] |= CAN_ERR_PROT_TX;
         }
-        if (isrc & ERR_PASSIVE) {
-                /* error passive interrupt */
-                netdev_dbg(dev, "error passive interrupt\n");
-                if (status & ERR_STA)
-                        state = CAN_STATE_ERROR_PASSIVE;
+
+update:
+        if (!rtnl_trylock())
+                return restart_syscall();
+        /* a hand-written filter replaces the filter bank */
+        sunxi_can_update_acceptance(dev,
+                                    !strcmp(mode, "off") ? FILTER_CLOSE :
+                                    dual ? DUAL_FILTER_MODE : SINGLE_FLTER_MODE,
+                                    code & care, ~care, NULL);
+        rtnl_unlock();
+
+        return count;
+}
+static DEVICE_ATTR(acceptance_filter, S_IRUGO | S_IWUSR,
+                   sunxi_can_show_acceptance_filter, sunxi_can_store_acceptance_filter);
+
+SUNXI_CAN_XSTAT_ATTR(sw_filter_rejected);
+
+static int sunxi_can_cmp_range(const void *a, const void *b)
+{
+        const struct sunxi_can_id_range *ra = a, *rb = b;
+
+        if (ra->eff != rb->eff)
+                return ra->eff ? 1 : -1;
+        if (ra->lo != rb->lo)
+                return ra->lo < rb->lo ? -1 : 1;
+        return 0;
+}
+
+/*
+* filter bank of wanted identifiers, written as
+*   [sff] <id>[-<id>] ... [eff <id>[-<id>] ...]
+* or "off"; sff/eff select the format of the following identifiers
+* the acceptance filter is computed to cover the set with the fewest false
+* accepts, the rest is dropped in sunxi_can_rx() before an skb is allocated
+*/
+static ssize_t sunxi_can_show_rx_ids(struct device *d,
+                                     struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        struct sunxi_can_id_set *ids;
+        struct sunxi_can_id_range *r;
+        unsigned long accepted, rejected;
+        ssize_t len = 0;
+        unsigned int i;
+
+        if (!rtnl_trylock())
+                return restart_syscall();
+        ids = rtnl_dereference(priv->rx_ids);
+        if (!ids) {
+                rtnl_unlock();
+                return sprintf(buf, "off\n");
+        }
+
+        for (i = 0; i < ids->n && len < PAGE_SIZE - 64; i++) {
+                r = &ids->range[i];
+                if (i == 0 || i == ids->n_sff)
+                        len += sprintf(buf + len, "%s%s", i ? " " : "", r->eff ? "eff" : "sff");
+                if (r->lo == r->hi)
+                        len += sprintf(buf + len, " 0x%x", r->lo);
                 else
-                        state = CAN_STATE_ERROR_ACTIVE;
+                        len += sprintf(buf + len, " 0x%x-0x%x", r->lo, r->hi);
         }
-        if (isrc & ARB_LOST) {
-                /* arbitration lost interrupt */
-                netdev_dbg(dev, "arbitration lost interrupt\n");
-                alc = readl(CAN_STA_ADDR);
-                priv->can.can_stats.arbitration_lost++;
-                stats->tx_errors++;
-                cf->can_id |= CAN_ERR_LOSTARB;
-                cf->data[0] = (alc & 0x1f) >> 8;
+
+        if (priv->filter_mode == FILTER_CLOSE)
+                len += sprintf(buf + len, "\nacceptance filter open (mixed SFF/EFF set)\n");
+        else
+                len += sprintf(buf + len, "\n%s filter 0x%08x 0x%08x: %llu ids, %llu accepted\n",
+                               priv->filter_mode == SINGLE_FLTER_MODE ? "single" : "dual",
+                               priv->acp_code, priv->acp_mask, ids->ids, ids->accepted);
+
+        accepted = priv->xstats.hw_filter_accepted;
+        rejected = priv->xstats.sw_filter_rejected;
+        len += sprintf(buf + len, "false accepts: %lu of %lu frames (%lu.%lu%%)\n",
+                       rejected, accepted,
+                       accepted ? rejected * 100 / accepted : 0,
+                       accepted ? rejected * 1000 / accepted % 10 : 0);
+        rtnl_unlock();
+
+        return len;
+}
+
+static ssize_t sunxi_can_store_rx_ids(struct device *d,
+                                      struct device_attribute *attr,
+                                      const char *buf, size_t count)
+{
+        struct net_device *dev = to_net_dev(d);
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_id_set *ids = NULL;
+        struct sunxi_can_id_range *r;
+        char *str, *cur, *tok, *hi;
+        unsigned int i, n = 0;
+        bool eff = false;
+        u32 code = 0, mask = 0;
+        u8 mode = FILTER_CLOSE;
+        int err = -EINVAL;
+
+        str = kstrndup(buf, count, GFP_KERNEL);
+        if (!str)
+                return -ENOMEM;
+        cur = strim(str);
+
+        if (!strcmp(cur, "off"))
+                goto update;
+
+        ids = kzalloc(sizeof(*ids) + SUNXI_CAN_MAX_ID_RANGES * sizeof(ids->range[0]),
+                      GFP_KERNEL);
+        if (!ids) {
+                err = -ENOMEM;
+                goto exit_free;
+        }
+
+        while ((tok = strsep(&cur, " \t,")) != NULL) {
+                if (!*tok)
+                        continue;
+                if (!strcmp(tok, "sff") || !strcmp(tok, "eff")) {
+                        eff = tok[0] == 'e';
+                        continue;
+                }
+                if (n == SUNXI_CAN_MAX_ID_RANGES) {
+                        err = -E2BIG;
+                        goto exit_free;
+                }
+                r = &ids->range[n++];
+                r->eff = eff;
+                hi = strchr(tok, '-');
+                if (hi)
+                        *hi++ = '\0';
+                if (kstrtou32(tok, 0, &r->lo) || kstrtou32(hi ? hi : tok, 0, &r->hi) ||
+                    r->lo > r->hi || r->hi > (eff ? CAN_EFF_MASK : CAN_SFF_MASK))
+                        goto exit_free;
+        }
+        if (!n)
+                goto exit_free;
+
+        /* sort SFF before EFF and merge overlapping or adjacent ranges */
+        sort(ids->range, n, sizeof(ids->range[0]), sunxi_can_cmp_range, NULL);
+        ids->n = 1;
+        for (i = 1; i < n; i++) {
+                r = &ids->range[ids->n - 1];
+                if (ids->range[i].eff == r->eff && ids->range[i].lo <= r->hi + 1) {
+                        if (ids->range[i].hi > r->hi)
+                                r->hi = ids->range[i].hi;
+                } else {
+                        ids->range[ids->n++] = ids->range[i];
+                }
         }
 
-        if (state != priv->can.state && (state == CAN_STATE_ERROR_WARNING ||
-                                         state == CAN_STATE_ERROR_PASSIVE)) {
-                uint8_t rxerr = (readl(CAN_ERRC_ADDR) >> 16) & 0xFF;
-                uint8_t txerr = readl(CAN_ERRC_ADDR) & 0xFF;
-                cf->can_id |= CAN_ERR_CRTL;
-                if (state == CAN_STATE_ERROR_WARNING) {
-                        priv->can.can_stats.error_warning++;
-                        cf->data[1] = (txerr > rxerr) ?
-                                CAN_ERR_CRTL_TX_WARNING :
-                                CAN_ERR_CRTL_RX_WARNING;
-                } else {
-                        priv->can.can_stats.error_passive++;
-                        cf->data[1] = (txerr > rxerr) ?
-                                CAN_ERR_CRTL_TX_PASSIVE :
-                                CAN_ERR_CRTL_RX_PASSIVE;
-                }
-                cf->data[6] = txerr;
-                cf->data[7] = rxerr;
+        for (i = 0; i < ids->n; i++) {
+                r = &ids->range[i];
+                ids->ids += r->hi - r->lo + 1;
+                if (!r->eff) {
+                        bitmap_set(ids->sff_map, r->lo, r->hi - r->lo + 1);
+                        ids->n_sff++;
+                }
+        }
+
+        mode = sunxi_can_cover_ids(ids, &code, &mask);
+
+update:
+        if (!rtnl_trylock()) {
+                err = restart_syscall();
+                goto exit_free;
+        }
+        priv->xstats.hw_filter_accepted = 0;
+        priv->xstats.sw_filter_rejected = 0;
+        sunxi_can_update_acceptance(dev, mode, code, mask, ids);
+        rtnl_unlock();
+        ids = NULL;
+        err = count;
+
+exit_free:
+        kfree(ids);
+        kfree(str);
+
+        return err;
+}
+static DEVICE_ATTR(rx_ids, S_IRUGO | S_IWUSR, sunxi_can_show_rx_ids, sunxi_can_store_rx_ids);
+
+/*
+* ISR budget tunables
+* isr_budget is the current frame budget, isr_budget_min/max bound its
+* adaptation; writing isr_budget_min or isr_budget_max pulls isr_budget
+* back into the range
+*/
+static ssize_t sunxi_can_store_isr_tunable(struct device *d, const char *buf, size_t count,
+                                           unsigned int *val, unsigned int lo, unsigned int hi)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        unsigned long v;
+
+        if (kstrtoul(buf, 0, &v) || v < lo || v > hi)
+                return -EINVAL;
+
+        *val = v;
+        if (priv->isr_budget_min > priv->isr_budget_max)
+                priv->isr_budget_min = priv->isr_budget_max;
+        priv->isr_budget = clamp(priv->isr_budget, priv->isr_budget_min, priv->isr_budget_max);
+
+        return count;
+}
+
+#define SUNXI_CAN_ISR_TUNABLE_ATTR(_name, _lo, _hi)                                \
+static ssize_t sunxi_can_show_##_name(struct device *d,                        \
+                                      struct device_attribute *attr, char *buf) \
+{                                                                              \
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));              \
+                                                                               \
+        return sprintf(buf, "%u\n", priv->_name);                              \
+}                                                                              \
+static ssize_t sunxi_can_store_##_name(struct device *d,                       \
+                                       struct device_attribute *attr,          \
+                                       const char *buf, size_t count)          \
+{                                                                              \
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));              \
+                                                                               \
+        return sunxi_can_store_isr_tunable(d, buf, count, &priv->_name, _lo, _hi); \
+}                                                                              \
+static DEVICE_ATTR(_name, S_IRUGO | S_IWUSR, sunxi_can_show_##_name, sunxi_can_store_##_name)
+
+SUNXI_CAN_ISR_TUNABLE_ATTR(isr_budget, 1, SUNXI_CAN_ISR_BUDGET_LIMIT);
+SUNXI_CAN_ISR_TUNABLE_ATTR(isr_budget_min, 1, SUNXI_CAN_ISR_BUDGET_LIMIT);
+SUNXI_CAN_ISR_TUNABLE_ATTR(isr_budget_max, 1, SUNXI_CAN_ISR_BUDGET_LIMIT);
+SUNXI_CAN_ISR_TUNABLE_ATTR(isr_time_budget_us, 0, USEC_PER_SEC);
+SUNXI_CAN_XSTAT_ATTR(isr_deferrals);
+SUNXI_CAN_XSTAT_ATTR(rx_irq_latency_max_ns);
+SUNXI_CAN_XSTAT_ATTR(rx_poll_switches);
+
+/* error events waiting for the next error frame, by type */
+static ssize_t sunxi_can_show_err_pending(struct device *d,
+                                          struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        struct sunxi_can_err_acc acc;
+        unsigned long flags;
+
+        raw_spin_lock_irqsave(&priv->err_lock, flags);
+        acc = priv->err_acc;
+        raw_spin_unlock_irqrestore(&priv->err_lock, flags);
+
+        return sprintf(buf, "events %u overruns %u bus_errors %u arb_lost %u\n",
+                       acc.events, acc.overruns, acc.bus_errors, acc.arb_lost);
+}
+static DEVICE_ATTR(err_pending, S_IRUGO, sunxi_can_show_err_pending, NULL);
+SUNXI_CAN_XSTAT_ATTR(err_coalesced);
+SUNXI_CAN_XSTAT_ATTR(berr_suppressed);
+
+/* "off", or "on" with the current throttle time and the rate that tripped it */
+static ssize_t sunxi_can_show_berr_throttle(struct device *d,
+                                            struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+
+        if (!priv->berr_throttled)
+                return sprintf(buf, "off\n");
+
+        return sprintf(buf, "on %u ms, %lu/s\n", priv->berr_backoff_ms, priv->berr_rate);
+}
+static DEVICE_ATTR(berr_throttle, S_IRUGO, sunxi_can_show_berr_throttle, NULL);
+
+/* controller mode transition times */
+static ssize_t sunxi_can_show_mode_switch(struct device *d,
+                                          struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        unsigned long n = priv->xstats.mode_switches;
+
+        return sprintf(buf, "switches %lu timeouts %lu min_ns %llu avg_ns %llu max_ns %llu\n",
+                       n, priv->xstats.mode_timeouts, priv->mode_min_ns,
+                       n ? div64_u64(priv->mode_total_ns, n) : 0, priv->mode_max_ns);
+}
+static DEVICE_ATTR(mode_switch, S_IRUGO, sunxi_can_show_mode_switch, NULL);
+
+/* bus-off recovery times: latest, longest and a histogram in ms */
+static ssize_t sunxi_can_show_busoff_recovery(struct device *d,
+                                              struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        ssize_t len;
+        int i;
+
+        len = sprintf(buf, "recoveries %lu last_us %llu max_us %llu%s\n",
+                      priv->xstats.busoff_recoveries,
+                      div_u64(priv->busoff_last_ns, NSEC_PER_USEC),
+                      div_u64(priv->busoff_max_ns, NSEC_PER_USEC),
+                      priv->busoff_recovering ? " recovering" : "");
+        for (i = 0; i < SUNXI_CAN_BUSOFF_HIST - 1; i++)
+                len += sprintf(buf + len, "<%ums %lu\n", 1 << i, priv->busoff_hist[i]);
+        len += sprintf(buf + len, ">=%ums %lu\n", 1 << i, priv->busoff_hist[i]);
+
+        return len;
+}
+static DEVICE_ATTR(busoff_recovery, S_IRUGO, sunxi_can_show_busoff_recovery, NULL);
+
+/* "irq" or "hrtimer", and the poll period in use or for the next switch */
+static ssize_t sunxi_can_show_rx_poll_mode(struct device *d,
+                                           struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+
+        return sprintf(buf, "%s\n", priv->hrpoll ? "hrtimer" : "irq");
+}
+static DEVICE_ATTR(rx_poll_mode, S_IRUGO, sunxi_can_show_rx_poll_mode, NULL);
+
+static ssize_t sunxi_can_show_rx_poll_period_us(struct device *d,
+                                                struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        u64 period = priv->hrpoll ? priv->poll_period_ns : sunxi_can_hrpoll_period(priv);
+
+        return sprintf(buf, "%llu\n", div_u64(period, NSEC_PER_USEC));
+}
+static DEVICE_ATTR(rx_poll_period_us, S_IRUGO, sunxi_can_show_rx_poll_period_us, NULL);
+
+/* frames received per filter bank range */
+static ssize_t sunxi_can_show_rx_id_hits(struct device *d,
+                                         struct device_attribute *attr, char *buf)
+{
+        struct sunxi_can_priv *priv = netdev_priv(to_net_dev(d));
+        struct sunxi_can_id_set *ids;
+        struct sunxi_can_id_range *r;
+        ssize_t len = 0;
+        unsigned int i;
+
+        rcu_read_lock();
+        ids = rcu_dereference(priv->rx_ids);
+        for (i = 0; ids && i < ids->n && len < PAGE_SIZE - 64; i++) {
+                r = &ids->range[i];
+                len += sprintf(buf + len, "%s 0x%x-0x%x %lu\n", r->eff ? "eff" : "sff",
+                               r->lo, r->hi, r->hits);
         }
+        rcu_read_unlock();
 
-        priv->can.state = state;
+        len += sprintf(buf + len, "miss %lu\n", priv->xstats.sw_filter_rejected);
 
-        netif_rx(skb);
+        return len;
+}
+static DEVICE_ATTR(rx_id_hits, S_IRUGO, sunxi_can_show_rx_id_hits, NULL);
+
+static struct attribute *sunxi_can_attrs[] = {
+        &dev_attr_mode_switches.attr,
+        &dev_attr_shadow_drift.attr,
+        &dev_attr_tx_aborts.attr,
+        &dev_attr_tx_latency.attr,
+        &dev_attr_rx_mmio_reads.attr,
+        &dev_attr_rx_drained.attr,
+        &dev_attr_rx_mmio_per_frame.attr,
+        &dev_attr_acceptance_filter.attr,
+        &dev_attr_hw_filter_accepted.attr,
+        &dev_attr_sw_filter_rejected.attr,
+        &dev_attr_rx_ids.attr,
+        &dev_attr_rx_id_hits.attr,
+        &dev_attr_isr_budget.attr,
+        &dev_attr_isr_budget_min.attr,
+        &dev_attr_isr_budget_max.attr,
+        &dev_attr_isr_time_budget_us.attr,
+        &dev_attr_isr_deferrals.attr,
+        &dev_attr_rx_irq_latency_max_ns.attr,
+        &dev_attr_rx_poll_mode.attr,
+        &dev_attr_rx_poll_switches.attr,
+        &dev_attr_rx_poll_period_us.attr,
+        &dev_attr_err_pending.attr,
+        &dev_attr_err_coalesced.attr,
+        &dev_attr_berr_throttle.attr,
+        &dev_attr_berr_suppressed.attr,
+        &dev_attr_busoff_recovery.attr,
+        &dev_attr_mode_switch.attr,
+        NULL
+};
 
-        stats->rx_packets++;
-        stats->rx_bytes += cf->can_dlc;
+static const struct attribute_group sunxi_can_attr_group = {
+        .name = DRV_NAME,
+        .attrs = sunxi_can_attrs,
+};
 
-        return 0;
+/*
+* loopback self-benchmark
+*   echo 1 > /sys/kernel/debug/sunxi_can/can0/bench
+*   cat /sys/kernel/debug/sunxi_can/can0/bench
+* the interface must be up; bench_secs, bench_id, bench_eff and bench_dlc
+* set up the next run. The controller is switched to loopback for the
+* duration of the run, frames go through dev_queue_xmit() and the regular
+* TX path and come back through the regular RX path. Other traffic sent
+* on the interface meanwhile is looped back as well and counts towards
+* the ISR and poll time.
+*/
+static void sunxi_can_bench_mode(struct net_device *dev, bool on)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        disable_irq(dev->irq);
+        napi_disable(&priv->napi);
+        sunxi_can_tx_halt(dev);
+
+        set_reset_mode(dev, true);
+        priv->bench.active = on;
+        sunxi_can_update_msel(priv, LOOPBACK_MODE, 0);
+        set_normal_mode(dev, true);
+
+        sunxi_can_tx_resume(dev);
+        napi_enable(&priv->napi);
+        sunxi_can_rx_restart(priv);
+        enable_irq(dev->irq);
 }
 
-irqreturn_t sunxi_can_interrupt(int irq, void *dev_id)
+static u64 sunxi_can_bench_percentile(const u32 *hist, unsigned long frames, unsigned int pct)
 {
-        struct net_device *dev = (struct net_device *)dev_id;
-        struct sunxi_can_priv *priv = netdev_priv(dev);
-        struct net_device_stats *stats = &dev->stats;
-        uint8_t isrc, status;
-        int n = 0;
+        unsigned long want = DIV_ROUND_UP(frames * pct, 100), seen = 0;
+        int i;
 
-        while ((isrc = readl(CAN_INT_ADDR)) && (n < SUNXI_CAN_MAX_IRQ)) {
-                n++;
-                status = readl(CAN_STA_ADDR);
-                /* check for absent controller due to hw unplug */
-                if (sunxi_can_is_absent(priv))
-                        return IRQ_NONE;
+        for (i = 0; i < SUNXI_CAN_BENCH_BUCKETS; i++) {
+                seen += hist[i];
+                if (seen >= want)
+                        break;
+        }
 
-                if (isrc & WAKEUP)
-                        netdev_warn(dev, "wakeup interrupt\n");
+        return (u64)(i + 1) * SUNXI_CAN_BENCH_BUCKET_NS;
+}
 
-                if (isrc & TBUF_VLD) {
-			pr_debug("sunxicanirq: Tx irq, reg=0x%X\n", isrc);
-                        /* transmission complete interrupt */
-                        stats->tx_bytes += readl(CAN_RBUF_RBACK_START_ADDR) & 0xf;
-                        stats->tx_packets++;
-                        can_get_echo_skb(dev, 0);
-                        netif_wake_queue(dev);
+static int sunxi_can_bench_run(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_bench *b = &priv->bench;
+        struct sunxi_can_bench_result *r = &b->result;
+        unsigned long rx_over;
+        struct can_frame *cf;
+        struct sk_buff *skb;
+        s64 start, end, now;
+        u32 seq;
+        int err = 0;
+
+        b->sent = kcalloc(SUNXI_CAN_BENCH_INFLIGHT, sizeof(*b->sent), GFP_KERNEL);
+        b->hist = kcalloc(SUNXI_CAN_BENCH_BUCKETS, sizeof(*b->hist), GFP_KERNEL);
+        if (!b->sent || !b->hist) {
+                err = -ENOMEM;
+                goto exit_free;
+        }
+
+        rtnl_lock();
+        if (!netif_running(dev)) {
+                rtnl_unlock();
+                err = -ENETDOWN;
+                goto exit_free;
+        }
+        memset(r, 0, sizeof(*r));
+        b->can_id = b->eff ? (b->id & CAN_EFF_MASK) | CAN_EFF_FLAG : b->id & CAN_SFF_MASK;
+        b->dlc = min_t(u8, b->dlc, 8);
+        b->tx_seq = 0;
+        b->rx_next = 0;
+        rx_over = dev->stats.rx_over_errors;
+        sunxi_can_bench_mode(dev, true);
+        rtnl_unlock();
+
+        start = ktime_to_ns(ktime_get());
+        end = start + (s64)b->secs * NSEC_PER_SEC;
+        while ((now = ktime_to_ns(ktime_get())) < end) {
+                if (signal_pending(current)) {
+                        err = -EINTR;
+                        break;
                 }
-                if (isrc & RBUF_VLD) {
-			pr_debug("sunxicanirq: Rx irq, reg=0x%X\n", isrc);
-                        /* receive interrupt */
-                        while (status & RBUF_RDY) {        //RX buffer is not empty
-                                sunxi_can_rx(dev);
-                                status = readl(CAN_STA_ADDR);
-                                /* check for absent controller */
-                                if (sunxi_can_is_absent(priv))
-                                        return IRQ_NONE;
-                        }
+                if (!netif_running(dev)) {
+                        err = -ENETDOWN;
+                        break;
                 }
-                if (isrc & (DATA_ORUNI | ERR_WRN | BUS_ERR | ERR_PASSIVE | ARB_LOST)) {
-			pr_debug("sunxicanirq: error, reg=0x%X\n", isrc);
-                        /* error interrupt */
-                        if (sunxi_can_err(dev, isrc, status))
-                                break;
+
+                /* keep the frames in the driver's TX ring, not in the qdisc */
+                if (netif_queue_stopped(dev) ||
+                    b->tx_seq - b->rx_next >= SUNXI_CAN_BENCH_INFLIGHT) {
+                        usleep_range(50, 100);
+                        continue;
                 }
 
-                //clear the interrupt
-                writel(isrc, CAN_INT_ADDR);
-                readl(CAN_INT_ADDR);
+                skb = alloc_can_skb(dev, &cf);
+                if (!skb) {
+                        usleep_range(50, 100);
+                        continue;
+                }
+                seq = b->tx_seq;
+                cf->can_id = b->can_id;
+                cf->can_dlc = b->dlc;
+                memcpy(cf->data, &seq, min_t(u8, b->dlc, sizeof(seq)));
+
+                b->sent[seq % SUNXI_CAN_BENCH_INFLIGHT] = ktime_get();
+                smp_wmb();
+                b->tx_seq = seq + 1;
+                r->tx++;
+                if (dev_queue_xmit(skb) != NET_XMIT_SUCCESS)
+                        r->tx_dropped++;
+        }
+        r->elapsed_ns = now - start;
+
+        /* give the frames in flight time to come back */
+        end = ktime_to_ns(ktime_get()) + 100 * NSEC_PER_MSEC;
+        while (b->rx_next != b->tx_seq && ktime_to_ns(ktime_get()) < end)
+                usleep_range(1000, 2000);
+
+        rtnl_lock();
+        if (netif_running(dev))
+                sunxi_can_bench_mode(dev, false);
+        else
+                b->active = false;
+        rtnl_unlock();
+
+        r->rx_overruns = dev->stats.rx_over_errors - rx_over;
+        if (r->rx) {
+                r->p50_ns = sunxi_can_bench_percentile(b->hist, r->rx, 50);
+                r->p90_ns = sunxi_can_bench_percentile(b->hist, r->rx, 90);
+                r->p99_ns = sunxi_can_bench_percentile(b->hist, r->rx, 99);
         }
 
-        if (n >= SUNXI_CAN_MAX_IRQ)
-                netdev_dbg(dev, "%d messages handled in ISR", n);
+exit_free:
+        kfree(b->hist);
+        kfree(b->sent);
+        b->hist = NULL;
+        b->sent = NULL;
 
-        return (n) ? IRQ_HANDLED : IRQ_NONE;
+        return err;
 }
-EXPORT_SYMBOL_GPL(sunxi_can_interrupt);
 
-static int sunxi_can_open(struct net_device *dev)
+static ssize_t sunxi_can_bench_read(struct file *file, char __user *ubuf,
+                                    size_t count, loff_t *ppos)
+{
+        struct net_device *dev = file->private_data;
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_bench_result *r = &priv->bench.result;
+        unsigned long frames = r->rx ? r->rx : 1;
+        char buf[512];
+        int len;
+
+        if (!mutex_trylock(&priv->bench.lock))
+                return -EBUSY;
+
+        len = scnprintf(buf, sizeof(buf),
+                        "tx %lu\ntx_dropped %lu\nrx %lu\nlost %lu\nrx_overruns %lu\n"
+                        "frames_per_sec %llu\nisr_ns_per_frame %llu\npoll_ns_per_frame %llu\n"
+                        "latency_us p50 %llu p90 %llu p99 %llu max %llu\n",
+                        r->tx, r->tx_dropped, r->rx, r->tx - r->tx_dropped - r->rx,
+                        r->rx_overruns,
+                        r->elapsed_ns ? div64_u64((u64)r->rx * NSEC_PER_SEC, r->elapsed_ns) : 0,
+                        div_u64(r->isr_ns, frames), div_u64(r->poll_ns, frames),
+                        div_u64(r->p50_ns, NSEC_PER_USEC), div_u64(r->p90_ns, NSEC_PER_USEC),
+                        div_u64(r->p99_ns, NSEC_PER_USEC), div_u64(r->max_ns, NSEC_PER_USEC));
+
+        mutex_unlock(&priv->bench.lock);
+
+        return simple_read_from_buffer(ubuf, count, ppos, buf, len);
+}
+
+/* any write starts a run and returns when it is over */
+static ssize_t sunxi_can_bench_write(struct file *file, const char __user *ubuf,
+                                     size_t count, loff_t *ppos)
 {
+        struct net_device *dev = file->private_data;
         struct sunxi_can_priv *priv = netdev_priv(dev);
         int err;
 
-        /* set chip into reset mode */
-        set_reset_mode(dev);
+        if (!mutex_trylock(&priv->bench.lock))
+                return -EBUSY;
+        err = sunxi_can_bench_run(dev);
+        mutex_unlock(&priv->bench.lock);
 
-        writel(0xffffffff, CAN_ACPM_ADDR);
+        return err ? err : count;
+}
 
-        /* common open */
-        err = open_candev(dev);
-        if (err)
-                return err;
+static const struct file_operations sunxi_can_bench_fops = {
+        .owner = THIS_MODULE,
+        .open = simple_open,
+        .read = sunxi_can_bench_read,
+        .write = sunxi_can_bench_write,
+        .llseek = default_llseek,
+};
 
-        /* register interrupt handler, if not done by the device driver */
-        if (!(priv->flags & SUNXI_CAN_CUSTOM_IRQ_HANDLER)) {
-                err = request_irq(dev->irq, sunxi_can_interrupt, priv->irq_flags,
-                                 dev->name, (void *)dev);
-                if (err) {
-                        close_candev(dev);
-                        pr_info("request_irq err:%d\n", err);
-                        return -EAGAIN;
-                }
-        }
+/* empty the ID statistics, frames received meanwhile may be lost or half counted */
+static void sunxi_can_id_stats_clear(struct sunxi_can_id_stats *st)
+{
+        int i;
 
-        /* init and start chi */
-        sunxi_can_start(dev);
-        priv->open_time = jiffies;
+        memset(st, 0, sizeof(*st));
+        for (i = 0; i <= CAN_SFF_MASK; i++)
+                st->sff[i].id = i;
+}
 
-        netif_start_queue(dev);
+static void sunxi_can_id_stat_show(struct seq_file *m, const struct sunxi_can_id_stat *e,
+                                   const char *fmt)
+{
+        seq_printf(m, fmt, e->id & CAN_EFF_MASK);
+        seq_printf(m, " %10u %12llu %12llu %10u %10u\n", e->count, e->bytes, e->last_ns,
+                   e->count > 1 ? e->min_gap_ns : 0, e->max_gap_ns);
+}
+
+/* text view of the identifiers seen so far */
+static int sunxi_can_id_stats_show(struct seq_file *m, void *v)
+{
+        struct net_device *dev = m->private;
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        struct sunxi_can_id_stats *st = priv->id_stats;
+        int i;
+
+        seq_printf(m, "%-8s %10s %12s %12s %10s %10s\n",
+                   "id", "frames", "bytes", "last_ns", "min_gap_ns", "max_gap_ns");
+        for (i = 0; i <= CAN_SFF_MASK; i++) {
+                if (st->sff[i].count)
+                        sunxi_can_id_stat_show(m, &st->sff[i], "%03x     ");
+        }
+        for (i = 0; i < SUNXI_CAN_ID_STATS_EFF; i++) {
+                if (st->eff[i].count)
+                        sunxi_can_id_stat_show(m, &st->eff[i], "%08x");
+        }
+        seq_printf(m, "eff_overflow %lu\n", priv->xstats.id_stats_overflow);
 
         return 0;
 }
 
-static int sunxi_can_close(struct net_device *dev)
+static int sunxi_can_id_stats_open(struct inode *inode, struct file *file)
 {
-        struct sunxi_can_priv *priv = netdev_priv(dev);
+        return single_open(file, sunxi_can_id_stats_show, inode->i_private);
+}
 
-        netif_stop_queue(dev);
-        set_reset_mode(dev);
+/* any write clears the table */
+static ssize_t sunxi_can_id_stats_write(struct file *file, const char __user *ubuf,
+                                        size_t count, loff_t *ppos)
+{
+        struct seq_file *m = file->private_data;
+        struct sunxi_can_priv *priv = netdev_priv((struct net_device *)m->private);
 
-        if (!(priv->flags & SUNXI_CAN_CUSTOM_IRQ_HANDLER))
-                free_irq(dev->irq, (void *)dev);
+        sunxi_can_id_stats_clear(priv->id_stats);
+        priv->xstats.id_stats_overflow = 0;
 
-        close_candev(dev);
+        return count;
+}
 
-        priv->open_time = 0;
+static const struct file_operations sunxi_can_id_stats_fops = {
+        .owner = THIS_MODULE,
+        .open = sunxi_can_id_stats_open,
+        .read = seq_read,
+        .write = sunxi_can_id_stats_write,
+        .llseek = seq_lseek,
+        .release = single_release,
+};
+
+/*
+* binary view, a struct sunxi_can_id_stats copied when the file is
+* opened so one open reads a consistent snapshot
+*/
+static int sunxi_can_id_stats_bin_open(struct inode *inode, struct file *file)
+{
+        struct sunxi_can_priv *priv = netdev_priv((struct net_device *)inode->i_private);
+        struct sunxi_can_id_stats *snap;
+
+        snap = vmalloc(sizeof(*snap));
+        if (!snap)
+                return -ENOMEM;
+        memcpy(snap, priv->id_stats, sizeof(*snap));
+        file->private_data = snap;
 
         return 0;
 }
 
-struct net_device *alloc_sunxicandev(int sizeof_priv)
+static ssize_t sunxi_can_id_stats_bin_read(struct file *file, char __user *ubuf,
+                                           size_t count, loff_t *ppos)
 {
-        struct net_device *dev;
-        struct sunxi_can_priv *priv;
+        return simple_read_from_buffer(ubuf, count, ppos, file->private_data,
+                                       sizeof(struct sunxi_can_id_stats));
+}
 
-        dev = alloc_candev(sizeof(struct sunxi_can_priv) + sizeof_priv,
-                SUNXI_CAN_ECHO_SKB_MAX);
-        if (!dev)
-                return NULL;
+static int sunxi_can_id_stats_bin_release(struct inode *inode, struct file *file)
+{
+        vfree(file->private_data);
 
-        priv = netdev_priv(dev);
+        return 0;
+}
 
-        priv->dev = dev;
-        priv->can.bittiming_const = &sunxi_can_bittiming_const;
-        priv->can.do_set_bittiming = sunxi_can_set_bittiming;
-        priv->can.do_set_mode = sunxi_can_set_mode;
-        priv->can.do_get_berr_counter = sunxi_can_get_berr_counter;
-        priv->can.ctrlmode_supported = CAN_CTRLMODE_LOOPBACK |
-                CAN_CTRLMODE_LISTENONLY |
-                CAN_CTRLMODE_3_SAMPLES |
-                CAN_CTRLMODE_BERR_REPORTING;
+static const struct file_operations sunxi_can_id_stats_bin_fops = {
+        .owner = THIS_MODULE,
+        .open = sunxi_can_id_stats_bin_open,
+        .read = sunxi_can_id_stats_bin_read,
+        .llseek = default_llseek,
+        .release = sunxi_can_id_stats_bin_release,
+};
 
-        spin_lock_init(&priv->cmdreg_lock);
+static void sunxi_can_debugfs_init(struct net_device *dev)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
 
-        if (sizeof_priv)
-                priv->priv = (void *)priv + sizeof(struct sunxi_can_priv);
+        priv->debugfs = debugfs_create_dir(dev->name, sunxi_can_debugfs);
+        if (IS_ERR_OR_NULL(priv->debugfs))
+                return;
 
-        return dev;
+        debugfs_create_file("bench", S_IRUSR | S_IWUSR, priv->debugfs, dev,
+                            &sunxi_can_bench_fops);
+        debugfs_create_u32("bench_secs", S_IRUSR | S_IWUSR, priv->debugfs, &priv->bench.secs);
+        debugfs_create_x32("bench_id", S_IRUSR | S_IWUSR, priv->debugfs, &priv->bench.id);
+        debugfs_create_bool("bench_eff", S_IRUSR | S_IWUSR, priv->debugfs, &priv->bench.eff);
+        debugfs_create_u8("bench_dlc", S_IRUSR | S_IWUSR, priv->debugfs, &priv->bench.dlc);
+
+        if (priv->id_stats) {
+                debugfs_create_file("id_stats", S_IRUSR | S_IWUSR, priv->debugfs, dev,
+                                    &sunxi_can_id_stats_fops);
+                debugfs_create_file("id_stats.bin", S_IRUSR, priv->debugfs, dev,
+                                    &sunxi_can_id_stats_bin_fops);
+        }
 }
-EXPORT_SYMBOL_GPL(alloc_sunxicandev);
 
-void free_sunxicandev(struct net_device *dev)
+/* names of the members of struct sunxi_can_xstats, in order */
+static const char sunxi_can_xstat_strings[][ETH_GSTRING_LEN] = {
+        "mode_switches",
+        "mode_timeouts",
+        "shadow_drift",
+        "tx_aborts",
+        "rx_mmio_reads",
+        "rx_mmio_writes",
+        "rx_drained",
+        "rx_passes",
+        "rx_pass_max",
+        "rx_alloc_failed",
+        "err_alloc_failed",
+        "hw_filter_accepted",
+        "sw_filter_rejected",
+        "tx_mmio_reads",
+        "tx_mmio_writes",
+        "isr_calls",
+        "isr_loops",
+        "isr_budget_exhausted",
+        "isr_deferrals",
+        "isr_mmio_reads",
+        "isr_mmio_writes",
+        "rx_irq_latency_max_ns",
+        "rx_poll_switches",
+        "skb_pool_hits",
+        "skb_pool_misses",
+        "skb_pool_refills",
+        "skb_pool_refill_max_ns",
+        "err_events",
+        "err_frames",
+        "err_coalesced",
+        "err_overruns",
+        "err_bus_errors",
+        "err_arb_lost",
+        "berr_storms",
+        "berr_suppressed",
+        "busoff_recoveries",
+        "id_stats_overflow",
+        "irq_rbuf_vld",
+        "irq_tbuf_vld",
+        "irq_err_wrn",
+        "irq_data_orun",
+        "irq_wakeup",
+        "irq_err_passive",
+        "irq_arb_lost",
+        "irq_bus_err",
+};
+
+static int sunxi_can_get_sset_count(struct net_device *dev, int sset)
 {
-        free_candev(dev);
+        BUILD_BUG_ON(ARRAY_SIZE(sunxi_can_xstat_strings) !=
+                     sizeof(struct sunxi_can_xstats) / sizeof(unsigned long));
+
+        switch (sset) {
+        case ETH_SS_STATS:
+                return ARRAY_SIZE(sunxi_can_xstat_strings);
+        default:
+                return -EOPNOTSUPP;
+        }
+}
+
+static void sunxi_can_get_strings(struct net_device *dev, u32 stringset, u8 *data)
+{
+        if (stringset == ETH_SS_STATS)
+                memcpy(data, sunxi_can_xstat_strings, sizeof(sunxi_can_xstat_strings));
 }
-EXPORT_SYMBOL_GPL(free_sunxicandev);
+
+static void sunxi_can_get_ethtool_stats(struct net_device *dev,
+                                        struct ethtool_stats *stats, u64 *data)
+{
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        const unsigned long *xstats = (const unsigned long *)&priv->xstats;
+        int i;
+
+        for (i = 0; i < ARRAY_SIZE(sunxi_can_xstat_strings); i++)
+                data[i] = xstats[i];
+}
+
+static const struct ethtool_ops sunxi_can_ethtool_ops = {
+        .get_sset_count = sunxi_can_get_sset_count,
+        .get_strings = sunxi_can_get_strings,
+        .get_ethtool_stats = sunxi_can_get_ethtool_stats,
+};
 
 static const struct net_device_ops sunxican_netdev_ops = {
        .ndo_open = sunxi_can_open,
@@ -623,63 +3477,215 @@ static const struct net_device_ops sunxican_netdev_ops = {
 
 int register_sunxicandev(struct net_device *dev)
 {
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+        int err;
+
         if (!sunxi_can_probe(dev))
                 return -ENODEV;
 
         dev->flags |= IFF_ECHO;        /* support local echo */
         dev->netdev_ops = &sunxican_netdev_ops;
+        dev->ethtool_ops = &sunxi_can_ethtool_ops;
+        dev->sysfs_groups[0] = &sunxi_can_attr_group;
+
+        set_reset_mode(dev, true);
 
-        set_reset_mode(dev);
+        if (id_stats) {
+                priv->id_stats = vmalloc(sizeof(*priv->id_stats));
+                if (!priv->id_stats)
+                        return -ENOMEM;
+                sunxi_can_id_stats_clear(priv->id_stats);
+        }
         
-        return register_candev(dev);
+        err = register_candev(dev);
+        if (err) {
+                vfree(priv->id_stats);
+                priv->id_stats = NULL;
+                return err;
+        }
+
+        sunxi_can_debugfs_init(dev);
+
+        return 0;
 }
 EXPORT_SYMBOL_GPL(register_sunxicandev);
 
 void unregister_sunxicandev(struct net_device *dev)
 {
-        set_reset_mode(dev);
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        debugfs_remove_recursive(priv->debugfs);
+        set_reset_mode(dev, true);
         unregister_candev(dev);
+
+        /* the interface is closed, nothing updates the table any more */
+        vfree(priv->id_stats);
+        priv->id_stats = NULL;
 }
 EXPORT_SYMBOL_GPL(unregister_sunxicandev);
 
-static __init int sunxi_can_init(void)
+/*
+* one "sunxi_can" platform device per controller, each with its own
+* register window, interrupt and clocks
+*/
+static int __devinit sunxi_can_plat_probe(struct platform_device *pdev)
 {
+        struct sunxi_can_platform_data *pdata = pdev->dev.platform_data;
         struct sunxi_can_priv *priv;
+        struct net_device *dev;
+        struct resource *res;
+        struct clk *mod;
+        int irq, err;
+
+        res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+        irq = platform_get_irq(pdev, 0);
+        if (!pdata || !res || irq < 0)
+                return -ENODEV;
+
+        dev = alloc_sunxicandev(0);
+        if (!dev)
+                return -ENOMEM;
+        priv = netdev_priv(dev);
+
+        priv->base = devm_request_and_ioremap(&pdev->dev, res);
+        if (!priv->base) {
+                err = -EBUSY;
+                goto exit_free;
+        }
+
+        priv->clk = clk_get(&pdev->dev, pdata->clk_gate);
+        if (IS_ERR(priv->clk)) {
+                err = PTR_ERR(priv->clk);
+                goto exit_free;
+        }
+        mod = clk_get(&pdev->dev, pdata->clk_mod);
+        if (IS_ERR(mod)) {
+                err = PTR_ERR(mod);
+                goto exit_put;
+        }
+        priv->can.clock.freq = clk_get_rate(mod);
+        clk_put(mod);
+
+        err = clk_enable(priv->clk);
+        if (err)
+                goto exit_put;
+
+        dev->irq = irq;
+        dev->base_addr = res->start;
+        priv->irq_flags = 0;
+        SET_NETDEV_DEV(dev, &pdev->dev);
+        platform_set_drvdata(pdev, dev);
+
+        chipset_init(dev, pdata->para);
+        err = register_sunxicandev(dev);
+        if (err) {
+                dev_err(&pdev->dev, "registering %s failed (err=%d)\n", DRV_NAME, err);
+                goto exit_disable;
+        }
+
+        dev_info(&pdev->dev, "%s device registered (reg_base=0x%08lx, irq=%d)\n",
+                 DRV_NAME, dev->base_addr, dev->irq);
+
+        return 0;
+
+exit_disable:
+        clk_disable(priv->clk);
+exit_put:
+        clk_put(priv->clk);
+exit_free:
+        platform_set_drvdata(pdev, NULL);
+        free_sunxicandev(dev);
+
+        return err;
+}
+
+static int __devexit sunxi_can_plat_remove(struct platform_device *pdev)
+{
+        struct net_device *dev = platform_get_drvdata(pdev);
+        struct sunxi_can_priv *priv = netdev_priv(dev);
+
+        unregister_sunxicandev(dev);
+        clk_disable(priv->clk);
+        clk_put(priv->clk);
+        platform_set_drvdata(pdev, NULL);
+        free_sunxicandev(dev);
+
+        return 0;
+}
+
+static struct platform_driver sunxi_can_driver = {
+        .probe = sunxi_can_plat_probe,
+        .remove = __devexit_p(sunxi_can_plat_remove),
+        .driver = {
+                .name = DRV_NAME,
+                .owner = THIS_MODULE,
+        },
+};
+
+/*
+* the A10/A20 controller is described by script.bin rather than by board
+* code, so the driver registers its platform device itself; further
+* controllers are added by the board as "sunxi_can" platform devices
+*/
+#define SUNXI_CAN0_PHYS 0x01C2BC00
+#define SUNXI_CAN_REG_SIZE 0x400
+
+static struct resource sunxi_can0_resources[] = {
+        {
+                .start = SUNXI_CAN0_PHYS,
+                .end = SUNXI_CAN0_PHYS + SUNXI_CAN_REG_SIZE - 1,
+                .flags = IORESOURCE_MEM,
+        }, {
+                .start = SW_INT_IRQNO_CAN,
+                .end = SW_INT_IRQNO_CAN,
+                .flags = IORESOURCE_IRQ,
+        },
+};
+
+static struct sunxi_can_platform_data sunxi_can0_pdata = {
+        .para = "can_para",
+        .clk_gate = "apb_can",
+        .clk_mod = "can",
+};
+
+static struct platform_device *sunxi_can0;
+
+static __init int sunxi_can_init(void)
+{
         int err = 0;
 		int ret = 0;
 		int used = 0;
 		
-        sunxican_dev = alloc_sunxicandev(0);
-        if(!sunxican_dev) {
-                pr_info("alloc sunxicandev fail\n");
-        }
-	
-		ret = script_parser_fetch("can_para", "can_used", &used, sizeof (used));
-		if ( ret || used == 0) {
-			pr_info("[sunxi-can] Cannot setup CANBus driver, maybe not configured in script.bin?");
-			goto exit_free;
-		}
-		
-        priv = netdev_priv(sunxican_dev);
-        sunxican_dev->irq = SW_INT_IRQNO_CAN;
-        priv->irq_flags = 0;
-        priv->can.clock.freq = clk_get_rate(clk_get(NULL, "can"));
-        chipset_init(sunxican_dev);
-        err = register_sunxicandev(sunxican_dev);
-        if(err) {
-                dev_err(&sunxican_dev->dev, "registering %s failed (err=%d)\n", DRV_NAME, err);
-                goto exit_free;
-        }
+        sunxi_can_debugfs = debugfs_create_dir(DRV_NAME, NULL);
+
+        err = platform_driver_register(&sunxi_can_driver);
+        if (err)
+                goto exit_debugfs;
 
-        dev_info(&sunxican_dev->dev, "%s device registered (reg_base=0x%08x, irq=%d)\n",
-                 DRV_NAME, CAN_BASE0, sunxican_dev->irq);
+        ret = script_parser_fetch("can_para", "can_used", &used, sizeof (used));
+        if (ret || used == 0) {
+                pr_info("[sunxi-can] Cannot setup CANBus driver, maybe not configured in script.bin?");
+        } else {
+                sunxi_can0 = platform_device_register_resndata(NULL, DRV_NAME, 0,
+                                                               sunxi_can0_resources,
+                                                               ARRAY_SIZE(sunxi_can0_resources),
+                                                               &sunxi_can0_pdata,
+                                                               sizeof(sunxi_can0_pdata));
+                if (IS_ERR(sunxi_can0)) {
+                        err = PTR_ERR(sunxi_can0);
+                        sunxi_can0 = NULL;
+                        goto exit_driver;
+                }
+        }
 
         pr_info("%s CAN netdevice driver\n", DRV_NAME);
 
         return 0;
 
-exit_free:
-        free_sunxicandev(sunxican_dev);
+exit_driver:
+        platform_driver_unregister(&sunxi_can_driver);
+exit_debugfs:
+        debugfs_remove_recursive(sunxi_can_debugfs);
 
         return err;
 }
@@ -687,8 +3693,10 @@ module_init(sunxi_can_init);
 
 static __exit void sunxi_can_exit(void)
 {
-        unregister_sunxicandev(sunxican_dev);
-        free_sunxicandev(sunxican_dev);
+        if (sunxi_can0)
+                platform_device_unregister(sunxi_can0);
+        platform_driver_unregister(&sunxi_can_driver);
+        debugfs_remove_recursive(sunxi_can_debugfs);
 
         pr_info("%s: driver removed\n", DRV_NAME);
 }
@@ -12,39 +12,45 @@
 #define SUNXI_CAN_H
 
 #include <linux/irqreturn.h>
+#include <linux/ethtool.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/timer.h>
+#include <linux/rcupdate.h>
 #include <linux/can/dev.h>
 
-#define SUNXI_CAN_ECHO_SKB_MAX        1 /* the SUN7I, SUN4I CAN has one TX buffer object */
-
-/* Registers' address */
-#define CAN_BASE0                        0xF1C2BC00
-#define CAN_MSEL_ADDR                        (CAN_BASE0 + 0x0000)         //Can Mode Select Register
-#define CAN_CMD_ADDR                        (CAN_BASE0 + 0x0004)         //Can Command Register
-#define CAN_STA_ADDR         (CAN_BASE0 + 0x0008)         //Can Status Register
-#define CAN_INT_ADDR         (CAN_BASE0 + 0x000c)         //Can Interrupt Flag Register
-#define CAN_INTEN_ADDR         (CAN_BASE0 + 0x0010)         //Can Interrupt Enable Register
-#define CAN_BTIME_ADDR         (CAN_BASE0 + 0x0014)         //Can Bus Timing 0 Register
-#define CAN_TEWL_ADDR         (CAN_BASE0 + 0x0018)         //Can Tx Error Warning Limit Register
-#define CAN_ERRC_ADDR         (CAN_BASE0 + 0x001c)         //Can Error Counter Register
-#define CAN_RMCNT_ADDR         (CAN_BASE0 + 0x0020)         //Can Receive Message Counter Register
-#define CAN_RBUFSA_ADDR         (CAN_BASE0 + 0x0024)         //Can Receive Buffer Start Address Register
-#define CAN_BUF0_ADDR         (CAN_BASE0 + 0x0040)         //Can Tx/Rx Buffer 0 Register
-#define CAN_BUF1_ADDR         (CAN_BASE0 + 0x0044)         //Can Tx/Rx Buffer 1 Register
-#define CAN_BUF2_ADDR         (CAN_BASE0 + 0x0048)         //Can Tx/Rx Buffer 2 Register
-#define CAN_BUF3_ADDR         (CAN_BASE0 + 0x004c)         //Can Tx/Rx Buffer 3 Register
-#define CAN_BUF4_ADDR         (CAN_BASE0 + 0x0050)         //Can Tx/Rx Buffer 4 Register
-#define CAN_BUF5_ADDR         (CAN_BASE0 + 0x0054)         //Can Tx/Rx Buffer 5 Register
-#define CAN_BUF6_ADDR         (CAN_BASE0 + 0x0058)         //Can Tx/Rx Buffer 6 Register
-#define CAN_BUF7_ADDR         (CAN_BASE0 + 0x005c)         //Can Tx/Rx Buffer 7 Register
-#define CAN_BUF8_ADDR         (CAN_BASE0 + 0x0060)         //Can Tx/Rx Buffer 8 Register
-#define CAN_BUF9_ADDR         (CAN_BASE0 + 0x0064)         //Can Tx/Rx Buffer 9 Register
-#define CAN_BUF10_ADDR         (CAN_BASE0 + 0x0068)         //Can Tx/Rx Buffer 10 Register
-#define CAN_BUF11_ADDR         (CAN_BASE0 + 0x006c)         //Can Tx/Rx Buffer 11 Register
-#define CAN_BUF12_ADDR         (CAN_BASE0 + 0x0070)         //Can Tx/Rx Buffer 12 Register
-#define CAN_ACPC_ADDR         (CAN_BASE0 + 0x0040)         //Can Acceptance Code 0 Register
-#define CAN_ACPM_ADDR         (CAN_BASE0 + 0x0044)         //Can Acceptance Mask 0 Register
-#define CAN_RBUF_RBACK_START_ADDR        (CAN_BASE0 + 0x0180)        //CAN transmit buffer for read back register
-#define CAN_RBUF_RBACK_END_ADDR                (CAN_BASE0 + 0x01b0)        //CAN transmit buffer for read back register
+#define SUNXI_CAN_ECHO_SKB_MAX        (SUNXI_CAN_TX_RING_MAX + 1) /* one echo skb per frame in the TX ring or the TX buffer */
+
+/* Registers' offsets from sunxi_can_priv.base */
+#define CAN_MSEL_ADDR                        0x0000         //Can Mode Select Register
+#define CAN_CMD_ADDR                        0x0004         //Can Command Register
+#define CAN_STA_ADDR         0x0008         //Can Status Register
+#define CAN_INT_ADDR         0x000c         //Can Interrupt Flag Register
+#define CAN_INTEN_ADDR         0x0010         //Can Interrupt Enable Register
+#define CAN_BTIME_ADDR         0x0014         //Can Bus Timing 0 Register
+#define CAN_TEWL_ADDR         0x0018         //Can Tx Error Warning Limit Register
+#define CAN_ERRC_ADDR         0x001c         //Can Error Counter Register
+#define CAN_RMCNT_ADDR         0x0020         //Can Receive Message Counter Register
+#define CAN_RBUFSA_ADDR         0x0024         //Can Receive Buffer Start Address Register
+#define CAN_BUF0_ADDR         0x0040         //Can Tx/Rx Buffer 0 Register
+#define CAN_BUF1_ADDR         0x0044         //Can Tx/Rx Buffer 1 Register
+#define CAN_BUF2_ADDR         0x0048         //Can Tx/Rx Buffer 2 Register
+#define CAN_BUF3_ADDR         0x004c         //Can Tx/Rx Buffer 3 Register
+#define CAN_BUF4_ADDR         0x0050         //Can Tx/Rx Buffer 4 Register
+#define CAN_BUF5_ADDR         0x0054         //Can Tx/Rx Buffer 5 Register
+#define CAN_BUF6_ADDR         0x0058         //Can Tx/Rx Buffer 6 Register
+#define CAN_BUF7_ADDR         0x005c         //Can Tx/Rx Buffer 7 Register
+#define CAN_BUF8_ADDR         0x0060         //Can Tx/Rx Buffer 8 Register
+#define CAN_BUF9_ADDR         0x0064         //Can Tx/Rx Buffer 9 Register
+#define CAN_BUF10_ADDR         0x0068         //Can Tx/Rx Buffer 10 Register
+#define CAN_BUF11_ADDR         0x006c         //Can Tx/Rx Buffer 11 Register
+#define CAN_BUF12_ADDR         0x0070         //Can Tx/Rx Buffer 12 Register
+#define CAN_ACPC_ADDR         0x0040         //Can Acceptance Code 0 Register
+#define CAN_ACPM_ADDR         0x0044         //Can Acceptance Mask 0 Register
+#define CAN_RBUF_RBACK_START_ADDR        0x0180         //CAN transmit buffer for read back register
+#define CAN_RBUF_RBACK_END_ADDR                0x01b0         //CAN transmit buffer for read back register
 
 /* Controller Register Description */
 
@@ -151,12 +157,235 @@
 #define SINGLE_FLTER_MODE         1
 #define DUAL_FILTER_MODE         2
 
+/*
+* register accessors, all controller MMIO of the driver goes through these
+* reg is one of the CAN_*_ADDR offsets into the instance's register window
+* a build outside the kernel may define them before including this header
+* to run the driver against an emulated register file; sim/ instead
+* routes readl()/writel() of its kernel shim to a model of the controller
+*/
+#ifndef sunxi_can_read
+#define sunxi_can_read(priv, reg) readl((priv)->base + (reg))
+#endif
+#ifndef sunxi_can_write
+#define sunxi_can_write(priv, val, reg) writel(val, (priv)->base + (reg))
+#endif
+#ifndef sunxi_can_read_relaxed
+#define sunxi_can_read_relaxed(priv, reg) readl_relaxed((priv)->base + (reg))
+#endif
+#ifndef sunxi_can_write_relaxed
+#define sunxi_can_write_relaxed(priv, val, reg) writel_relaxed(val, (priv)->base + (reg))
+#endif
+
+/*
+* platform data of a "sunxi_can" platform device, next to its register
+* window (IORESOURCE_MEM) and interrupt (IORESOURCE_IRQ)
+*/
+struct sunxi_can_platform_data {
+        char *para;             /* script.bin section with the can_tx/can_rx pins */
+        const char *clk_gate;   /* bus clock gate of the controller */
+        const char *clk_mod;    /* clock the bit timing derives from */
+};
+
 /*
 * Flags for sun7icanpriv.flags
 */
 #define SUNXI_CAN_CUSTOM_IRQ_HANDLER 0x1
 
 #define SUNXI_CAN_MAX_IRQ 20        /* max. number of interrupts handled in ISR */
+#define SUNXI_CAN_ISR_BUDGET_MIN 4        /* default floor of the ISR frame budget */
+#define SUNXI_CAN_ISR_BUDGET_MAX 64        /* default ceiling of the ISR frame budget */
+#define SUNXI_CAN_ISR_BUDGET_LIMIT 256        /* RX FIFO depth, no point in a larger budget */
+#define SUNXI_CAN_ISR_TIME_BUDGET_US 200        /* default time budget of one ISR invocation */
+#define SUNXI_CAN_RX_FIFO_BYTES 64        /* RX FIFO size, an EFF frame with 8 data bytes takes 13 */
+#define SUNXI_CAN_RX_FIFO_BITS_PER_BYTE 9        /* fewest bus bits per RX FIFO byte, SFF/EFF with 8 data bytes */
+#define SUNXI_CAN_HRPOLL_WINDOW_NS (10 * NSEC_PER_MSEC)        /* interrupt/frame rate measurement window */
+#define SUNXI_CAN_HRPOLL_PERIOD_MIN_NS (20 * NSEC_PER_USEC)        /* shortest RX poll period */
+#define SUNXI_CAN_NAPI_WEIGHT 16        /* max. number of frames received per NAPI poll */
+#define SUNXI_CAN_RX_BATCH 16        /* max. number of frames handed up per RX FIFO pass */
+#define SUNXI_CAN_BUF_WINDOW 13        /* BUF0..BUF12 of the TX/RX buffer, frame info, id and data of an EFF frame */
+#define SUNXI_CAN_RX_RING_MAX 1024        /* max. number of records in the RX ring */
+#define SUNXI_CAN_SKB_POOL_MAX 256        /* max. number of preallocated skbs */
+#define SUNXI_CAN_BERR_WINDOW (HZ / 10)        /* bus error rate measurement window */
+#define SUNXI_CAN_BERR_BACKOFF_MAX_MS 10000        /* longest bus error interrupt throttle */
+#define SUNXI_CAN_MODE_TIMEOUT_US 1000        /* longest wait for a mode change */
+#define SUNXI_CAN_MODE_SPIN_US 50        /* longest busy wait for a mode change in atomic context */
+#define SUNXI_CAN_BUSOFF_HIST 12        /* bus-off recovery histogram, bucket i < 2^i ms, the last takes the rest */
+#define SUNXI_CAN_ID_STATS_EFF_BITS 10        /* log2 of the EFF identifiers tracked per device */
+#define SUNXI_CAN_ID_STATS_EFF (1 << SUNXI_CAN_ID_STATS_EFF_BITS)
+#define SUNXI_CAN_ID_STATS_PROBE 8        /* hash slots tried for an EFF identifier */
+#define SUNXI_CAN_TX_RING_MAX 256        /* max. number of frames queued in the TX ring */
+#define SUNXI_CAN_TX_PRIO_CLASS_BITS 2        /* priority classes are the top ID bits */
+#define SUNXI_CAN_TX_PRIO_CLASSES (1 << SUNXI_CAN_TX_PRIO_CLASS_BITS)
+#define SUNXI_CAN_MAX_ID_RANGES 64        /* max. number of ranges in an ID set */
+#define SUNXI_CAN_COVER_EXHAUSTIVE 12        /* ranges up to which every dual filter split is tried */
+#define SUNXI_CAN_BENCH_INFLIGHT 1024        /* max. number of benchmark frames in flight */
+#define SUNXI_CAN_BENCH_BUCKET_NS 5000        /* width of a benchmark latency histogram bucket */
+#define SUNXI_CAN_BENCH_BUCKETS 2000        /* histogram range 0..10 ms, the last bucket takes the rest */
+
+/*
+* driver statistics, reported by ethtool -S in this order
+* only unsigned long members, the ethtool code walks the structure as an array
+*/
+struct sunxi_can_xstats {
+        unsigned long mode_switches;        /* reset <-> normal mode transitions */
+        unsigned long mode_timeouts;        /* mode transitions the controller did not complete in time */
+        unsigned long shadow_drift;        /* registers found to differ from their shadow */
+        unsigned long tx_aborts;        /* frames aborted for a higher-priority one */
+        unsigned long rx_mmio_reads;        /* register reads on the RX path */
+        unsigned long rx_mmio_writes;        /* register writes on the RX path */
+        unsigned long rx_drained;        /* frames read from the RX FIFO */
+        unsigned long rx_passes;        /* RX FIFO passes that found frames */
+        unsigned long rx_pass_max;        /* most frames read in one pass */
+        unsigned long rx_alloc_failed;        /* frames dropped for lack of an skb */
+        unsigned long err_alloc_failed;        /* error frames dropped for lack of an skb */
+        unsigned long hw_filter_accepted;        /* frames passed by the acceptance filter */
+        unsigned long sw_filter_rejected;        /* frames dropped by the filter bank */
+        unsigned long tx_mmio_reads;        /* register reads on the TX path */
+        unsigned long tx_mmio_writes;        /* register writes on the TX path */
+        unsigned long isr_calls;        /* ISR invocations that found an interrupt */
+        unsigned long isr_loops;        /* iterations of the ISR loop */
+        unsigned long isr_budget_exhausted;        /* ISR left on its iteration or time budget */
+        unsigned long isr_deferrals;        /* RX work handed from the ISR to the NAPI poll */
+        unsigned long isr_mmio_reads;        /* register reads of the ISR loop itself */
+        unsigned long isr_mmio_writes;        /* register writes of the ISR loop itself */
+        unsigned long rx_irq_latency_max_ns;        /* worst RX interrupt to netif delivery */
+        unsigned long rx_poll_switches;        /* switches between RX interrupts and hrtimer polling */
+        unsigned long skb_pool_hits;        /* skbs taken from the pool */
+        unsigned long skb_pool_misses;        /* skbs allocated in place, the pool was empty */
+        unsigned long skb_pool_refills;        /* pool refill rounds */
+        unsigned long skb_pool_refill_max_ns;        /* worst time from refill request to full pool */
+        unsigned long err_events;        /* error interrupts with something to report */
+        unsigned long err_frames;        /* error frames sent */
+        unsigned long err_coalesced;        /* error events merged into another event's frame */
+        unsigned long err_overruns;        /* RX overrun events, coalesced or not */
+        unsigned long err_bus_errors;        /* bus error events, coalesced or not */
+        unsigned long err_arb_lost;        /* arbitration lost events, coalesced or not */
+        unsigned long berr_storms;        /* bus error interrupts throttled for a storm */
+        unsigned long berr_suppressed;        /* estimated bus error interrupts missed while throttled */
+        unsigned long busoff_recoveries;        /* bus-off states left by the driver's own recovery */
+        unsigned long id_stats_overflow;        /* EFF frames not counted, no free slot in the ID table */
+        unsigned long irq_src[8];        /* interrupts per CAN_INT_ADDR bit */
+};
+
+/*
+* receive statistics of one identifier, 32 bytes so two share a cache line
+* written only by the RX path, readers see each field atomically but not
+* the entry as a whole; counters wrap like the 32-bit netdev stats, gaps
+* saturate at ~4.3s
+*/
+struct sunxi_can_id_stat {
+        u32 id;                 /* identifier, CAN_EFF_FLAG set for EFF, 0 for a free EFF slot */
+        u32 count;              /* frames received */
+        u32 min_gap_ns;         /* shortest time between two frames */
+        u32 max_gap_ns;         /* longest time between two frames */
+        u64 bytes;              /* data bytes received */
+        u64 last_ns;            /* ktime of the latest frame */
+};
+
+/*
+* per-identifier receive statistics, also the layout of the binary
+* debugfs snapshot: all SFF identifiers indexed directly, EFF ones in an
+* open-addressing hash
+*/
+struct sunxi_can_id_stats {
+        struct sunxi_can_id_stat sff[CAN_SFF_MASK + 1];
+        struct sunxi_can_id_stat eff[SUNXI_CAN_ID_STATS_EFF];
+};
+
+/*
+* set of wanted receive identifiers, sorted and merged ranges
+*/
+struct sunxi_can_id_range {
+        u32 lo;
+        u32 hi;
+        bool eff;
+        unsigned long hits;     /* frames received in this range */
+};
+
+struct sunxi_can_id_set {
+        struct rcu_head rcu;
+        unsigned int n;         /* ranges, SFF ranges first */
+        unsigned int n_sff;
+        u64 ids;                /* identifiers in the set */
+        u64 accepted;           /* identifiers the acceptance filter lets through */
+        unsigned long sff_map[BITS_TO_LONGS(CAN_SFF_MASK + 1)];
+        struct sunxi_can_id_range range[0];
+};
+
+/*
+* code/mask pair of the acceptance filter as a cube of identifiers:
+* every base ^ x with x a subset of var
+*/
+struct sunxi_can_cube {
+        u32 base;
+        u32 var;
+};
+
+/*
+* frame waiting in the TX ring
+*/
+struct sunxi_can_tx_entry {
+        u16 echo;               /* echo skb slot, filled in start_xmit */
+        u8 dlc;
+        bool loaded;            /* was in the TX buffer before, its latency is recorded */
+        u32 key;                /* arbitration priority, lower wins */
+        ktime_t queued;
+        u8 len;                        /* registers used in regs */
+        u8 regs[SUNXI_CAN_BUF_WINDOW];        /* image of the TX buffer window BUF0..BUF12 */
+};
+
+/*
+* TX queueing latency of one priority class
+*/
+struct sunxi_can_tx_lat {
+        unsigned long frames;
+        u64 total_ns;
+        u64 max_ns;
+};
+
+/* error events waiting for the next error frame */
+struct sunxi_can_err_acc {
+        struct can_frame cf;        /* summary of the pending events */
+        unsigned int events;        /* events merged into cf */
+        unsigned int overruns;        /* pending events per type */
+        unsigned int bus_errors;
+        unsigned int arb_lost;
+        unsigned long last;        /* jiffies of the last error frame */
+};
+
+/* frame copied out of the RX FIFO by the ISR */
+struct sunxi_can_rx_rec {
+        u32 win[SUNXI_CAN_BUF_WINDOW];        /* RX frame window BUF0..BUF12 */
+        s64 irq_ns;                        /* time of the interrupt that read it */
+};
+
+/* results of a loopback benchmark run */
+struct sunxi_can_bench_result {
+        unsigned long tx;        /* frames handed to dev_queue_xmit() */
+        unsigned long tx_dropped;        /* frames the stack refused */
+        unsigned long rx;        /* frames received back */
+        unsigned long rx_overruns;        /* RX FIFO overruns during the run */
+        u64 elapsed_ns;
+        u64 isr_ns;        /* time spent in the ISR */
+        u64 poll_ns;        /* time spent in the NAPI poll */
+        u64 p50_ns, p90_ns, p99_ns, max_ns;        /* submit to receive latency */
+};
+
+struct sunxi_can_bench {
+        struct mutex lock;        /* one run at a time */
+        bool active;        /* controller switched to loopback for a run */
+        u32 secs;        /* settings of the next run */
+        u32 id;
+        u32 eff;
+        u8 dlc;
+        canid_t can_id;        /* identifier of the frames of the current run */
+        u32 tx_seq;        /* sequence number of the next frame sent */
+        u32 rx_next;        /* sequence number of the next frame expected */
+        ktime_t *sent;        /* submit time per in-flight sequence number */
+        u32 *hist;        /* latency histogram */
+        struct sunxi_can_bench_result result;
+};
 
 /*
 * sun7i_can private data structure
@@ -169,8 +398,90 @@ struct sunxi_can_priv {
         void *priv;                /* for board-specific data */
         struct net_device *dev;
 
+        void __iomem *base;        /* register window of this controller */
+        struct clk *clk;           /* bus clock gate of this controller */
+
         unsigned long irq_flags; /* for request_irq() */
-        spinlock_t cmdreg_lock; /* lock for concurrent cmd register writes */
+        raw_spinlock_t cmdreg_lock; /* lock for concurrent cmd register writes */
+        raw_spinlock_t inten_lock;  /* lock for interrupt enable register updates */
+        raw_spinlock_t msel_lock;   /* lock for mode register updates */
+        u32 msel;               /* last value written to CAN_MSEL_ADDR */
+        u32 inten;              /* last value written to CAN_INTEN_ADDR */
+        u32 btime;              /* last value written to CAN_BTIME_ADDR */
+        u64 mode_min_ns;        /* shortest mode transition */
+        u64 mode_max_ns;        /* longest mode transition */
+        u64 mode_total_ns;      /* sum of all mode transitions */
+        int irq_thread_prio;    /* priority applied to the IRQ thread, 0 if not yet */
+        s64 rx_irq_ns;          /* interrupt time of the oldest frame not handed up, 0 if none */
+
+        struct napi_struct napi; /* RX polling context */
+
+        struct sunxi_can_rx_rec *rx_recs; /* RX ring, ISR to NAPI poll */
+        unsigned int rx_recs_len; /* power of 2, 0 without RX ring */
+        unsigned int rx_head;   /* next record written, by the ISR only */
+        unsigned int rx_tail;   /* next record read, by the NAPI poll only */
+        bool rx_recs_full;      /* ISR stopped filling the RX ring, RX interrupts masked */
+        bool rx_napi_masked;    /* RX interrupts masked until the NAPI poll drained the FIFO */
+
+        raw_spinlock_t pool_lock; /* lock for the skb pool */
+        struct sk_buff **pool;  /* preallocated RX and error frame skbs */
+        unsigned int pool_len;
+        unsigned int pool_count; /* skbs in the pool */
+        s64 pool_refill_ns;     /* time the pending refill was requested, 0 if none */
+        struct work_struct pool_work;
+
+        raw_spinlock_t err_lock; /* lock for err_acc */
+        struct sunxi_can_err_acc err_acc;
+        struct timer_list err_timer; /* sends the pending error summary */
+
+        bool berr_throttled;    /* BERR_IRQ_EN cleared for a bus error storm */
+        unsigned long berr_window; /* jiffies, start of the bus error rate window */
+        unsigned int berr_count; /* bus error interrupts in the window */
+        unsigned long berr_rate; /* bus error interrupts per second at the last storm */
+        unsigned long berr_masked; /* jiffies, bus error interrupts throttled since */
+        unsigned long berr_rearmed; /* jiffies, bus error interrupts last re-enabled */
+        unsigned int berr_backoff_ms; /* current throttle time */
+        struct timer_list berr_timer; /* re-enables bus error interrupts */
+
+        bool busoff_recovering; /* bus-off recovery sequence requested */
+        s64 busoff_ns;          /* time bus-off was entered */
+        u64 busoff_max_ns;      /* longest recovery */
+        u64 busoff_last_ns;     /* latest recovery */
+        unsigned long busoff_hist[SUNXI_CAN_BUSOFF_HIST]; /* recovery times */
+
+        unsigned int isr_budget;        /* frames the ISR may receive, adapted to the RX backlog */
+        unsigned int isr_budget_min;
+        unsigned int isr_budget_max;
+        unsigned int isr_time_budget_us;        /* 0 for no time limit */
+
+        bool hrpoll;            /* RX interrupts masked, the FIFO is polled from poll_timer */
+        struct hrtimer poll_timer;
+        u64 poll_period_ns;
+        s64 rate_window_ns;     /* start of the current rate measurement window */
+        unsigned long rate_count; /* RX interrupts, or frames when polling, at window start */
+        unsigned long rx_irq_count; /* RX interrupts seen by the hard handler */
+
+        raw_spinlock_t tx_lock; /* lock for the TX buffer and TX ring */
+        struct sunxi_can_tx_entry *tx_ring; /* frames waiting for the TX buffer */
+        unsigned int tx_ring_len;
+        unsigned int tx_count;  /* frames in the TX ring */
+        struct sunxi_can_tx_entry tx_cur; /* frame in the TX buffer */
+        bool tx_busy;           /* TX buffer holds a frame */
+        bool tx_aborting;       /* ABORT_REQ issued for tx_cur */
+        bool tx_halted;         /* controller in reset mode, TX buffer not usable */
+        unsigned long tx_echo_used[BITS_TO_LONGS(SUNXI_CAN_ECHO_SKB_MAX)]; /* echo slots in use */
+        struct sunxi_can_tx_lat tx_lat[SUNXI_CAN_TX_PRIO_CLASSES];
+
+        u8 filter_mode;         /* FILTER_CLOSE, SINGLE_FLTER_MODE or DUAL_FILTER_MODE */
+        u32 acp_code;           /* CAN_ACPC_ADDR value */
+        u32 acp_mask;           /* CAN_ACPM_ADDR value, set bits are "don't care" */
+        struct sunxi_can_id_set __rcu *rx_ids; /* filter bank, NULL accepts all */
+
+        struct sunxi_can_xstats xstats;
+
+        struct dentry *debugfs;
+        struct sunxi_can_bench bench;
+        struct sunxi_can_id_stats *id_stats; /* per-identifier RX statistics, NULL if disabled */
 
         u16 flags;                /* custom mode flags */
 };